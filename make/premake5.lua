@@ -2,16 +2,44 @@
 
 rootdir = path.join(path.getdirectory(_SCRIPT), "..")
 
+-- The emulator core.  None of these may depend on SFML, PortAudio or the UI so that the core builds and runs on
+-- machines without a display or sound card.
+corefiles = {
+	"../src/config.h",
+	"../src/types.h",
+	"../src/asm/asm.*",
+	"../src/asm/disasm.*",
+	"../src/asm/lex.*",
+	"../src/asm/stringtable.h",
+	"../src/audio/audio.*",
+	"../src/emulator/callstack.*",
+	"../src/emulator/nxfile.*",
+	"../src/emulator/profiler.*",
+	"../src/emulator/rewind.*",
+	"../src/emulator/roms.cc",
+	"../src/emulator/scheduler.*",
+	"../src/emulator/snapshot.*",
+	"../src/emulator/spectrum.*",
+	"../src/emulator/z80.*",
+	"../src/tape/tape.*",
+	"../src/utils/filename.*",
+	"../src/utils/format.*",
+}
+
 filter { "platforms:Win64" }
 	system "Windows"
 	architecture "x64"
 
+filter { "platforms:Linux64" }
+	system "Linux"
+	architecture "x64"
+
 
 -- Solution
 solution "nx"
 	language "C++"
 	configurations { "Debug", "Release" }
-	platforms { "Win64" }
+	platforms { "Win64", "Linux64" }
 	location "../_build"
     --debugdir "../data"
     characterset "MBCS"
@@ -36,11 +64,23 @@ solution "nx"
         flags { "FatalWarnings" }
 		optimize "full"
 
+	configuration "Win*"
+		defines {
+			"WIN32",
+			"_SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING",
+		}
+		buildoptions { "/std:c++17" }
+
+	configuration "Linux*"
+		buildoptions { "-std=c++17" }
+		disablewarnings { "multichar" }		-- Four-character codes such as 'NX00' are used for file sections
+
 	-- Projects
 	project "nx"
 		targetdir "../_bin/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
 		objdir "../_obj/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
         kind "WindowedApp"
+        removeplatforms { "Linux64" }
 		files {
             "../src/**.h",
 			"../src/**.cc",
@@ -50,11 +90,14 @@ solution "nx"
             "../README.md",
             "../etc/keys.txt",
 		}
+        removefiles(corefiles)
+        removefiles { "../src/headless/**", "../src/bench/**" }
         includedirs {
             "../include",
             "../src",
         }
         links {
+            "nx-core",
             "flac.lib",
             "freetype.lib",
             "ogg.lib",
@@ -103,10 +146,6 @@ solution "nx"
         -- }
 
 		configuration "Win*"
-			defines {
-				"WIN32",
-                "_SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING",
-			}
 			flags {
 				--"StaticRuntime",
 				--"NoMinimalRebuild",
@@ -115,5 +154,51 @@ solution "nx"
             linkoptions {
                 "/ignore:4099"
             }
-            buildoptions { "/std:c++17" }
+
+	-- Emulator core library, shared by the windowed and headless front ends
+	project "nx-core"
+		targetdir "../_bin/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+		objdir "../_obj/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+        kind "StaticLib"
+		files(corefiles)
+        includedirs {
+            "../src",
+        }
+
+	-- Runs snapshots and tapes with no window or audio, for batch regression and benchmarking
+	project "nx-headless"
+		targetdir "../_bin/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+		objdir "../_obj/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+        kind "ConsoleApp"
+		files {
+            "../src/headless/**.h",
+			"../src/headless/**.cc",
+		}
+        includedirs {
+            "../src",
+        }
+        links {
+            "nx-core",
+        }
+
+		configuration "Linux*"
+            links {
+                "pthread",
+            }
+
+	-- Benchmarks for the emulator's hot paths
+	project "nx-bench"
+		targetdir "../_bin/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+		objdir "../_obj/%{cfg.platform}/%{cfg.buildcfg}/%{prj.name}"
+        kind "ConsoleApp"
+		files {
+            "../src/bench/**.h",
+			"../src/bench/**.cc",
+		}
+        includedirs {
+            "../src",
+        }
+        links {
+            "nx-core",
+        }
 
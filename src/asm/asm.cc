@@ -3,7 +3,6 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 #include <asm/asm.h>
-#include <asm/overlay_asm.h>
 #include <emulator/nxfile.h>
 #include <emulator/spectrum.h>
 #include <utils/filename.h>
@@ -170,13 +169,13 @@ void MemoryMap::upload(Spectrum& speccy)
 // Constructor
 //----------------------------------------------------------------------------------------------------------------------
 
-Assembler::Assembler(AssemblerWindow& window, Spectrum& speccy)
-    : m_assemblerWindow(window)
+Assembler::Assembler(IAssemblerOutput& output, Spectrum& speccy)
+    : m_output(output)
     , m_speccy(speccy)
     , m_mmap(speccy)
     , m_address(0)
 {
-    window.clear();
+    output.clear();
 
     m_options.m_startAddress = 0;
 }
@@ -363,7 +362,7 @@ void Assembler::startAssembly(const vector<u8>& data, string sourceName)
     //
     // Reset the assembler
     //
-    m_assemblerWindow.clear();
+    m_output.clear();
     m_sessions.clear();
     m_fileStack.clear();
     m_symbolTable.clear();
@@ -387,14 +386,14 @@ void Assembler::startAssembly(const vector<u8>& data, string sourceName)
         m_mmap.upload(m_speccy);
     }
 
-    m_assemblerWindow.output("");
+    m_output.output("");
     if (numErrors())
     {
-        m_assemblerWindow.output(stringFormat("!Assembler error(s): {0}", numErrors()));
+        m_output.output(stringFormat("!Assembler error(s): {0}", numErrors()));
     }
     else
     {
-        m_assemblerWindow.output(stringFormat("*\"{0}\" assembled ok!", sourceName));
+        m_output.output(stringFormat("*\"{0}\" assembled ok!", sourceName));
     }
 }
 
@@ -535,7 +534,7 @@ bool Assembler::assembleFile2(Path fileName)
 
 void Assembler::output(const std::string& msg)
 {
-    m_assemblerWindow.output(msg);
+    m_output.output(msg);
 }
 
 void Assembler::addErrorInfo(const string& fileName, const string& message, int line, int col)
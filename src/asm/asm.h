@@ -88,10 +88,19 @@ using Labels = vector<pair<string, MemoryMap::Address>>;
 
 
 //----------------------------------------------------------------------------------------------------------------------
-// Assembler
+// Assembler output
+// Receives the listing, symbol table and error messages.  The assembler results window implements this in the UI.
 //----------------------------------------------------------------------------------------------------------------------
 
-class AssemblerWindow;
+struct IAssemblerOutput
+{
+    virtual void clear() = 0;
+    virtual void output(const std::string& msg) = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Assembler
+//----------------------------------------------------------------------------------------------------------------------
 
 class Assembler
 {
@@ -100,7 +109,7 @@ public:
     // Public interface
     //------------------------------------------------------------------------------------------------------------------
 
-    Assembler(AssemblerWindow& window,
+    Assembler(IAssemblerOutput& output,
               Spectrum& speccy);
 
     void startAssembly(const vector<u8>& data, string sourceName);
@@ -306,7 +315,7 @@ private:
 
     map<string, Lex>            m_sessions;
     vector<string>              m_fileStack;
-    AssemblerWindow&            m_assemblerWindow;
+    IAssemblerOutput&           m_output;
     Spectrum&                   m_speccy;
 
     // Symbols (labels)
@@ -98,7 +98,7 @@ std::string Disassembler::indexDisplacement(u8 d, std::string ix) const
 OperandType Disassembler::regs8(u8 y) const
 {
     //static const char* regs[] = { "b", "c", "d", "e", "h", "l", "(hl)", "a" };
-    static O regs[] = {
+    static const O regs[] = {
         O::B, O::C,
         O::D, O::E,
         O::H, O::L,
@@ -111,7 +111,7 @@ OperandType Disassembler::regs8(u8 y) const
 OperandType Disassembler::regs16_1(u8 p) const
 {
     //static const char* regs[] = { "bc", "de", "hl", "sp" };
-    static O regs[] = {
+    static const O regs[] = {
         O::BC,
         O::DE,
         O::HL,
@@ -124,7 +124,7 @@ OperandType Disassembler::regs16_1(u8 p) const
 OperandType Disassembler::regs16_2(u8 p) const
 {
     //static const char* regs[] = { "bc", "de", "hl", "af" };
-    static O regs[] = { O::BC, O::DE, O::HL, O::AF };
+    static const O regs[] = { O::BC, O::DE, O::HL, O::AF };
     assert(p >= 0 && p < 4);
     return regs[p];
 }
@@ -150,7 +150,7 @@ OperandType Disassembler::regs8_ix(u8 y, OperandType ix) const
 OperandType Disassembler::regs16_1_ix(u8 p, OperandType ix) const
 {
     //static const char* regs[] = { "bc", "de", "??", "sp" };
-    static O regs[] = { O::BC, O::DE, O::None, O::SP };
+    static const O regs[] = { O::BC, O::DE, O::None, O::SP };
     assert(p >= 0 && p < 4);
     return p == 2 ? ix : regs[p];
 }
@@ -158,7 +158,7 @@ OperandType Disassembler::regs16_1_ix(u8 p, OperandType ix) const
 OperandType Disassembler::regs16_2_ix(u8 p, OperandType ix) const
 {
     //static const char* regs[] = { "bc", "de", "??", "af" };
-    static O regs[] = { O::BC, O::DE, O::None, O::AF };
+    static const O regs[] = { O::BC, O::DE, O::None, O::AF };
     assert(p >= 0 && p < 4);
     return p == 2 ? ix : regs[p];
 }
@@ -166,7 +166,7 @@ OperandType Disassembler::regs16_2_ix(u8 p, OperandType ix) const
 OperandType Disassembler::flags(u8 y) const
 {
     //static const char* flags[] = { "nz", "z", "nc", "c", "po", "pe", "p", "m" };
-    static O flags[] = { O::NZ, O::Z, O::NC, O::C, O::PO, O::PE, O::P, O::M };
+    static const O flags[] = { O::NZ, O::Z, O::NC, O::C, O::PO, O::PE, O::P, O::M };
     assert(y >= 0 && y < 8);
     return flags[y];
 }
@@ -174,7 +174,7 @@ OperandType Disassembler::flags(u8 y) const
 T Disassembler::aluOpCode(u8 y) const
 {
     //static const char* aluOpcodes[] = { "add", "adc", "sub", "sbc", "and", "xor", "or", "cp" };
-    static T aluOpcodes[] = { T::ADD, T::ADC, T::SUB, T::SBC, T::AND, T::XOR, T::OR, T::CP };
+    static const T aluOpcodes[] = { T::ADD, T::ADC, T::SUB, T::SBC, T::AND, T::XOR, T::OR, T::CP };
     assert(y >= 0 && y < 8);
     return aluOpcodes[y];
 }
@@ -182,7 +182,7 @@ T Disassembler::aluOpCode(u8 y) const
 bool Disassembler::aluOperandPrefix(u8 y) const
 {
     //static const char* prefixes[] = { "a,", "a,", "", "a,", "", "", "", "" };
-    static bool prefixes[] = { true, true, false, true, false, false, false, false };
+    static const bool prefixes[] = { true, true, false, true, false, false, false, false };
     assert(y >= 0 && y < 8);
     return prefixes[y];
 }
@@ -190,7 +190,7 @@ bool Disassembler::aluOperandPrefix(u8 y) const
 T Disassembler::rotShift(u8 y) const
 {
     //static const char* opCodes[] = { "rlc", "rrc", "rl", "rr", "sla", "sra", "sl1", "srl" };
-    static T opCodes[] = { T::RLC, T::RRC, T::RL, T::RR, T::SLA, T::SRA, T::SL1, T::SRL };
+    static const T opCodes[] = { T::RLC, T::RRC, T::RL, T::RR, T::SLA, T::SRA, T::SL1, T::SRL };
     assert(y >= 0 && y < 8);
     return opCodes[y];
 }
@@ -655,7 +655,7 @@ void Disassembler::disassembleED(u8 b2, u8 b3, u8 b4)
 
     case 2:
     {
-        static T ops[] = {
+        static const T ops[] = {
             T::LDI,     T::CPI,     T::INI,     T::OUTI,
             T::LDD,     T::CPD,     T::IND,     T::OUTD,
             T::LDIR,    T::CPIR,    T::INIR,    T::OTIR,
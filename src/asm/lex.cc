@@ -6,7 +6,8 @@
 #include <asm/lex.h>
 #include <utils/format.h>
 
-#ifdef __APPLE__
+#ifndef _WIN32
+#include <strings.h>
 #define _strnicmp strncasecmp
 #endif
 
@@ -20,7 +21,7 @@
 //      1 = Can be found within a name.
 //      2 = Can be found within a name but not as the initial character.
 //
-static char gNameChar[128] =
+static const char gNameChar[128] =
 {
     //          00 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e 0f // Characters
     /* 00 */    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <asm/asm.h>
 #include <utils/ui.h>
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -11,13 +12,13 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 
-class AssemblerWindow final : public Window
+class AssemblerWindow final : public Window, public IAssemblerOutput
 {
 public:
     AssemblerWindow(Nx& nx);
 
-    void clear();
-    void output(const std::string& msg);
+    void clear() override;
+    void output(const std::string& msg) override;
 
 protected:
     void onDraw(Draw& draw) override;
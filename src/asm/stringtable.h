@@ -9,7 +9,8 @@
 #include <cstring>
 #include <memory>
 
-#ifdef __APPLE__
+#ifndef _WIN32
+#include <strings.h>
 #define _stricmp strcasecmp
 #define _memicmp strncasecmp
 #endif
@@ -4,175 +4,274 @@
 
 #include <audio/audio.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 
 #define NX_VOLUME       10000
 
+//----------------------------------------------------------------------------------------------------------------------
+// Band-limited step kernel
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace
+{
+    // Each edge is spread over kKernelTaps samples, which delays the output by half of that.  The kernel is worked out
+    // for kKernelPhases positions of the edge between two samples.
+    const int kKernelTaps = 16;
+    const int kKernelPhases = 64;
+
+    // Gain of the high-pass filter that stands in for the speaker's coupling capacitor.  It takes the constant offset
+    // out of the output (about 35Hz at 44.1kHz).
+    const float kHighPass = 0.995f;
+
+    struct StepKernel
+    {
+        float   taps[kKernelPhases][kKernelTaps];
+
+        StepKernel()
+        {
+            const double pi = 3.14159265358979323846;
+            const double cutoff = 0.9;      // Fraction of the Nyquist frequency that is let through
+
+            for (int phase = 0; phase < kKernelPhases; ++phase)
+            {
+                // A Blackman-windowed sinc, centred half the kernel after the edge.  Each phase sums to 1 so that a
+                // step always ends up at its full height.
+                double sum = 0;
+                for (int i = 0; i < kKernelTaps; ++i)
+                {
+                    double x = i - double(phase) / kKernelPhases - kKernelTaps / 2;
+                    double sinc = x == 0 ? 1 : sin(pi * cutoff * x) / (pi * cutoff * x);
+                    double u = x / (kKernelTaps / 2);
+                    double window = fabs(u) >= 1 ? 0 : 0.42 + 0.5 * cos(pi * u) + 0.08 * cos(2 * pi * u);
+                    taps[phase][i] = float(sinc * window);
+                    sum += sinc * window;
+                }
+                for (int i = 0; i < kKernelTaps; ++i) taps[phase][i] = float(taps[phase][i] / sum);
+            }
+        }
+    };
+
+    const StepKernel gStepKernel;
+
+    int outputLevel(u8 speaker, u8 tape)
+    {
+        return ((speaker ? 1 : -1) + (tape ? 1 : -1)) * (NX_VOLUME / 2);
+    }
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Audio
 //----------------------------------------------------------------------------------------------------------------------
 
-Audio::Audio(int numTStatesPerFrame, function<void()> frameFunc)
-    : m_numTStatesPerSample(0)
-    , m_numSamplesPerFrame(0)
-    , m_numTStatesPerFrame(numTStatesPerFrame)
-    , m_soundBuffer(nullptr)
-    , m_playBuffer(nullptr)
-    , m_fillBuffer(nullptr)
-    , m_tStatesUpdated(0)
-    , m_tStateCounter(0)
-    , m_audioValue(0)
-    , m_tapeAudioValue(0)
-    , m_writePosition(0)
-    , m_audioHost(0)
-    , m_audioDevice(0)
-    , m_stream(nullptr)
+Audio::Audio(function<void()> frameFunc)
+    : m_numSamplesPerFrame(0)
+    , m_sampleRate(0)
+    , m_level(outputLevel(0, 0))
+    , m_integrator(0)
+    , m_lastInput(0)
+    , m_lastOutput(0)
+    , m_ringRead(0)
+    , m_ringWrite(0)
+    , m_lastSample(0)
+    , m_numSamplesPlayed(0)
+    , m_numSamplesPaced(0)
+    , m_numUnderruns(0)
+    , m_numOverruns(0)
     , m_frameFunc(frameFunc)
     , m_mute(false)
     , m_started(false)
 {
+    setSampleRate(NX_AUDIO_SAMPLERATE);
     start();
 }
 
-void Audio::start()
+Audio::~Audio()
 {
-    if (m_started) return;
-
-    Pa_Initialize();
-    m_audioHost = Pa_GetDefaultHostApi();
-    m_audioDevice = Pa_GetDefaultOutputDevice();
-
-    // Output information about the audio system
-    const PaHostApiInfo* hostInfo = Pa_GetHostApiInfo(m_audioHost);
-    const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(m_audioDevice);
-    m_sampleRate = (int)deviceInfo->defaultSampleRate;
-
-    //m_numTStatesPerSample = numTStatesPerFrame / (m_sampleRate / 50);
-    //m_numSamplesPerFrame = numTStatesPerFrame / m_numTStatesPerSample;
+    stop();
+}
 
+void Audio::setSampleRate(int sampleRate)
+{
+    m_sampleRate = sampleRate;
     m_numSamplesPerFrame = m_sampleRate / 50;
-    m_numTStatesPerSample = m_numTStatesPerFrame / m_numSamplesPerFrame;
-
-    printf("Audio host: %s\n", hostInfo->name);
-    printf("Audio device: %s\n", deviceInfo->name);
-    printf("        rate: %g\n", deviceInfo->defaultSampleRate);
-    printf("     latency: %g\n", deviceInfo->defaultLowOutputLatency);
 
     // We know the sample rate now, so let's initialise our buffers.
     initialiseBuffers();
-
-    // Let's set up continuous streaming.
-    PaStreamParameters output;
-    output.channelCount = 1;
-    output.device = m_audioDevice;
-    output.hostApiSpecificStreamInfo = nullptr;
-    output.sampleFormat = paInt16;
-    //output.suggestedLatency = 0;
-    output.suggestedLatency = deviceInfo->defaultLowOutputLatency;
-
-    Pa_OpenStream(&m_stream,
-        nullptr,
-        &output,
-        deviceInfo->defaultSampleRate,
-        m_numSamplesPerFrame,
-        0,
-        &Audio::callback,
-        this);
-
-#if !NX_DISABLE_AUDIO
-    Pa_StartStream(m_stream);
-#endif
-
-    m_started = true;
 }
 
-void Audio::stop()
+void Audio::start()
 {
-    if (!m_started) return;
+    if (m_started.load(memory_order_relaxed)) return;
 
-    Pa_StopStream(m_stream);
-    Pa_Terminate();
-    delete[] m_soundBuffer;
-    m_soundBuffer = nullptr;
-    m_started = false;
+    // Start from silence.  The ring is left alone as a device may be reading from it.
+    fill(m_fillBuffer.begin(), m_fillBuffer.end(), i16(0));
+    fill(m_deltas.begin(), m_deltas.end(), 0.0f);
+    m_edges.clear();
+    m_integrator = float(m_level);
+    m_lastInput = m_integrator;
+    m_lastOutput = 0;
+
+    m_started.store(true, memory_order_release);
 }
 
-Audio::~Audio()
+void Audio::stop()
 {
-    stop();
+    m_started.store(false, memory_order_release);
 }
 
 void Audio::initialiseBuffers()
 {
-    // Each buffer needs to hold enough samples for a frame.  We'll double-buffer it so that one is the play buffer
-    // and the other is the fill buffer.
-    if (m_soundBuffer) delete[] m_soundBuffer;
+    m_fillBuffer.assign(m_numSamplesPerFrame, 0);
+    m_deltas.assign(m_numSamplesPerFrame + kKernelTaps, 0.0f);
+    m_edges.reserve(1024);
+    m_ring.assign(m_numSamplesPerFrame * kNumRingFrames + 1, 0);
+    m_ringRead = 0;
+    m_ringWrite = 0;
+    m_lastSample = 0;
+    m_numSamplesPlayed = 0;
+    m_numSamplesPaced = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// The ring
+//----------------------------------------------------------------------------------------------------------------------
 
-    int numSamples = m_numSamplesPerFrame * 2;
-    m_soundBuffer = new i16[numSamples];
-    m_playBuffer = m_soundBuffer;
-    m_fillBuffer = m_soundBuffer + m_numSamplesPerFrame;
+void Audio::queueFrame()
+{
+    int size = int(m_ring.size());
+    int write = m_ringWrite.load(memory_order_relaxed);
+    int read = m_ringRead.load(memory_order_acquire);
+    int free = (read - write - 1 + size) % size;
+
+    if (free < m_numSamplesPerFrame)
+    {
+        // The device isn't keeping up (or there isn't one), so this frame is dropped.  Nobody hears it while muted.
+        if (!m_mute.load(memory_order_relaxed)) ++m_numOverruns;
+        return;
+    }
 
-    for (int i = 0; i < numSamples; ++i) m_soundBuffer[i] = 0;
+    int first = min(m_numSamplesPerFrame, size - write);
+    copy(m_fillBuffer.begin(), m_fillBuffer.begin() + first, m_ring.begin() + write);
+    copy(m_fillBuffer.begin() + first, m_fillBuffer.end(), m_ring.begin());
+    m_ringWrite.store((write + m_numSamplesPerFrame) % size, memory_order_release);
 }
 
-int Audio::callback(const void *input,
-    void *output,
-    unsigned long frameCount,
-    const PaStreamCallbackTimeInfo *timeInfo,
-    PaStreamCallbackFlags statusFlags,
-    void *userData)
+void Audio::render(i16* output, int numSamples)
 {
-    Audio* self = (Audio *)userData;
-    i16* outputBuffer = (i16 *)output;
-    if (self->m_mute)
+    int size = int(m_ring.size());
+    int read = m_ringRead.load(memory_order_relaxed);
+    int write = m_ringWrite.load(memory_order_acquire);
+    int count = min(numSamples, (write - read + size) % size);
+
+    int first = min(count, size - read);
+    const i16* ring = m_ring.data();
+    memcpy(output, ring + read, first * sizeof(i16));
+    memcpy(output + first, ring, (count - first) * sizeof(i16));
+    m_ringRead.store((read + count) % size, memory_order_release);
+
+    if (m_mute.load(memory_order_relaxed) || !m_started.load(memory_order_acquire))
     {
-        memset(outputBuffer, 0, frameCount * sizeof(i16));
+        // The samples are still taken so that the ring keeps moving.
+        memset(output, 0, numSamples * sizeof(i16));
+        m_lastSample = 0;
     }
     else
     {
-        memcpy(outputBuffer, self->m_playBuffer, frameCount * sizeof(i16));
+        // Holding the last level rather than dropping to silence avoids a click.
+        if (count < numSamples) m_numUnderruns.fetch_add(1, memory_order_relaxed);
+        if (count) m_lastSample = output[count - 1];
+        for (int i = count; i < numSamples; ++i) output[i] = m_lastSample;
     }
-    self->m_renderSignal.trigger();
 
-    return paContinue;
+    m_numSamplesPlayed.fetch_add(u64(numSamples), memory_order_release);
 }
 
-void Audio::updateBeeper(i64 tState, u8 speaker, u8 tape)
+bool Audio::isFrameWanted()
 {
-    if (m_mute) speaker = 0;
+    u64 played = m_numSamplesPlayed.load(memory_order_acquire);
+    u64 latency = u64(m_numSamplesPerFrame) * kNumLatencyFrames;
 
-    if (m_writePosition < m_numSamplesPerFrame)
-    {
-        i64 dt = tState - m_tStatesUpdated;
-        if (m_tStateCounter + dt > m_numTStatesPerSample)
-        {
-            m_audioValue += int(speaker ? (m_numTStatesPerSample - m_tStateCounter) : 0);
-            m_tapeAudioValue += int(tape ? (m_numTStatesPerSample - m_tStateCounter) : 0);
+    // After falling behind (such as after running flat out in zoom mode), carry on from now rather than catching up
+    // in a burst.
+    if (m_numSamplesPaced < played) m_numSamplesPaced = played;
+    if (m_numSamplesPaced >= played + latency) return false;
 
-            i16 speakerSample = ((m_audioValue * (2 * NX_VOLUME)) / m_numTStatesPerSample) - NX_VOLUME;
-            i16 tapeSample = ((m_tapeAudioValue * (2 * NX_VOLUME)) / m_numTStatesPerSample) - NX_VOLUME;
+    // Don't add to a ring that is already well ahead of the device either.
+    if (getNumQueuedSamples() > int(latency)) return false;
 
-            m_fillBuffer[m_writePosition++] = (speakerSample + tapeSample) / 2;
+    m_numSamplesPaced += m_numSamplesPerFrame;
+    return true;
+}
 
-            dt = (m_tStateCounter + dt) - m_numTStatesPerSample;
-            m_audioValue = 0;
-            m_tapeAudioValue = 0;
-            m_tStateCounter = 0;
-        }
+int Audio::getNumQueuedSamples() const
+{
+    int size = int(m_ring.size());
+    return (m_ringWrite.load(memory_order_acquire) - m_ringRead.load(memory_order_acquire) + size) % size;
+}
 
-        m_audioValue += int(speaker ? dt : 0);
-        m_tapeAudioValue += int(tape ? dt : 0);
-        m_tStateCounter += dt;
+//----------------------------------------------------------------------------------------------------------------------
+// Sample generation
+//----------------------------------------------------------------------------------------------------------------------
+
+void Audio::setLevels(i64 tState, u8 speaker, u8 tape)
+{
+    int level = outputLevel(speaker, tape);
+    if (level == m_level) return;
+
+    m_edges.push_back({ tState, level - m_level });
+    m_level = level;
+}
+
+void Audio::addStep(double position, int delta)
+{
+    int sample = int(position);
+    int phase = min(int((position - sample) * kKernelPhases), kKernelPhases - 1);
+    const float* taps = gStepKernel.taps[phase];
+    float* out = &m_deltas[sample];
+    for (int i = 0; i < kKernelTaps; ++i) out[i] += taps[i] * delta;
+}
+
+void Audio::endFrame(i64 frameTStates)
+{
+    // Lay down the steps.  The frame's t-states are stretched over its samples exactly.
+    double samplesPerTState = double(m_numSamplesPerFrame) / double(frameTStates);
+    size_t numEdges = 0;
+    for (; numEdges < m_edges.size() && m_edges[numEdges].tState < frameTStates; ++numEdges)
+    {
+        const Edge& edge = m_edges[numEdges];
+        addStep(double(max<i64>(edge.tState, 0)) * samplesPerTState, edge.delta);
     }
-    m_tStatesUpdated = tState;
 
-    if (tState >= m_numTStatesPerFrame)
+    // Sum the steps up into levels and filter them.
+    for (int i = 0; i < m_numSamplesPerFrame; ++i)
     {
-        m_writePosition = 0;
-        std::swap(m_fillBuffer, m_playBuffer);
-        m_tStatesUpdated -= m_numTStatesPerFrame;
+        m_integrator += m_deltas[i];
+        m_lastOutput = m_integrator - m_lastInput + kHighPass * m_lastOutput;
+        m_lastInput = m_integrator;
+        m_fillBuffer[i] = i16(max(-32768.0f, min(32767.0f, m_lastOutput)));
     }
+
+    // The tail of the kernels after the frame end belongs to the next frame, as do any edges after it.
+    copy(m_deltas.begin() + m_numSamplesPerFrame, m_deltas.end(), m_deltas.begin());
+    fill(m_deltas.begin() + kKernelTaps, m_deltas.end(), 0.0f);
+    m_edges.erase(m_edges.begin(), m_edges.begin() + numEdges);
+    for (auto& edge : m_edges) edge.tState -= frameTStates;
+
+    queueFrame();
+}
+
+void Audio::seek(i64 tState, u8 speaker, u8 tape)
+{
+    // The frame keeps the level it started with up to tState and then steps to the new levels.  The kernels already
+    // laid down from earlier frames are short enough to be left to ring out.
+    for (const auto& edge : m_edges) m_level -= edge.delta;
+    m_edges.clear();
+    int level = outputLevel(speaker, tape);
+    if (level != m_level) m_edges.push_back({ tState, level - m_level });
+    m_level = level;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
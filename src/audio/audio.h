@@ -7,101 +7,117 @@
 #include <config.h>
 #include <types.h>
 
+#include <atomic>
 #include <functional>
-#include <mutex>
-#include <portaudio/portaudio.h>
+#include <vector>
 
 #define NX_AUDIO_SAMPLERATE 44100
-#define NX_DISABLE_AUDIO    0
 
 //----------------------------------------------------------------------------------------------------------------------
-// Signals
+// Audio system
+// Turns the beeper and tape levels into a frame's worth of samples.  Nothing here talks to a sound card, so the
+// emulator core can run without one.  AudioDevice (see audiodevice.h) plays the samples out.
+//
+// The machine only reports when a level changes.  The changes are kept as a list of edges and turned into samples
+// once a frame: each edge adds a band-limited step (a windowed sinc, integrated) to the output rather than a hard
+// one, so fast beeper tones don't alias into noise.
+//
+// Finished frames are queued in a ring of samples that the device reads from on its own thread.  There is only one
+// writer (the emulator) and one reader (the device), so the ring needs no locks: each side only moves its own
+// position, and publishes it after the samples it covers have been written or read.
 //----------------------------------------------------------------------------------------------------------------------
 
-class Signal
+class Audio
 {
 public:
-    Signal()
-        : m_triggered(false)
-    {
+    Audio(function<void()> frameFunc);
+    ~Audio();
 
-    }
+    void start();
+    void stop();
 
-    // Trigger a signal from remote thread
-    void trigger()
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    // Change the output sample rate.  The buffers are reallocated, so this must not be called while a device is
+    // reading from them.
+    void setSampleRate(int sampleRate);
+    int getSampleRate() const { return m_sampleRate; }
+    int getNumSamplesPerFrame() const { return m_numSamplesPerFrame; }
 
-        m_triggered = true;
-    }
+    // The speaker and tape levels change to these at tState in the current frame.  Calls must be in time order.
+    void setLevels(i64 tState, u8 speaker, u8 tape);
 
-    // Will reset the signal state when checked if triggered.
-    bool isTriggered()
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        bool result = m_triggered;
-        m_triggered = false;
-        return result;
-    }
+    // Turn the current frame's edges into samples and queue them.  Edges at or after frameTStates are carried into the
+    // next frame.
+    void endFrame(i64 frameTStates);
 
-private:
-    std::mutex      m_mutex;
-    bool            m_triggered;
-};
+    // Throw away the current frame's edges and carry on from tState with these levels, such as after the machine has
+    // been rewound.
+    void seek(i64 tState, u8 speaker, u8 tape);
 
-//----------------------------------------------------------------------------------------------------------------------
-// Audio system
-//----------------------------------------------------------------------------------------------------------------------
+    // Take numSamples queued samples into output, however many the device asks for.  If there aren't enough, the last
+    // sample is held for the rest.  Called from the audio device's thread.
+    void render(i16* output, int numSamples);
 
-class Audio
-{
-public:
-    Audio(int numTStatesPerFrame, function<void()> frameFunc);
-    ~Audio();
+    // Whether the emulator should run another frame to keep the device fed.  Each true answer counts as a frame
+    // having been run.  Frames are paced by the device's clock, so this works while the machine is stopped too.
+    bool isFrameWanted();
 
-    void start();
-    void stop();
+    void mute(bool enabled) { m_mute.store(enabled, memory_order_relaxed); }
 
-    void updateBeeper(i64 tState, u8 speaker, u8 tape);
-    void mute(bool enabled) { m_mute = enabled; }
+    bool isMute() const { return m_mute.load(memory_order_relaxed); }
 
-    bool isMute() const { return m_mute; }
+    // Times the device asked for more samples than were queued, and frames dropped because the ring was full.
+    int getNumUnderruns() const { return m_numUnderruns; }
+    int getNumOverruns() const { return m_numOverruns; }
 
-    Signal& getSignal() { return m_renderSignal; }
+    // Samples queued and not yet played.
+    int getNumQueuedSamples() const;
 
 private:
+    struct Edge
+    {
+        i64             tState;
+        int             delta;          // Change in output level
+    };
+
     void initialiseBuffers();
+    void queueFrame();
+    void addStep(double position, int delta);
 
-    static int callback(const void* input,
-        void* output,
-        unsigned long frameCount,
-        const PaStreamCallbackTimeInfo* timeInfo,
-        PaStreamCallbackFlags statusFlags,
-        void* userData);
+    // Frames the ring holds, and how many the emulator tries to keep ahead of the device.
+    static const int kNumRingFrames = 4;
+    static const int kNumLatencyFrames = 2;
 
 private:
-    int                 m_numTStatesPerSample;
     int                 m_numSamplesPerFrame;
-    int                 m_numTStatesPerFrame;
     int                 m_sampleRate;
-    i16*                m_soundBuffer;
-    i16*                m_playBuffer;
-    i16*                m_fillBuffer;
-    i64                 m_tStatesUpdated;
-    i64                 m_tStateCounter;
-    int                 m_audioValue;
-    int                 m_tapeAudioValue;
-    int                 m_writePosition;
-
-    PaHostApiIndex      m_audioHost;
-    PaDeviceIndex       m_audioDevice;
-    PaStream*           m_stream;
-
-    Signal              m_renderSignal;
+    vector<i16>         m_fillBuffer;
+
+    // Synthesis
+    vector<Edge>        m_edges;            // This frame's level changes
+    int                 m_level;            // Output level after the last edge
+    vector<float>       m_deltas;           // Steps added to each sample, with room for the kernel past the frame end
+    float               m_integrator;       // Sum of the deltas so far
+    float               m_lastInput;        // High-pass filter state
+    float               m_lastOutput;
+
+    // The ring.  One slot is always left empty so that a full ring can be told from an empty one.
+    vector<i16>         m_ring;
+    atomic<int>         m_ringRead;         // Only moved by the device
+    atomic<int>         m_ringWrite;        // Only moved by the emulator
+    i16                 m_lastSample;       // Device side
+
+    // Pacing
+    atomic<u64>         m_numSamplesPlayed; // Including held ones
+    u64                 m_numSamplesPaced;
+
+    atomic<int>         m_numUnderruns;
+    int                 m_numOverruns;
+
     function<void()>    m_frameFunc;
 
-    bool                m_mute;
-    bool                m_started;
+    // Both are read by the device as well
+    atomic<bool>        m_mute;
+    atomic<bool>        m_started;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
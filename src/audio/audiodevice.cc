@@ -0,0 +1,77 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Audio device implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <audio/audiodevice.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// AudioDevice
+//----------------------------------------------------------------------------------------------------------------------
+
+AudioDevice::AudioDevice(Audio& audio)
+    : m_audio(audio)
+    , m_audioHost(0)
+    , m_audioDevice(0)
+    , m_stream(nullptr)
+{
+    Pa_Initialize();
+    m_audioHost = Pa_GetDefaultHostApi();
+    m_audioDevice = Pa_GetDefaultOutputDevice();
+
+    // Output information about the audio system
+    const PaHostApiInfo* hostInfo = Pa_GetHostApiInfo(m_audioHost);
+    const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(m_audioDevice);
+
+    printf("Audio host: %s\n", hostInfo->name);
+    printf("Audio device: %s\n", deviceInfo->name);
+    printf("        rate: %g\n", deviceInfo->defaultSampleRate);
+    printf("     latency: %g\n", deviceInfo->defaultLowOutputLatency);
+
+    // The audio generates a frame's worth of samples at a time, so it needs to know the device's rate.
+    m_audio.setSampleRate((int)deviceInfo->defaultSampleRate);
+
+    // Let's set up continuous streaming.
+    PaStreamParameters output;
+    output.channelCount = 1;
+    output.device = m_audioDevice;
+    output.hostApiSpecificStreamInfo = nullptr;
+    output.sampleFormat = paInt16;
+    //output.suggestedLatency = 0;
+    output.suggestedLatency = deviceInfo->defaultLowOutputLatency;
+
+    Pa_OpenStream(&m_stream,
+        nullptr,
+        &output,
+        deviceInfo->defaultSampleRate,
+        paFramesPerBufferUnspecified,       // The samples are queued ahead, so the device can take as many as suits it
+        0,
+        &AudioDevice::callback,
+        this);
+
+#if !NX_DISABLE_AUDIO
+    Pa_StartStream(m_stream);
+#endif
+}
+
+AudioDevice::~AudioDevice()
+{
+    Pa_StopStream(m_stream);
+    Pa_CloseStream(m_stream);
+    Pa_Terminate();
+}
+
+int AudioDevice::callback(const void *input,
+    void *output,
+    unsigned long frameCount,
+    const PaStreamCallbackTimeInfo *timeInfo,
+    PaStreamCallbackFlags statusFlags,
+    void *userData)
+{
+    AudioDevice* self = (AudioDevice *)userData;
+    self->m_audio.render((i16 *)output, (int)frameCount);
+
+    return paContinue;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
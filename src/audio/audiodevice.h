@@ -0,0 +1,43 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Audio device
+// Streams the samples generated by an Audio object to the default PortAudio output device.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <audio/audio.h>
+#include <config.h>
+#include <types.h>
+
+#include <portaudio/portaudio.h>
+
+#define NX_DISABLE_AUDIO    0
+
+//----------------------------------------------------------------------------------------------------------------------
+// AudioDevice
+//----------------------------------------------------------------------------------------------------------------------
+
+class AudioDevice
+{
+public:
+    // Opens the default output device and switches the audio's sample rate to match it.
+    AudioDevice(Audio& audio);
+    ~AudioDevice();
+
+private:
+    static int callback(const void* input,
+        void* output,
+        unsigned long frameCount,
+        const PaStreamCallbackTimeInfo* timeInfo,
+        PaStreamCallbackFlags statusFlags,
+        void* userData);
+
+private:
+    Audio&              m_audio;
+    PaHostApiIndex      m_audioHost;
+    PaDeviceIndex       m_audioDevice;
+    PaStream*           m_stream;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,164 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Benchmark harness implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <bench/bench.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Allocation counting
+// Replacing the global operators catches every allocation, including those made inside the standard library.
+//----------------------------------------------------------------------------------------------------------------------
+
+static atomic<i64> gNumAllocations(0);
+static atomic<i64> gNumAllocatedBytes(0);
+
+void* operator new(size_t size)
+{
+    ++gNumAllocations;
+    gNumAllocatedBytes += (i64)size;
+    void* p = malloc(size ? size : 1);
+    if (!p) abort();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+i64 Bench::getNumAllocations()
+{
+    return gNumAllocations;
+}
+
+i64 Bench::getNumAllocatedBytes()
+{
+    return gNumAllocatedBytes;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Running
+//----------------------------------------------------------------------------------------------------------------------
+
+Bench::Bench(double minSeconds)
+    : m_minSeconds(minSeconds)
+    , m_filters()
+    , m_results()
+{
+}
+
+bool Bench::isSelected(const string& name) const
+{
+    if (m_filters.empty()) return true;
+    for (const auto& filter : m_filters)
+    {
+        if (name.compare(0, filter.size(), filter) == 0) return true;
+    }
+    return false;
+}
+
+void Bench::run(string name, string itemName, Func func)
+{
+    if (!isSelected(name)) return;
+
+    BenchResult result = { name, itemName, 0, 0, {}, 0, 0 };
+
+    // One untimed run first so that caches are warm and any one-off allocations are out of the way.
+    BenchCounters warmUp;
+    func(warmUp);
+
+    i64 startAllocations = getNumAllocations();
+    i64 startBytes = getNumAllocatedBytes();
+    auto startTime = chrono::high_resolution_clock::now();
+    do
+    {
+        func(result.counters);
+        ++result.iterations;
+        chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - startTime;
+        result.seconds = elapsed.count();
+    } while (result.seconds < m_minSeconds);
+
+    result.allocations = getNumAllocations() - startAllocations;
+    result.allocatedBytes = getNumAllocatedBytes() - startBytes;
+
+    m_results.push_back(result);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reporting
+//----------------------------------------------------------------------------------------------------------------------
+
+static double perSecond(i64 count, double seconds)
+{
+    return seconds > 0 ? double(count) / seconds : 0;
+}
+
+void Bench::printTable() const
+{
+    printf("%-24s %10s %10s %10s %12s %16s %12s\n", "Benchmark", "MHz", "ns/instr", "frames/s", "items/s", "item",
+        "allocs/iter");
+    for (const auto& r : m_results)
+    {
+        const BenchCounters& c = r.counters;
+        printf("%-24s", r.name.c_str());
+        if (c.tStates) printf(" %10.2f", perSecond(c.tStates, r.seconds) / 1000000.0); else printf(" %10s", "-");
+        if (c.instructions) printf(" %10.2f", r.seconds * 1e9 / c.instructions); else printf(" %10s", "-");
+        if (c.frames) printf(" %10.1f", perSecond(c.frames, r.seconds)); else printf(" %10s", "-");
+        if (c.items) printf(" %12.0f %16s", perSecond(c.items, r.seconds), r.itemName.c_str());
+        else printf(" %12s %16s", "-", "");
+        printf(" %12.1f\n", double(r.allocations) / r.iterations);
+    }
+}
+
+void Bench::printJson() const
+{
+    printf("{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < m_results.size(); ++i)
+    {
+        const BenchResult& r = m_results[i];
+        const BenchCounters& c = r.counters;
+        printf("    { \"name\": \"%s\", \"iterations\": %lld, \"seconds\": %.6f", r.name.c_str(), (long long)r.iterations,
+            r.seconds);
+        if (c.tStates) printf(", \"mhz\": %.3f", perSecond(c.tStates, r.seconds) / 1000000.0);
+        if (c.instructions) printf(", \"ns_per_instruction\": %.3f", r.seconds * 1e9 / c.instructions);
+        if (c.frames) printf(", \"frames_per_second\": %.2f", perSecond(c.frames, r.seconds));
+        if (c.items)
+        {
+            printf(", \"item\": \"%s\", \"items_per_second\": %.2f, \"ns_per_item\": %.3f", r.itemName.c_str(),
+                perSecond(c.items, r.seconds), r.seconds * 1e9 / c.items);
+        }
+        printf(", \"allocations\": %lld, \"allocated_bytes\": %lld, \"allocations_per_iteration\": %.2f }%s\n",
+            (long long)r.allocations, (long long)r.allocatedBytes, double(r.allocations) / r.iterations,
+            i + 1 < m_results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
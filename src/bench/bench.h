@@ -0,0 +1,75 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Benchmark harness
+// Times a piece of work repeatedly for a minimum time and counts the heap allocations it makes.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <types.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Results
+// The work being timed fills in whichever of the counters make sense for it.  They are totals over all iterations.
+//----------------------------------------------------------------------------------------------------------------------
+
+struct BenchCounters
+{
+    i64         tStates = 0;        // Emulated t-states
+    i64         instructions = 0;   // Z80 instructions executed
+    i64         frames = 0;         // Emulated frames
+    i64         items = 0;          // Anything else (calls, files, edges...)
+};
+
+struct BenchResult
+{
+    string          name;
+    string          itemName;       // What BenchCounters::items counts
+    i64             iterations;
+    double          seconds;
+    BenchCounters   counters;
+    i64             allocations;    // Heap allocations made while timing
+    i64             allocatedBytes;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Bench
+//----------------------------------------------------------------------------------------------------------------------
+
+class Bench
+{
+public:
+    using Func = function<void(BenchCounters& counters)>;
+
+    Bench(double minSeconds);
+
+    // Time func, running it at least once and until minSeconds have passed.  Set-up should be done before calling.
+    void run(string name, string itemName, Func func);
+
+    // Only run benchmarks whose name starts with one of these (all if empty).
+    void setFilters(const vector<string>& filters) { m_filters = filters; }
+
+    const vector<BenchResult>& getResults() const { return m_results; }
+
+    void printTable() const;
+    void printJson() const;
+
+    // Heap allocations made by the whole process so far.  Counted by the replacement operator new in bench.cc.
+    static i64 getNumAllocations();
+    static i64 getNumAllocatedBytes();
+
+private:
+    bool isSelected(const string& name) const;
+
+private:
+    double                  m_minSeconds;
+    vector<string>          m_filters;
+    vector<BenchResult>     m_results;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
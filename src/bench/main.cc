@@ -0,0 +1,444 @@
+//----------------------------------------------------------------------------------------------------------------------
+// NX benchmarks
+//
+// Usage: nx-bench [-data=<folder>] [-time=<seconds>] [-json] [-nodecode] [-noblocks] [<name prefix>...]
+//
+//      -data       The repository's etc folder, for the tape, snapshot and assembler sources (default etc)
+//      -time       Minimum time to run each benchmark for (default 1)
+//      -json       Print the results as JSON rather than a table
+//      -nodecode   Turn off the Z80 predecode cache, for comparison
+//      -noblocks   Turn off the Z80 decoded-block cache, for comparison
+//
+// Only the benchmarks whose names start with one of the given prefixes are run (all if none are given).
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <asm/asm.h>
+#include <audio/audio.h>
+#include <bench/bench.h>
+#include <emulator/nxfile.h>
+#include <emulator/snapshot.h>
+#include <emulator/spectrum.h>
+#include <tape/tape.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Settings
+//----------------------------------------------------------------------------------------------------------------------
+
+static map<string, string> gSettings;
+static bool gDecodeCache = true;
+static bool gBlockCache = true;
+
+static string getSetting(string key, string defaultSetting)
+{
+    auto it = gSettings.find(key);
+    return it == gSettings.end() ? defaultSetting : it->second;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Z80 instruction mixes
+// Each mix is a loop at $8000 (uncontended on all models) working on data at $9000.  Interrupts are off so nothing
+// but the instructions themselves are timed.
+//----------------------------------------------------------------------------------------------------------------------
+
+struct InstructionMix
+{
+    const char*     name;
+    vector<u8>      code;
+};
+
+static const InstructionMix gMixes[] =
+{
+    // 8-bit arithmetic, logic and register loads
+    { "alu", {
+        0x80,               // ADD A,B
+        0x89,               // ADC A,C
+        0x92,               // SUB D
+        0x9b,               // SBC A,E
+        0xa4,               // AND H
+        0xad,               // XOR L
+        0xb7,               // OR A
+        0xb8,               // CP B
+        0x0c,               // INC C
+        0x15,               // DEC D
+        0x47,               // LD B,A
+        0x4b,               // LD C,E
+        0xc6, 0x12,         // ADD A,$12
+        0xe6, 0x7f,         // AND $7F
+        0xee, 0x55,         // XOR $55
+        0x07,               // RLCA
+        0x1f,               // RRA
+        0x2f,               // CPL
+        0x27,               // DAA
+        0x37,               // SCF
+        0x3f,               // CCF
+        0x1c,               // INC E
+        0x57,               // LD D,A
+        0xc3, 0x00, 0x80,   // JP $8000
+    } },
+
+    // Memory reads and writes, and the stack
+    { "memory", {
+        0x7e,               // LD A,(HL)
+        0x70,               // LD (HL),B
+        0x34,               // INC (HL)
+        0x5e,               // LD E,(HL)
+        0xc5,               // PUSH BC
+        0xd1,               // POP DE
+        0x3a, 0x00, 0x90,   // LD A,($9000)
+        0x32, 0x01, 0x90,   // LD ($9001),A
+        0xed, 0x4b, 0x02, 0x90, // LD BC,($9002)
+        0x22, 0x04, 0x90,   // LD ($9004),HL
+        0xe3,               // EX (SP),HL
+        0xe3,               // EX (SP),HL
+        0xe5,               // PUSH HL
+        0xe1,               // POP HL
+        0xc3, 0x00, 0x80,   // JP $8000
+    } },
+
+    // Jumps, loops, calls and returns
+    { "branch", {
+        0x06, 0x08,         // $8000: LD B,8
+        0x10, 0xfe,         // $8002: DJNZ $8002
+        0xcd, 0x10, 0x80,   // $8004: CALL $8010
+        0x18, 0x00,         // $8007: JR $8009
+        0x20, 0x00,         // $8009: JR NZ,$800B
+        0xc3, 0x00, 0x80,   // $800B: JP $8000
+        0x00, 0x00,
+        0xa7,               // $8010: AND A
+        0xc8,               // $8011: RET Z
+        0xc9,               // $8012: RET
+    } },
+
+    // CB, ED, DD, FD and DDCB/FDCB prefixed instructions
+    { "prefixed", {
+        0x21, 0x00, 0x90,   // LD HL,$9000
+        0xdd, 0x21, 0x00, 0x90, // LD IX,$9000
+        0xcb, 0x00,         // RLC B
+        0xcb, 0x5f,         // BIT 3,A
+        0xcb, 0xd6,         // SET 2,(HL)
+        0xcb, 0x96,         // RES 2,(HL)
+        0xcb, 0x39,         // SRL C
+        0xed, 0x44,         // NEG
+        0xed, 0x4a,         // ADC HL,BC
+        0xed, 0x57,         // LD A,I
+        0xdd, 0x7e, 0x01,   // LD A,(IX+1)
+        0xfd, 0x77, 0x02,   // LD (IY+2),A
+        0xdd, 0x34, 0x03,   // INC (IX+3)
+        0xdd, 0x7c,         // LD A,IXH
+        0xdd, 0xcb, 0x04, 0x4e, // BIT 1,(IX+4)
+        0xfd, 0xcb, 0x05, 0xee, // SET 5,(IY+5)
+        0xdd, 0x09,         // ADD IX,BC
+        0xc3, 0x00, 0x80,   // JP $8000
+    } },
+
+    // Repeating block instructions
+    { "block", {
+        0x21, 0x00, 0x90,   // LD HL,$9000
+        0x11, 0x00, 0x91,   // LD DE,$9100
+        0x01, 0x40, 0x00,   // LD BC,64
+        0xed, 0xb0,         // LDIR
+        0x21, 0x00, 0x90,   // LD HL,$9000
+        0x01, 0x40, 0x00,   // LD BC,64
+        0xaf,               // XOR A
+        0xed, 0xb1,         // CPIR
+        0xc3, 0x00, 0x80,   // JP $8000
+    } },
+};
+
+// Instructions run per iteration of a mix
+static const int kMixSteps = 100000;
+
+static void benchZ80(Bench& bench)
+{
+    for (const auto& mix : gMixes)
+    {
+        Spectrum speccy([] {});
+        speccy.reset(Model::ZX48);
+        speccy.setDecodeCache(gDecodeCache);
+        speccy.setBlockCache(gBlockCache);
+        speccy.load(0x8000, mix.code);
+
+        auto& z80 = speccy.getZ80();
+        z80.PC() = 0x8000;
+        z80.SP() = 0xff00;
+        z80.HL() = 0x9000;
+        z80.IX() = 0x9000;
+        z80.IY() = 0x9000;
+        z80.IFF1() = z80.IFF2() = false;
+
+        bench.run(string("z80.") + mix.name, "", [&z80](BenchCounters& counters) {
+            TState t = 0;
+            for (int i = 0; i < kMixSteps; ++i)
+            {
+                z80.step(t);
+            }
+            counters.tStates += t;
+            counters.instructions += kMixSteps;
+        });
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Video and audio
+//----------------------------------------------------------------------------------------------------------------------
+
+// T-states between beeper edges, a fast tone from a tight OUT loop
+static const int kBeeperInterval = 64;
+
+static void benchVideo(Bench& bench)
+{
+    Spectrum speccy([] {});
+    speccy.reset(Model::ZX48);
+
+    // Give every cell a different bitmap and attribute so nothing is uniform.
+    for (u16 a = 0x4000; a < 0x5b00; ++a)
+    {
+        speccy.poke(a, u8(a * 7 + (a >> 8)));
+    }
+
+    // Cells that haven't changed since they were last drawn are skipped, so this is the cost of an unchanging screen.
+    bench.run("video.frame", "", [&speccy](BenchCounters& counters) {
+        speccy.renderVideo();
+        ++counters.frames;
+    });
+
+    // Changing every attribute makes every cell of the screen be drawn again.
+    u8 flip = 0;
+    bench.run("video.frame.changed", "", [&speccy, &flip](BenchCounters& counters) {
+        flip ^= 0x3f;
+        for (u16 a = 0x5800; a < 0x5b00; ++a) speccy.poke(a, u8(a * 7 + (a >> 8)) ^ flip);
+        speccy.renderVideo();
+        ++counters.frames;
+    });
+}
+
+static void benchAudio(Bench& bench)
+{
+    Audio audio([] {});
+
+    bench.run("audio.beeper", "edges", [&audio](BenchCounters& counters) {
+        for (int t = 0; t < 69888; t += kBeeperInterval)
+        {
+            audio.setLevels(t, u8((t / kBeeperInterval) & 1), u8((t >> 10) & 1));
+            ++counters.items;
+        }
+
+        // The frame's edges are turned into samples and queued.
+        audio.endFrame(69888);
+        ++counters.frames;
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Tape
+//----------------------------------------------------------------------------------------------------------------------
+
+static void benchTape(Bench& bench, const string& dataPath)
+{
+    vector<u8> data = NxFile::loadFile(dataPath + "/tests/z80doc.tap");
+    if (data.empty())
+    {
+        fprintf(stderr, "Cannot load tests/z80doc.tap; skipping tape benchmark.\n");
+        return;
+    }
+
+    // Plays the whole tape one edge at a time, as the emulator's tape event does.
+    bench.run("tape.play", "edges", [&data](BenchCounters& counters) {
+        Tape tape(data);
+        tape.selectBlock(0);
+        tape.play();
+        while (tape.isPlaying())
+        {
+            TState dt = tape.nextEdge();
+            tape.play(dt);
+            counters.tStates += dt;
+            ++counters.items;
+        }
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Assembler
+//----------------------------------------------------------------------------------------------------------------------
+
+struct NullAssemblerOutput : IAssemblerOutput
+{
+    void clear() override {}
+    void output(const std::string&) override {}
+};
+
+static void benchAssembler(Bench& bench, const string& dataPath)
+{
+    static const char* kSources[] = { "border.asm", "hello.asm", "hex.asm", "mon.asm", "opcodes.asm", "rom.asm",
+        "sound.asm", "test_db.asm" };
+
+    vector<pair<string, vector<u8>>> sources;
+    int numLines = 0;
+    for (const char* source : kSources)
+    {
+        string fileName = dataPath + "/asm/" + source;
+        vector<u8> data = NxFile::loadFile(fileName);
+        if (data.empty()) continue;
+
+        numLines += (int)count(data.begin(), data.end(), '\n');
+        sources.emplace_back(fileName, move(data));
+    }
+    if (sources.empty())
+    {
+        fprintf(stderr, "Cannot find the sources in asm/; skipping assembler benchmark.\n");
+        return;
+    }
+
+    Spectrum speccy([] {});
+    speccy.reset(Model::ZX48);
+    NullAssemblerOutput output;
+
+    bench.run("asm.sources", "lines", [&](BenchCounters& counters) {
+        for (const auto& source : sources)
+        {
+            Assembler assembler(output, speccy);
+            assembler.startAssembly(source.second, source.first);
+        }
+        counters.items += numLines;
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Snapshots
+//----------------------------------------------------------------------------------------------------------------------
+
+static void benchSnapshots(Bench& bench, const string& dataPath)
+{
+    Spectrum speccy([] {});
+    speccy.reset(Model::ZX48);
+
+    string snaName = dataPath + "/manic.sna";
+    string z80Name = dataPath + "/tests/Timing_Tests-48k_v1.0.z80";
+    string tempName = "nx-bench.tmp";
+
+    if (!loadSnaSnapshot(speccy, NxFile::loadFile(snaName)))
+    {
+        fprintf(stderr, "Cannot load manic.sna; skipping snapshot benchmarks.\n");
+        return;
+    }
+
+    bench.run("snapshot.load.sna", "snapshots", [&](BenchCounters& counters) {
+        loadSnaSnapshot(speccy, NxFile::loadFile(snaName));
+        ++counters.items;
+    });
+
+    bench.run("snapshot.load.z80", "snapshots", [&](BenchCounters& counters) {
+        loadZ80Snapshot(speccy, NxFile::loadFile(z80Name));
+        ++counters.items;
+    });
+
+    bench.run("snapshot.save.sna", "snapshots", [&](BenchCounters& counters) {
+        NxFile::saveFile(tempName, saveSnaSnapshot(speccy));
+        ++counters.items;
+    });
+
+    remove(tempName.c_str());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Whole machine
+// Full frames of a game, which is where all of the above meet.
+//----------------------------------------------------------------------------------------------------------------------
+
+static void benchMachine(Bench& bench, const string& dataPath)
+{
+    static const char* kSnapshots[] = { "manic.sna", "ChuckieEgg.sna", "AgentX.sna" };
+
+    for (const char* snapshot : kSnapshots)
+    {
+        Spectrum speccy([] {});
+        speccy.reset(Model::ZX48);
+        speccy.setDecodeCache(gDecodeCache);
+        speccy.setBlockCache(gBlockCache);
+        if (!loadSnaSnapshot(speccy, NxFile::loadFile(dataPath + "/" + snapshot)))
+        {
+            fprintf(stderr, "Cannot load %s; skipping.\n", snapshot);
+            continue;
+        }
+
+        string name = snapshot;
+        name = "machine." + name.substr(0, name.find('.'));
+        bench.run(name, "", [&speccy](BenchCounters& counters) {
+            // Run a second's worth of frames per iteration.
+            for (int i = 0; i < 50; ++i)
+            {
+                bool breakpointHit = false;
+                speccy.update(RunMode::Normal, breakpointHit);
+            }
+            counters.frames += 50;
+            counters.tStates += 50 * speccy.getFrameTime();
+        });
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Main entry point
+//----------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    // Deal with the command line
+    vector<string> filters;
+    for (int i = 1; i < argc; ++i)
+    {
+        char* arg = argv[i];
+        if (arg[0] == '-')
+        {
+            // Setting being added
+            char* keyEnd = strchr(arg, '=');
+            char* keyStart = arg + 1;
+            if (keyEnd)
+            {
+                gSettings[string(keyStart, keyEnd)] = string(keyEnd + 1);
+            }
+            else
+            {
+                // Assume key is "yes"
+                gSettings[keyStart] = "yes";
+            }
+        }
+        else
+        {
+            filters.emplace_back(arg);
+        }
+    }
+
+    string dataPath = getSetting("data", "etc");
+    gDecodeCache = !gSettings.count("nodecode");
+    gBlockCache = !gSettings.count("noblocks");
+    Bench bench(atof(getSetting("time", "1").c_str()));
+    bench.setFilters(filters);
+
+    benchZ80(bench);
+    benchVideo(bench);
+    benchAudio(bench);
+    benchTape(bench, dataPath);
+    benchAssembler(bench, dataPath);
+    benchSnapshots(bench, dataPath);
+    benchMachine(bench, dataPath);
+
+    if (gSettings.count("json"))
+    {
+        bench.printJson();
+    }
+    else
+    {
+        bench.printTable();
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 
 #include <debugger/overlay_debugger.h>
 #include <emulator/nx.h>
+#include <emulator/nxfile.h>
 #include <utils/format.h>
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -37,6 +38,7 @@ Debugger::Debugger(Nx& nx)
         "Ctrl-F5|Run to",
         "F6|Step Over",
         "F7|Step In",
+        "Shift-F7|Step Back",
         "F8|Step Out",
         "F9|Breakpoint",
         "Up|Scroll up",
@@ -64,58 +66,74 @@ Debugger::Debugger(Nx& nx)
         // Known commands
         return {
             "B  <addr>        Toggle breakpoint",
-            "DB <addr> <len>  Toggle data breakpoint",
+            "DB <addr> <len>  Toggle data breakpoint on write",
+            "DR <addr> <len>  Toggle data breakpoint on read",
+            "DX <addr> <len>  Toggle data breakpoint on execute",
             "LB               List breakpoints",
             "CB               Clear breakpoints",
             "CF               Clear search terms",
             "F  <byte>...     Find byte(s)",
             "FW <word>        Find word",
+            "PROF ON|OFF      Start/stop profiling",
+            "PROF CLEAR       Clear profile",
+            "PROF SHOW [TIME|COUNT|ADDR] [n]",
+            "                 List hot spots",
+            "PROF OPS [n]     List opcode mix",
+            "PROF CALLS [n]   List call graph",
+            "PROF STACK       List shadow call stack",
+            "PROF SAVE <file> Save profile as CSV",
         };
     });
 
     //
-    // Data breakpoint command
+    // Data breakpoint commands
     //
-
-    m_commandWindow.registerCommand("DB", [this](vector<string> args) {
-        vector<string> errors = syntaxCheck(args, "w?w", { "DB", "address", "len" });
-        if (errors.empty())
-        {
-            u16 addr = 0;
-            u16 len = 1;
-            bool parsedAddr = parseWord(args[0], addr);
-            bool parsedLen = args.size() == 1 ? true : parseWord(args[1], len);
-
-            if (parsedAddr && parsedLen)
+    using Type = Spectrum::DataBreakpointType;
+    auto dataBreakpointCommand = [this](const char* cmd, Type type) {
+        return [this, cmd, type](vector<string> args) {
+            vector<string> errors = syntaxCheck(args, "w?w", { cmd, "address", "len" });
+            if (errors.empty())
             {
-                getSpeccy().toggleDataBreakpoint(addr, len);
-                if (len == 1)
+                u16 addr = 0;
+                u16 len = 1;
+                bool parsedAddr = parseWord(args[0], addr);
+                bool parsedLen = args.size() == 1 ? true : parseWord(args[1], len);
+
+                if (parsedAddr && parsedLen)
                 {
-                    errors.emplace_back(
-                        stringFormat(getSpeccy().hasDataBreakpoint(addr, len)
-                            ? "Data breakpoint set at ${0}."
-                            : "Data breakpoint reset at ${0}.",
-                            hexWord(addr)));
+                    getSpeccy().toggleDataBreakpoint(addr, len, type);
+                    if (len == 1)
+                    {
+                        errors.emplace_back(
+                            stringFormat(getSpeccy().hasDataBreakpoint(addr, len, type)
+                                ? "Data breakpoint set at ${0}."
+                                : "Data breakpoint reset at ${0}.",
+                                hexWord(addr)));
+                    }
+                    else
+                    {
+                        errors.emplace_back(
+                            stringFormat(getSpeccy().hasDataBreakpoint(addr, len, type)
+                                ? "Data breakpoint set at ${0}-${1}."
+                                : "Data breakpoint reset at ${0}-${1}.",
+                                hexWord(addr),
+                                hexWord(addr + len - 1)));
+                    }
                 }
                 else
                 {
-                    errors.emplace_back(
-                        stringFormat(getSpeccy().hasDataBreakpoint(addr, len)
-                            ? "Data breakpoint set at ${0}-${1}."
-                            : "Data breakpoint reset at ${0}-${1}.",
-                            hexWord(addr),
-                            hexWord(addr + len - 1)));
+                    if (!parsedAddr) errors.emplace_back(stringFormat("Invalid address: '{0}'.", args[0]));
+                    if (!parsedLen) errors.emplace_back(stringFormat("Invalid length: '{0}'.", args[1]));
                 }
             }
-            else
-            {
-                if (!parsedAddr) errors.emplace_back(stringFormat("Invalid address: '{0}'.", args[0]));
-                if (!parsedLen) errors.emplace_back(stringFormat("Invalid length: '{0}'.", args[1]));
-            }
-        }
 
-        return errors;
-    });
+            return errors;
+        };
+    };
+
+    m_commandWindow.registerCommand("DB", dataBreakpointCommand("DB", Type::Write));
+    m_commandWindow.registerCommand("DR", dataBreakpointCommand("DR", Type::Read));
+    m_commandWindow.registerCommand("DX", dataBreakpointCommand("DX", Type::Execute));
 
     //
     // Breakpoint command
@@ -152,18 +170,22 @@ Debugger::Debugger(Nx& nx)
             errors.emplace_back("Breakpoints:");
             for (const auto& br : getSpeccy().getUserBreakpoints())
             {
-                errors.emplace_back(stringFormat("  ${0}", hexWord(br)));
+                errors.emplace_back(stringFormat("  {0}", getSpeccy().physicalAddressName(br)));
             }
             errors.emplace_back("Data breakpoints:");
             for (const auto& br : getSpeccy().getDataBreakpoints())
             {
+                const char* type = br.type == Spectrum::DataBreakpointType::Read ? "R"
+                                 : br.type == Spectrum::DataBreakpointType::Execute ? "X"
+                                 : "W";
                 if (br.len == 1)
                 {
-                    errors.emplace_back(stringFormat("  ${0}", hexWord(br.address)));
+                    errors.emplace_back(stringFormat("  {0} ${1}", type, hexWord(br.address)));
                 }
                 else
                 {
-                    errors.emplace_back(stringFormat("  ${0}-${1}", hexWord(br.address), hexWord(br.address + br.len - 1)));
+                    errors.emplace_back(stringFormat("  {0} ${1}-${2}", type, hexWord(br.address),
+                        hexWord(br.address + br.len - 1)));
                 }
             }
         }
@@ -288,6 +310,81 @@ Debugger::Debugger(Nx& nx)
 
         return errors;
     });
+
+    //
+    // Profiler command
+    //
+    m_commandWindow.registerCommand("PROF", [this](vector<string> args) -> vector<string> {
+        Spectrum& speccy = getSpeccy();
+        Profiler& profiler = speccy.getProfiler();
+        string sub = args.empty() ? "SHOW" : args[0];
+        auto name = [this](u16 address, u32 physAddress) { return routineName(address, physAddress); };
+
+        // Optional line count that follows the sub-command's arguments
+        u16 maxCount = 20;
+        auto parseCount = [&](size_t i) { return args.size() <= i || parseWord(args[i], maxCount); };
+
+        if (sub == "ON" && args.size() == 1)
+        {
+            speccy.setProfiling(true);
+            return { "Profiling on." };
+        }
+        else if (sub == "OFF" && args.size() == 1)
+        {
+            speccy.setProfiling(false);
+            return { "Profiling off." };
+        }
+        else if (sub == "CLEAR" && args.size() == 1)
+        {
+            speccy.clearProfiler();
+            return { "Profile cleared." };
+        }
+        else if (sub == "SHOW" && args.size() <= 3)
+        {
+            Profiler::Sort order = Profiler::Sort::TStates;
+            size_t countArg = 1;
+            if (args.size() > 1)
+            {
+                if (args[1] == "TIME") countArg = 2;
+                else if (args[1] == "COUNT") { order = Profiler::Sort::Count; countArg = 2; }
+                else if (args[1] == "ADDR") { order = Profiler::Sort::Address; countArg = 2; }
+            }
+            if (args.size() <= countArg + 1 && parseCount(countArg))
+            {
+                return profiler.hotSpotReport(speccy, order, maxCount);
+            }
+        }
+        else if (sub == "OPS" && args.size() <= 2)
+        {
+            if (parseCount(1)) return profiler.opCodeReport(maxCount);
+        }
+        else if (sub == "CALLS" && args.size() <= 2)
+        {
+            if (parseCount(1)) return speccy.getCallStack().report(name, maxCount);
+        }
+        else if (sub == "STACK" && args.size() == 1)
+        {
+            return speccy.getCallStack().stackReport(name);
+        }
+        else if (sub == "SAVE" && args.size() == 2)
+        {
+            string csv = profiler.csv(speccy) + "\n" + speccy.getCallStack().csv(name);
+            if (NxFile::saveFile(args[1], vector<u8>(csv.begin(), csv.end())))
+            {
+                return { stringFormat("Profile saved to '{0}'.", args[1]) };
+            }
+            return { stringFormat("Unable to save '{0}'.", args[1]) };
+        }
+
+        return {
+            "Syntax: PROF ON|OFF|CLEAR",
+            "        PROF SHOW [TIME|COUNT|ADDR] [n]",
+            "        PROF OPS [n]",
+            "        PROF CALLS [n]",
+            "        PROF STACK",
+            "        PROF SAVE <file>",
+        };
+    });
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -500,6 +597,14 @@ vector<string> Debugger::describeCommand(const char* format, vector<string> desc
     return lines;
 }
 
+string Debugger::routineName(u16 address, u32 physAddress)
+{
+    const Labels& labels = m_disassemblyWindow.getLabels();
+    auto it = lower_bound(labels.begin(), labels.end(), MemoryMap::Address(address),
+        [](const auto& label, MemoryMap::Address a) { return label.second < a; });
+    return it != labels.end() && it->second == address ? it->first : getSpeccy().physicalAddressName(physAddress);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Keyboard handling
 //----------------------------------------------------------------------------------------------------------------------
@@ -589,6 +694,10 @@ void Debugger::key(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool
     {
         switch (key)
         {
+        case K::F7:
+            getEmulator().stepBack();
+            break;
+
         case K::F3:
             if (!m_findAddresses.empty())
             {
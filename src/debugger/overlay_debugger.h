@@ -172,6 +172,9 @@ private:
     vector<string> syntaxCheck(const vector<string>& args, const char* format, vector<string> desc);
     vector<string> describeCommand(const char* format, vector<string> desc);
 
+    // The assembler's label for a routine, or its address if it has none.
+    string routineName(u16 address, u32 physAddress);
+
 private:
     MemoryDumpWindow            m_memoryDumpWindow;
     DisassemblyWindow           m_disassemblyWindow;
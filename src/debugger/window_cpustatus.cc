@@ -29,6 +29,8 @@ void CpuStatusWindow::onDraw(Draw &draw)
     draw.printString(m_x + 1, m_y + 13, "IM", false, colour);
     draw.printString(m_x + 1, m_y + 14, "HALT", false, colour);
     draw.printString(m_x + 1, m_y + 16, "FPS", false, colour);
+    draw.printString(m_x + 1, m_y + 17, "Under", false, colour);
+    draw.printString(m_x + 12, m_y + 17, "Over", false, colour);
     draw.printString(m_x + 12, m_y + 11, "S0: ", false, colour);
     draw.printString(m_x + 12, m_y + 12, "S1: ", false, colour);
     draw.printString(m_x + 12, m_y + 13, "S2: ", false, colour);
@@ -70,15 +72,19 @@ void CpuStatusWindow::onDraw(Draw &draw)
     static sf::Clock clock;
     draw.printString(m_x + 7, m_y + 16, draw.format("%d", (int)(sf::seconds(1) / clock.restart())), false, colour);
 
+    // Audio underruns and overruns
+    const Audio& audio = m_nx.getSpeccy().getAudio();
+    draw.printString(m_x + 7, m_y + 17, draw.format("%d", audio.getNumUnderruns()), false, colour);
+    draw.printString(m_x + 17, m_y + 17, draw.format("%d", audio.getNumOverruns()), false, colour);
+
     // Print out the stack
     for (int i = 1; i < m_height - 1; ++i) draw.printChar(m_x + 26, m_y + i, '\'', colour, gGfxFont);
     draw.printChar(m_x + 26, m_y + m_height - 1, '(', colour, gGfxFont);
 
     u16 a = m_z80.SP();
-    i64 ts = 0;
     for (int i = 0; i < 16; ++i)
     {
-        draw.printString(m_x + 29, m_y + 3 + i, draw.format("%04X", m_nx.getSpeccy().peek16(a, ts)), false, colour);
+        draw.printString(m_x + 29, m_y + 3 + i, draw.format("%04X", m_nx.getSpeccy().peek16(a)), false, colour);
         a += 2;
     }
 
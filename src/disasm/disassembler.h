@@ -9,6 +9,8 @@
 #include <asm/asm.h>
 #include <emulator/spectrum.h>
 
+#include <SFML/Graphics.hpp>
+
 //----------------------------------------------------------------------------------------------------------------------
 // DisassemblerDoc
 //
@@ -0,0 +1,283 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Shadow call stack implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/callstack.h>
+#include <utils/format.h>
+
+#include <algorithm>
+
+// Callees listed under each routine in a report
+static const size_t kMaxCalleesShown = 3;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Construction
+//----------------------------------------------------------------------------------------------------------------------
+
+CallStack::CallStack()
+{
+    reset();
+}
+
+void CallStack::reset()
+{
+    clearFrames();
+    clearCounts();
+}
+
+void CallStack::clearFrames()
+{
+    m_frames.clear();
+}
+
+void CallStack::clearCounts()
+{
+    // Frames that are still running carry on being timed from now.
+    m_time = 0;
+    for (auto& frame : m_frames)
+    {
+        frame.start = 0;
+        frame.childTStates = 0;
+    }
+    m_topLevelTStates = 0;
+    m_routines.clear();
+    m_edges.clear();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Following the CPU
+//----------------------------------------------------------------------------------------------------------------------
+
+void CallStack::step(const u8* bytes, u16 sp, bool interrupt, u16 newPC, u32 physNewPC, u16 newSP, u16 stackWord,
+    TState tStates)
+{
+    m_time += tStates;
+    if (interrupt)
+    {
+        // The handler is charged for the response.
+        push(newPC, physNewPC, stackWord, newSP, true, m_time - tStates);
+        return;
+    }
+    if (m_frames.empty()) m_topLevelTStates += tStates;
+
+    u8 opCode = bytes[0];
+    if (opCode == 0xcd || (opCode & 0xc7) == 0xc4 || (opCode & 0xc7) == 0xc7)
+    {
+        // CALL, CALL cc or RST.  A conditional call that isn't taken leaves SP alone.
+        if (newSP == u16(sp - 2)) push(newPC, physNewPC, stackWord, newSP, false, m_time);
+        return;
+    }
+
+    bool isReturn = opCode == 0xc9 || (opCode & 0xc7) == 0xc0 || (opCode == 0xed && (bytes[1] & 0xc7) == 0x45);
+    bool isJump = opCode == 0xe9 || ((opCode == 0xdd || opCode == 0xfd) && bytes[1] == 0xe9);
+
+    bool first = true;
+    while (!m_frames.empty())
+    {
+        const Frame& frame = m_frames.back();
+
+        // How far SP is above the return address, allowing for the stack wrapping round.
+        i16 above = i16(newSP - frame.sp);
+        if (above <= 0) break;
+
+        if (first)
+        {
+            if (!isReturn && !isJump && newPC != frame.returnAddress) break;
+        }
+        else
+        {
+            // Further frames end too if SP has gone past their return addresses as well, as when a program resets SP
+            // to recover from an error.  One whose return address shares the slot just returned through is kept.
+            if (above <= 2 && newPC != frame.returnAddress) break;
+        }
+
+        pop();
+        first = false;
+    }
+}
+
+void CallStack::addTime(TState tStates)
+{
+    m_time += tStates;
+    if (m_frames.empty()) m_topLevelTStates += tStates;
+}
+
+void CallStack::push(u16 routine, u32 physRoutine, u16 returnAddress, u16 sp, bool interrupt, TState start)
+{
+    u32 caller = m_frames.empty() ? kTopLevel : m_frames.back().physRoutine;
+    if (m_frames.size() == kMaxDepth) m_frames.erase(m_frames.begin());
+    m_frames.push_back({ routine, physRoutine, returnAddress, sp, interrupt, start, 0 });
+
+    Routine& r = m_routines[physRoutine];
+    r.physAddress = physRoutine;
+    r.address = routine;
+    ++r.calls;
+
+    Edge& e = m_edges[u64(caller) << 32 | physRoutine];
+    e.caller = caller;
+    e.callee = physRoutine;
+    ++e.calls;
+}
+
+void CallStack::pop()
+{
+    Frame frame = m_frames.back();
+    m_frames.pop_back();
+
+    TState inclusive = m_time - frame.start;
+    Routine& r = m_routines[frame.physRoutine];
+    r.physAddress = frame.physRoutine;
+    r.address = frame.routine;
+    r.exclusive += inclusive - frame.childTStates;
+
+    // Time in a recursive call is already part of the outer call's inclusive time.
+    if (!isRunning(frame.physRoutine, m_frames.size())) r.inclusive += inclusive;
+
+    u32 caller = m_frames.empty() ? kTopLevel : m_frames.back().physRoutine;
+    Edge& e = m_edges[u64(caller) << 32 | frame.physRoutine];
+    e.caller = caller;
+    e.callee = frame.physRoutine;
+    e.tStates += inclusive;
+
+    if (!m_frames.empty()) m_frames.back().childTStates += inclusive;
+}
+
+map<u32, u16> CallStack::routineAddresses(const vector<Routine>& routines)
+{
+    map<u32, u16> addresses;
+    for (const auto& r : routines) addresses[r.physAddress] = r.address;
+    return addresses;
+}
+
+bool CallStack::isRunning(u32 physRoutine, size_t depth) const
+{
+    for (size_t i = 0; i < depth; ++i)
+    {
+        if (m_frames[i].physRoutine == physRoutine) return true;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Results
+//----------------------------------------------------------------------------------------------------------------------
+
+vector<CallStack::Routine> CallStack::getRoutines() const
+{
+    // Charge the frames that are still running as if they returned now.
+    map<u32, Routine> routines = m_routines;
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        const Frame& frame = m_frames[i];
+        TState inclusive = m_time - frame.start;
+        TState runningChild = i + 1 < m_frames.size() ? m_time - m_frames[i + 1].start : 0;
+
+        Routine& r = routines[frame.physRoutine];
+        r.physAddress = frame.physRoutine;
+        r.address = frame.routine;
+        r.exclusive += inclusive - frame.childTStates - runningChild;
+        if (!isRunning(frame.physRoutine, i)) r.inclusive += inclusive;
+    }
+
+    vector<Routine> result;
+    for (const auto& r : routines) result.push_back(r.second);
+    stable_sort(result.begin(), result.end(), [](const Routine& r1, const Routine& r2) {
+        return r1.inclusive > r2.inclusive;
+    });
+
+    return result;
+}
+
+vector<CallStack::Edge> CallStack::getEdges() const
+{
+    map<u64, Edge> edges = m_edges;
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        u32 caller = i ? m_frames[i - 1].physRoutine : kTopLevel;
+        Edge& e = edges[u64(caller) << 32 | m_frames[i].physRoutine];
+        e.caller = caller;
+        e.callee = m_frames[i].physRoutine;
+        e.tStates += m_time - m_frames[i].start;
+    }
+
+    vector<Edge> result;
+    for (const auto& e : edges) result.push_back(e.second);
+    stable_sort(result.begin(), result.end(), [](const Edge& e1, const Edge& e2) { return e1.tStates > e2.tStates; });
+
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reports
+//----------------------------------------------------------------------------------------------------------------------
+
+vector<string> CallStack::report(const NameFunc& name, size_t maxCount) const
+{
+    vector<Routine> routines = getRoutines();
+    vector<Edge> edges = getEdges();
+    map<u32, u16> addresses = routineAddresses(routines);
+    u64 total = u64(m_time);
+
+    vector<string> lines;
+    lines.push_back(stringFormat("{0} routines, {1} t-states, {2} outside any routine.", routines.size(), total,
+        percentString(u64(m_topLevelTStates), total)));
+    lines.push_back("Incl.  Excl.  Routine");
+
+    if (maxCount && maxCount < routines.size()) routines.resize(maxCount);
+    for (const auto& r : routines)
+    {
+        lines.push_back(stringFormat("{0} {1} {2} {3}x", percentString(r.inclusive, total),
+            percentString(r.exclusive, total), name(r.address, r.physAddress), r.calls));
+
+        // Edges are already sorted by time, so the first few callees found are the ones it spent most time in.
+        size_t numShown = 0;
+        for (const auto& e : edges)
+        {
+            if (e.caller != r.physAddress) continue;
+            lines.push_back(stringFormat("{0}        > {1} {2}x", percentString(e.tStates, total),
+                name(addresses[e.callee], e.callee), e.calls));
+            if (++numShown == kMaxCalleesShown) break;
+        }
+    }
+
+    return lines;
+}
+
+vector<string> CallStack::stackReport(const NameFunc& name) const
+{
+    vector<string> lines;
+    for (auto it = m_frames.rbegin(); it != m_frames.rend(); ++it)
+    {
+        lines.push_back(stringFormat("{0} returns to ${1} (SP=${2}){3}", name(it->routine, it->physRoutine),
+            hexWord(it->returnAddress), hexWord(it->sp), it->interrupt ? " interrupt" : ""));
+    }
+    if (lines.empty()) lines.push_back("No calls are being followed.");
+
+    return lines;
+}
+
+string CallStack::csv(const NameFunc& name) const
+{
+    vector<Routine> routines = getRoutines();
+    map<u32, u16> addresses = routineAddresses(routines);
+
+    string s = "address,routine,calls,inclusive,exclusive\n";
+    for (const auto& r : routines)
+    {
+        s += stringFormat("{0},\"{1}\",{2},{3},{4}\n", r.physAddress, name(r.address, r.physAddress), r.calls,
+            r.inclusive, r.exclusive);
+    }
+    s += stringFormat("top level,,,{0},{0}\n", m_topLevelTStates);
+
+    s += "\ncaller,callee,calls,tstates\n";
+    for (const auto& e : getEdges())
+    {
+        string caller = e.caller == kTopLevel ? string("top level") : name(addresses[e.caller], e.caller);
+        s += stringFormat("\"{0}\",\"{1}\",{2},{3}\n", caller, name(addresses[e.callee], e.callee), e.calls, e.tStates);
+    }
+
+    return s;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
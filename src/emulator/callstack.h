@@ -0,0 +1,117 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Shadow call stack
+//
+// Follows the CALLs, RSTs, interrupts and returns the CPU runs, to know which routine is running and where it will
+// return to without trusting whatever is on the Z80's stack.  Each routine is charged the t-states spent in it
+// (exclusive) and in it and everything it calls (inclusive), and each caller/callee pair is counted, which gives the
+// call graph.
+//
+// Programs that play with the stack are followed too.  A frame ends when the stack pointer rises above the return
+// address it pushed, and either a return runs, PC reaches the return address or a JP (HL)/(IX)/(IY) jumps away.  So a
+// routine that pops its return address to read inline parameters ends when it jumps or returns back, not when it
+// pops.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <types.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class CallStack
+{
+public:
+    struct Frame
+    {
+        u16         routine;        // Address called
+        u32         physRoutine;
+        u16         returnAddress;
+        u16         sp;             // Where the return address was pushed
+        bool        interrupt;
+        TState      start;          // getTime() when the routine started
+        TState      childTStates;   // Time spent in routines it called that have returned
+    };
+
+    struct Routine
+    {
+        u32         physAddress;
+        u16         address;
+        u64         calls;
+        u64         inclusive;
+        u64         exclusive;
+    };
+
+    struct Edge
+    {
+        u32         caller;         // kTopLevel if there was no routine running
+        u32         callee;
+        u64         calls;
+        u64         tStates;
+    };
+
+    static const u32 kTopLevel = 0xffffffff;
+
+    // Names a routine from its Z80 and physical addresses.
+    using NameFunc = function<string(u16 address, u32 physAddress)>;
+
+    CallStack();
+
+    // Throw away the frames and the counts.
+    void reset();
+
+    // Throw away the frames but not the counts, for when the stack can no longer be trusted (such as when tracking
+    // starts again after a gap).
+    void clearFrames();
+    void clearCounts();
+
+    // Follow one instruction, given its first 4 bytes and SP from before it ran (or that it was an interrupt response),
+    // then PC, SP and the word at SP after it.
+    void step(const u8* bytes, u16 sp, bool interrupt, u16 newPC, u32 physNewPC, u16 newSP, u16 stackWord,
+        TState tStates);
+
+    // Time that passes without any instruction being followed, such as a skipped HALT.
+    void addTime(TState tStates);
+
+    const vector<Frame>& getFrames() const { return m_frames; }
+    TState getTime() const { return m_time; }
+
+    // The routine counts, including the calls that haven't returned yet, most inclusive t-states first.
+    vector<Routine> getRoutines() const;
+    vector<Edge> getEdges() const;
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Reports
+    //------------------------------------------------------------------------------------------------------------------
+
+    // The routines with the most inclusive t-states, each followed by the routines it spent most time calling.
+    vector<string> report(const NameFunc& name, size_t maxCount) const;
+
+    // The frames from the innermost out.
+    vector<string> stackReport(const NameFunc& name) const;
+
+    // All the routines, then all the caller/callee pairs, as CSV.
+    string csv(const NameFunc& name) const;
+
+private:
+    void push(u16 routine, u32 physRoutine, u16 returnAddress, u16 sp, bool interrupt, TState start);
+    void pop();
+    bool isRunning(u32 physRoutine, size_t depth) const;
+    static map<u32, u16> routineAddresses(const vector<Routine>& routines);
+
+    // Frames beyond this are dropped from the bottom, for programs that call without ever returning.
+    static const size_t kMaxDepth = 1024;
+
+private:
+    vector<Frame>               m_frames;
+    TState                      m_time;
+    TState                      m_topLevelTStates;
+    map<u32, Routine>           m_routines;         // By physical address
+    map<u64, Edge>              m_edges;            // By caller << 32 | callee
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
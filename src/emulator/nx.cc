@@ -6,6 +6,7 @@
 #include <editor/editor.h>
 #include <emulator/nx.h>
 #include <emulator/nxfile.h>
+#include <emulator/snapshot.h>
 #include <utils/tinyfiledialogs.h>
 #include <utils/ui.h>
 
@@ -163,9 +164,15 @@ void Emulator::key(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool
 
         case K::R:
             getSpeccy().reset(getSpeccy().getModel());
+            getEmulator().getRewind().clear();
             getEmulator().getDebugger().getDisassemblyWindow().setLabels(Labels{});
             break;
 
+        case K::B:
+            // Back to the snapshot from about a second ago.
+            getEmulator().getRewind().rewindFrames(50);
+            break;
+
         case K::O:
             openFile();
             break;
@@ -566,6 +573,8 @@ void Emulator::switchModel(Model model)
 
 Nx::Nx(int argc, char** argv)
     : m_machine(new Spectrum(std::bind(&Nx::frame, this)))   // #todo: Allow the debugger to switch Spectrums, via proxy
+    , m_rewind(*m_machine)
+    , m_audioDevice(m_machine->getAudio())
     , m_quit(false)
     , m_frameCounter(0)
     , m_zoom(false)
@@ -605,8 +614,11 @@ Nx::Nx(int argc, char** argv)
 #else
     m_tempPath = Path(argv[0]).parent();
 #endif
+    m_videoTexture.create(kWindowWidth, kWindowHeight);
+    m_videoSprite.setTexture(m_videoTexture);
+
     setScale(kDefaultScale);
-    m_machine->getVideoSprite().setScale(float(kDefaultScale + 1), float(kDefaultScale + 1));
+    m_videoSprite.setScale(float(kDefaultScale + 1), float(kDefaultScale + 1));
     m_ui.getSprite().setScale(float(kDefaultScale + 1) / 2, float(kDefaultScale + 1) / 2);
 
     // Deal with the command line
@@ -684,7 +696,15 @@ string Nx::getTitle() const
 void Nx::render()
 {
     m_window.clear();
-    m_window.draw(m_machine->getVideoSprite());
+
+    // Only the lines of the video image that have changed are sent to the texture.
+    int firstLine, lastLine;
+    if (m_machine->takeDirtyLines(firstLine, lastLine))
+    {
+        m_videoTexture.update((const sf::Uint8 *)(m_machine->getVideoImage() + firstLine * kWindowWidth),
+            kWindowWidth, unsigned(lastLine - firstLine + 1), 0, unsigned(firstLine));
+    }
+    m_window.draw(m_videoSprite);
     m_ui.render((m_frameCounter++ & 16) != 0);
     m_window.draw(m_ui.getSprite());
     m_window.display();
@@ -755,11 +775,11 @@ void Nx::run()
                             if (i++ == num) break;
                             if (ki.isKey)
                             {
-                                Overlay::currentOverlay()->key(ki.code, ki.pressed, ki.shift, ki.ctrl, ki.alt);
+                                m_ui.currentOverlay()->key(ki.code, ki.pressed, ki.shift, ki.ctrl, ki.alt);
                             }
                             else
                             {
-                                Overlay::currentOverlay()->text(char(ki.code));
+                                m_ui.currentOverlay()->text(char(ki.code));
                             }
                         }
                     }
@@ -841,24 +861,24 @@ void Nx::run()
                         break;
 
                     default:
-                        Overlay::currentOverlay()->key(event.key.code, true, false, true, false);
+                        m_ui.currentOverlay()->key(event.key.code, true, false, true, false);
                     }
                 }
                 else
                 {
-                    Overlay::currentOverlay()->key(event.key.code, true, event.key.shift, event.key.control, event.key.alt);
+                    m_ui.currentOverlay()->key(event.key.code, true, event.key.shift, event.key.control, event.key.alt);
                 }
                 break;
 
             case sf::Event::KeyReleased:
                 m_keys.emplace_back(true, false, event.key.shift, event.key.control, event.key.alt, event.key.code);
                 // Forward the key controls to the right mode handler
-                Overlay::currentOverlay()->key(event.key.code, false, event.key.shift, event.key.control, event.key.alt);
+                m_ui.currentOverlay()->key(event.key.code, false, event.key.shift, event.key.control, event.key.alt);
                 break;
                     
             case sf::Event::TextEntered:
                 m_keys.emplace_back(false, false, false, false, false, (sf::Keyboard::Key)event.text.unicode);
-                Overlay::currentOverlay()->text((char)event.text.unicode);
+                m_ui.currentOverlay()->text((char)event.text.unicode);
                 break;
 
             default:
@@ -869,7 +889,7 @@ void Nx::run()
         //
         // Generate a frame
         //
-        if (m_zoom || m_machine->getAudio().getSignal().isTriggered())
+        if (m_zoom || m_machine->getAudio().isFrameWanted())
         {
             frame();
             render();
@@ -888,6 +908,10 @@ void Nx::frame()
 {
     if (m_quit) return;
     bool breakpointHit = false;
+
+    // Calls are only followed while the debugger is open, for step out.
+    m_machine->setCallTracking(isDebugging());
+    if (m_runMode != RunMode::Stopped) m_rewind.update();
     m_machine->update(m_runMode, breakpointHit);
     if (breakpointHit)
     {
@@ -902,239 +926,19 @@ void Nx::frame()
 
 bool Nx::loadSnaSnapshot(string fileName)
 {
-    vector<u8> buffer = NxFile::loadFile(fileName);
-    u8* data = buffer.data();
-    i64 size = (i64)buffer.size();
-    Z80& z80 = m_machine->getZ80();
-    
-    if (size != 49179) return false;
-    
-    z80.I() = BYTE_OF(data, 0);
-    z80.HL_() = WORD_OF(data, 1);
-    z80.DE_() = WORD_OF(data, 3);
-    z80.BC_() = WORD_OF(data, 5);
-    z80.AF_() = WORD_OF(data, 7);
-    z80.HL() = WORD_OF(data, 9);
-    z80.DE() = WORD_OF(data, 11);
-    z80.BC() = WORD_OF(data, 13);
-    z80.IY() = WORD_OF(data, 15);
-    z80.IX() = WORD_OF(data, 17);
-    z80.IFF1() = (BYTE_OF(data, 19) & 0x01) != 0;
-    z80.IFF2() = (BYTE_OF(data, 19) & 0x04) != 0;
-    z80.R() = BYTE_OF(data, 20);
-    z80.AF() = WORD_OF(data, 21);
-    z80.SP() = WORD_OF(data, 23);
-    z80.IM() = BYTE_OF(data, 25);
-    m_machine->setBorderColour(BYTE_OF(data, 26));
-    m_machine->load(0x4000, data + 27, 0xc000);
-    
-    TState t = 0;
-    z80.PC() = z80.pop(t);
-    z80.IFF1() = z80.IFF2();
-    m_machine->resetTState();
-    
-    return true;
+    m_rewind.clear();
+    return ::loadSnaSnapshot(*m_machine, NxFile::loadFile(fileName));
 }
 
 bool Nx::loadZ80Snapshot(string fileName)
 {
-    vector<u8> buffer = NxFile::loadFile(fileName);
-    u8* data = buffer.data();
-    Z80& z80 = m_machine->getZ80();
-
-    // Only support version 1.0 Z80 files now
-    if (buffer.size() < 30) return false;
-    int version = 1;
-    if (WORD_OF(data, 6) == 0)
-    {
-        if (WORD_OF(data, 30) == 23) version = 2;
-        else version = 3;
-    }
-
-    if (version > 1)
-    {
-        // Check to see if we're only 48K
-        u8 hardware = BYTE_OF(data, 34);
-        if (version == 2 && (hardware != 0 && hardware == 1)) return false;
-        if (version == 3 && (hardware != 0 || hardware == 1 || hardware == 3)) return false;
-    }
-
-    z80.A() = BYTE_OF(data, 0);
-    z80.F() = BYTE_OF(data, 1);
-    z80.BC() = WORD_OF(data, 2);
-    z80.HL() = WORD_OF(data, 4);
-    z80.PC() = WORD_OF(data, 6);
-    z80.SP() = WORD_OF(data, 8);
-    z80.I() = BYTE_OF(data, 10);
-    z80.R() = (BYTE_OF(data, 11) & 0x7f) | ((BYTE_OF(data, 12) & 0x01) << 7);
-    u8 b12 = BYTE_OF(data, 12);
-    if (b12 == 255) b12 = 1;
-    m_machine->setBorderColour((b12 & 0x0e) >> 1);
-    bool compressed = (b12 & 0x20) != 0;
-    z80.DE() = WORD_OF(data, 13);
-    z80.BC_() = WORD_OF(data, 15);
-    z80.DE_() = WORD_OF(data, 17);
-    z80.HL_() = WORD_OF(data, 19);
-    u8 a_ = BYTE_OF(data, 21);
-    u8 f_ = BYTE_OF(data, 22);
-    z80.AF_() = (u16(a_) << 8) + u16(f_);
-    z80.IY() = WORD_OF(data, 23);
-    z80.IX() = WORD_OF(data, 25);
-    z80.IFF1() = BYTE_OF(data, 27) ? 1 : 0;
-    z80.IFF2() = BYTE_OF(data, 28) ? 1 : 0;
-    z80.IM() = int(BYTE_OF(data, 29) & 0x03);
-
-#define CHECK_BUFFER() do { if (size_t(mem - data) >= buffer.size()) { NX_BREAK(); return false; } } while(0)
-
-    if (version == 1)
-    {
-        if (compressed)
-        {
-            u8* mem = data + 30;
-            u16 a = 0x4000;
-            while (1)
-            {
-                // Check we haven't run out of bytes.
-                CHECK_BUFFER();
-                u8 b = *mem++;
-                if (b == 0x00)
-                {
-                    // Not enough room for 4 terminating bytes
-                    if (size_t(mem + 3 - data) > buffer.size())
-                    {
-                        NX_BREAK();
-                        return false;
-                    }
-
-                    if (mem[0] == 0xed && mem[1] == 0xed && mem[2] == 0x00)
-                    {
-                        // Terminator.
-                        break;
-                    }
-
-                    m_machine->poke(a++, 0);
-                }
-                else if (b == 0xed)
-                {
-                    CHECK_BUFFER();
-                    b = *mem++;
-                    if (b != 0xed)
-                    {
-                        m_machine->poke(a++, 0xed);
-                        m_machine->poke(a++, b);
-                    }
-                    else
-                    {
-                        // Two EDs - compression.
-                        CHECK_BUFFER();
-                        u8 count = *mem++;
-                        CHECK_BUFFER();
-                        b = *mem++;
-
-                        for (u8 i = 0; i < count; ++i)
-                        {
-                            m_machine->poke(a++, b);
-                        }
-                    }
-                }
-                else
-                {
-                    m_machine->poke(a++, b);
-                }
-            }
-        }
-        else
-        {
-            if (buffer.size() != (0xc000 + 30)) return false;
-
-            m_machine->load(0x4000, data + 30, 0xc000);
-        }
-    }
-    else
-    {
-        // Version 2 & 3 files
-        u8* mem = data + 32 + WORD_OF(data, 30);
-        z80.PC() = WORD_OF(data, 32);
-        if (version == 3)
-        {
-            m_machine->setTState(TState(WORD_OF(data, 55)) + (TState(BYTE_OF(data, 57)) << 16));
-        }
-
-        u16 pages[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x8000, 0xc000, 0x0000, 0x0000, 0x4000, 0x0000, 0x0000, 0x0000 };
-        for (int i = 0; i < 3; ++i)
-        {
-            u16 a = pages[BYTE_OF(mem,2)];
-            u16 len = WORD_OF(mem, 0);
-            mem += 3;
-            bool compressed = (len != 0xffff);
-            if (!compressed) len = 0x4000;
-
-            int idx = 0;
-            while (idx < len)
-            {
-                u8 b = mem[idx++];
-                if (b == 0xed)
-                {
-                    b = mem[idx++];
-                    if (b == 0xed)
-                    {
-                        u8 count = mem[idx++];
-                        b = mem[idx++];
-                        for (int ii = 0; ii < count; ++ii)
-                        {
-                            m_machine->poke(a++, b);
-                        }
-                    }
-                    else
-                    {
-                        m_machine->poke(a++, 0xed);
-                        m_machine->poke(a++, b);
-                    }
-                }
-                else
-                {
-                    m_machine->poke(a++, b);
-                }
-            }
-            mem += len;
-        }
-    }
-
-    return true;
+    m_rewind.clear();
+    return ::loadZ80Snapshot(*m_machine, NxFile::loadFile(fileName));
 }
 
 bool Nx::saveSnaSnapshot(string fileName)
 {
-    vector<u8> data;
-    Z80& z80 = m_machine->getZ80();
-
-    TState t = 0;
-    z80.push(z80.PC(), t);
-
-    NxFile::write8(data, z80.I());
-    NxFile::write16(data, z80.HL_());
-    NxFile::write16(data, z80.DE_());
-    NxFile::write16(data, z80.BC_());
-    NxFile::write16(data, z80.AF_());
-    NxFile::write16(data, z80.HL());
-    NxFile::write16(data, z80.DE());
-    NxFile::write16(data, z80.BC());
-    NxFile::write16(data, z80.IY());
-    NxFile::write16(data, z80.IX());
-    NxFile::write8(data, (z80.IFF1() ? 0x01 : 0) | (z80.IFF2() ? 0x04 : 0));
-    NxFile::write8(data, z80.R());
-    NxFile::write16(data, z80.AF());
-    NxFile::write16(data, z80.SP());
-    NxFile::write8(data, (u8)z80.IM());
-    NxFile::write8(data, m_machine->getBorderColour());
-    for (u16 a = 0x4000; a; ++a)
-    {
-        data.emplace_back(m_machine->peek(a));
-    }
-
-    z80.pop(t);
-
-    return NxFile::saveFile(fileName, data);
+    return NxFile::saveFile(fileName, ::saveSnaSnapshot(*m_machine));
 }
 
 bool Nx::loadNxSnapshot(string fileName)
@@ -1343,14 +1147,13 @@ bool Nx::saveNxSnapshot(string fileName, bool saveEmulatorSettings)
 
         // Save out the memory
         BlockSection r128('R128');
-        TState t = 0;
         int oldSlot3 = m_machine->getBank(3);
         for (int i = 0; i < 8; ++i)
         {
             m_machine->bank(3, i);
             for (u16 byte = 0xc000; byte != 0x0000; ++byte)
             {
-                r128.poke8(m_machine->peek(byte, t));
+                r128.poke8(m_machine->peek(byte));
             }
         }
         m_machine->bank(3, oldSlot3);
@@ -1465,6 +1268,7 @@ void Nx::switchModel(Model model)
 {
     m_emulator.switchModel(model);
     getSpeccy().reset(model);
+    m_rewind.clear();
     m_window.setTitle(getTitle().c_str());
 }
 
@@ -1508,6 +1312,15 @@ void Nx::stepIn()
     m_debugger.getDisassemblyWindow().setCursor(m_machine->getZ80().PC());
 }
 
+void Nx::stepBack()
+{
+    assert(isDebugging());
+    if (m_runMode == RunMode::Normal) togglePause(false);
+
+    m_rewind.stepBack();
+    m_debugger.getDisassemblyWindow().setCursor(m_machine->getZ80().PC());
+}
+
 void Nx::stepOver()
 {
     u16 pc = getSpeccy().getZ80().PC();
@@ -1532,9 +1345,20 @@ void Nx::stepOut()
     if (m_runMode == RunMode::Normal) togglePause(false);
     else
     {
+        // The shadow call stack knows where the current routine returns to even if it has pushed more since.  It only
+        // has the calls made while the debugger was open, so fall back to the word at SP if it has nothing that SP is
+        // still below.
         u16 sp = getSpeccy().getZ80().SP();
-        TState t = 0;
-        u16 address = m_machine->peek16(sp, t);
+        const auto& frames = getSpeccy().getCallStack().getFrames();
+        u16 address;
+        if (!frames.empty() && i16(sp - frames.back().sp) <= 0)
+        {
+            address = frames.back().returnAddress;
+        }
+        else
+        {
+            address = m_machine->peek16(sp);
+        }
         m_machine->addTemporaryBreakpoint(address);
         m_runMode = RunMode::Normal;
     }
@@ -6,11 +6,13 @@
 #pragma once
 
 #include <asm/overlay_asm.h>
+#include <audio/audiodevice.h>
 #include <debugger/overlay_debugger.h>
 #include <disasm/overlay_disasm.h>
 #include <editor/overlay_editor.h>
+#include <emulator/rewind.h>
 #include <emulator/spectrum.h>
-#include <tape/tape.h>
+#include <tape/overlay_tape.h>
 
 #include <SFML/Graphics.hpp>
 
@@ -103,6 +105,9 @@ public:
     Spectrum& getSpeccy() { return *m_machine; }
     const Spectrum& getSpeccy() const { return *m_machine; }
 
+    // Obtain a reference to the UI, which knows which overlay is showing.
+    Ui& getUi() { return m_ui; }
+
     // Obtain a reference to the debugger.
     Debugger& getDebugger() { return m_debugger; }
 
@@ -133,14 +138,18 @@ public:
     void updateSettings();
 
     // Debugging
-    bool isDebugging() const { return Overlay::currentOverlay() == &m_debugger; }
+    bool isDebugging() const { return m_ui.currentOverlay() == &m_debugger; }
     void togglePause(bool breakpointHit);
     void stepOver();
     void stepIn();
     void stepOut();
+    void stepBack();
     RunMode getRunMode() const { return m_runMode; }
     void setRunMode(RunMode runMode) { m_runMode = m_runMode; }
 
+    // Rewind
+    Rewind& getRewind() { return m_rewind; }
+
     // Peripherals
     bool usesKempstonJoystick() const { return m_kempstonJoystick; }
 
@@ -180,8 +189,9 @@ private:
 
 private:
     Spectrum*           m_machine;
+    Rewind              m_rewind;
+    AudioDevice         m_audioDevice;
     Ui                  m_ui;
-    Signal              m_renderSignal;
     bool                m_quit;
     int                 m_frameCounter;
     bool                m_zoom;
@@ -204,6 +214,8 @@ private:
 
     // Rendering
     sf::RenderWindow    m_window;
+    sf::Texture         m_videoTexture;
+    sf::Sprite          m_videoSprite;
 
     // Peripherals
     bool                m_kempstonJoystick;
@@ -4,8 +4,6 @@
 
 #include <emulator/nxfile.h>
 
-#include <SFML/System.hpp>
-
 #include <fstream>
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -191,13 +189,15 @@ NxFile::NxFile()
 vector<u8> NxFile::loadFile(string fileName)
 {
     vector<u8> buffer;
-    sf::FileInputStream f;
+    ifstream f;
+    f.open(fileName, ios::in | ios::binary | ios::ate);
 
-    if (f.open(fileName))
+    if (f)
     {
-        i64 size = f.getSize();
+        i64 size = (i64)f.tellg();
         buffer.resize(size);
-        f.read(buffer.data(), size);
+        f.seekg(0);
+        f.read((char *)buffer.data(), size);
     }
 
     return buffer;
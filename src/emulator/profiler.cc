@@ -0,0 +1,218 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Execution profiler implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <asm/disasm.h>
+#include <emulator/profiler.h>
+#include <emulator/spectrum.h>
+#include <utils/format.h>
+
+#include <algorithm>
+#include <cstring>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Construction
+//----------------------------------------------------------------------------------------------------------------------
+
+Profiler::Profiler()
+{
+    reset(0);
+}
+
+void Profiler::reset(size_t memorySize)
+{
+    m_counts.assign(memorySize, 0);
+    m_tStates.assign(memorySize, 0);
+    memset(m_opCodes, 0, sizeof(m_opCodes));
+    m_numInstructions = 0;
+    m_numTStates = 0;
+    m_numInterrupts = 0;
+    m_interruptTStates = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Counting
+//----------------------------------------------------------------------------------------------------------------------
+
+void Profiler::addInstruction(u32 physAddress, const u8* bytes, TState tStates)
+{
+    ++m_counts[physAddress];
+    m_tStates[physAddress] += tStates;
+    ++m_numInstructions;
+    m_numTStates += tStates;
+
+    switch (bytes[0])
+    {
+    case 0xcb:  ++m_opCodes[(int)Group::CB][bytes[1]];  break;
+    case 0xed:  ++m_opCodes[(int)Group::ED][bytes[1]];  break;
+
+    case 0xdd:
+    case 0xfd:
+        if (bytes[1] == 0xcb)
+        {
+            ++m_opCodes[(int)(bytes[0] == 0xdd ? Group::DDCB : Group::FDCB)][bytes[3]];
+        }
+        else
+        {
+            // A prefix followed by another prefix runs as a 4 t-state NOP, which is counted as its own opcode.
+            ++m_opCodes[(int)(bytes[0] == 0xdd ? Group::DD : Group::FD)][bytes[1]];
+        }
+        break;
+
+    default:
+        ++m_opCodes[(int)Group::Base][bytes[0]];
+    }
+}
+
+void Profiler::addHalt(u32 physAddress, TState tStates)
+{
+    u64 numFetches = u64(tStates + 3) / 4;
+    m_counts[physAddress] += numFetches;
+    m_tStates[physAddress] += tStates;
+    m_opCodes[(int)Group::Base][0x76] += numFetches;
+    m_numInstructions += numFetches;
+    m_numTStates += tStates;
+}
+
+void Profiler::addInterrupt(TState tStates)
+{
+    ++m_numInterrupts;
+    m_interruptTStates += tStates;
+    m_numTStates += tStates;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Results
+//----------------------------------------------------------------------------------------------------------------------
+
+vector<Profiler::HotSpot> Profiler::getHotSpots(Sort order, size_t maxCount) const
+{
+    vector<HotSpot> spots;
+    for (u32 a = 0; a < (u32)m_counts.size(); ++a)
+    {
+        if (m_counts[a]) spots.push_back({ a, m_counts[a], m_tStates[a] });
+    }
+
+    auto compare = [order](const HotSpot& s1, const HotSpot& s2) {
+        switch (order)
+        {
+        case Sort::TStates: if (s1.tStates != s2.tStates) return s1.tStates > s2.tStates; break;
+        case Sort::Count:   if (s1.count != s2.count) return s1.count > s2.count; break;
+        default:            break;
+        }
+        return s1.physAddress < s2.physAddress;
+    };
+
+    if (maxCount && maxCount < spots.size())
+    {
+        partial_sort(spots.begin(), spots.begin() + maxCount, spots.end(), compare);
+        spots.resize(maxCount);
+    }
+    else
+    {
+        std::sort(spots.begin(), spots.end(), compare);
+    }
+
+    return spots;
+}
+
+vector<Profiler::OpCode> Profiler::getOpCodes(size_t maxCount) const
+{
+    vector<OpCode> ops;
+    for (int g = 0; g < (int)Group::COUNT; ++g)
+    {
+        for (int op = 0; op < 256; ++op)
+        {
+            if (m_opCodes[g][op]) ops.push_back({ Group(g), u8(op), m_opCodes[g][op] });
+        }
+    }
+
+    stable_sort(ops.begin(), ops.end(), [](const OpCode& op1, const OpCode& op2) { return op1.count > op2.count; });
+    if (maxCount && maxCount < ops.size()) ops.resize(maxCount);
+
+    return ops;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reports
+//----------------------------------------------------------------------------------------------------------------------
+
+const char* Profiler::groupName(Group group)
+{
+    static const char* names[] = { "", "CB", "ED", "DD", "FD", "DDCB", "FDCB" };
+    return names[(int)group];
+}
+
+string Profiler::opCodeName(Group group, u8 opCode)
+{
+    u8 bytes[4] = { opCode, 0, 0, 0 };
+    switch (group)
+    {
+    case Group::CB:     bytes[0] = 0xcb; bytes[1] = opCode;                     break;
+    case Group::ED:     bytes[0] = 0xed; bytes[1] = opCode;                     break;
+    case Group::DD:     bytes[0] = 0xdd; bytes[1] = opCode;                     break;
+    case Group::FD:     bytes[0] = 0xfd; bytes[1] = opCode;                     break;
+    case Group::DDCB:   bytes[0] = 0xdd; bytes[1] = 0xcb; bytes[3] = opCode;    break;
+    case Group::FDCB:   bytes[0] = 0xfd; bytes[1] = 0xcb; bytes[3] = opCode;    break;
+    default:                                                                    break;
+    }
+
+    Disassembler d;
+    d.disassemble(0, bytes[0], bytes[1], bytes[2], bytes[3]);
+    string operands = d.operandString();
+    return operands.empty() ? d.opCodeString() : d.opCodeString() + " " + operands;
+}
+
+vector<string> Profiler::hotSpotReport(Spectrum& speccy, Sort order, size_t maxCount) const
+{
+    vector<string> lines;
+    lines.push_back(stringFormat("{0} instructions, {1} t-states.", m_numInstructions, m_numTStates));
+    for (const auto& spot : getHotSpots(order, maxCount))
+    {
+        lines.push_back(stringFormat("{0} {1} {2}t {3}x", percentString(spot.tStates, m_numTStates),
+            speccy.physicalAddressName(spot.physAddress), spot.tStates, spot.count));
+    }
+    if (m_numInterrupts)
+    {
+        lines.push_back(stringFormat("{0} interrupts {1}t", percentString(m_interruptTStates, m_numTStates),
+            m_interruptTStates));
+    }
+
+    return lines;
+}
+
+vector<string> Profiler::opCodeReport(size_t maxCount) const
+{
+    vector<string> lines;
+    for (const auto& op : getOpCodes(maxCount))
+    {
+        string code = op.group == Group::Base ? hexByte(op.opCode) : string(groupName(op.group)) + hexByte(op.opCode);
+        lines.push_back(stringFormat("{0} {1} {2} {3}x", percentString(op.count, m_numInstructions), code,
+            opCodeName(op.group, op.opCode), op.count));
+    }
+
+    return lines;
+}
+
+string Profiler::csv(Spectrum& speccy) const
+{
+    string s = "address,name,instructions,tstates\n";
+    for (const auto& spot : getHotSpots(Sort::Address, 0))
+    {
+        s += stringFormat("{0},\"{1}\",{2},{3}\n", spot.physAddress, speccy.physicalAddressName(spot.physAddress),
+            spot.count, spot.tStates);
+    }
+    s += stringFormat("interrupts,,{0},{1}\n", m_numInterrupts, m_interruptTStates);
+
+    s += "\nprefix,opcode,mnemonic,count\n";
+    for (const auto& op : getOpCodes(0))
+    {
+        s += stringFormat("{0},{1},\"{2}\",{3}\n", groupName(op.group), hexByte(op.opCode),
+            opCodeName(op.group, op.opCode), op.count);
+    }
+
+    return s;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
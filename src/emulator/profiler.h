@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Execution profiler
+//
+// Counts the instructions run and the t-states they took (including contention) at each physical address, and how
+// often each opcode of each prefix group was used.  The Spectrum feeds it one instruction at a time while profiling is
+// on, and the debugger and nx-headless turn the counts into reports.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <types.h>
+
+#include <string>
+#include <vector>
+
+class Spectrum;
+
+class Profiler
+{
+public:
+    enum class Group
+    {
+        Base,
+        CB,
+        ED,
+        DD,
+        FD,
+        DDCB,
+        FDCB,
+
+        COUNT
+    };
+
+    enum class Sort
+    {
+        TStates,
+        Count,
+        Address,
+    };
+
+    struct HotSpot
+    {
+        u32         physAddress;
+        u64         count;
+        u64         tStates;
+    };
+
+    struct OpCode
+    {
+        Group       group;
+        u8          opCode;
+        u64         count;
+    };
+
+    Profiler();
+
+    // Throw away all the counts and size the address tables for a machine with this much memory.  They take 16 bytes
+    // per byte of memory, so a size of 0 frees them while nothing is being profiled.
+    void reset(size_t memorySize);
+    size_t getMemorySize() const { return m_counts.size(); }
+
+    // Add an instruction whose first 4 bytes (as they were before it ran) are given.  A HALT that was skipped over
+    // counts as one instruction per 4 t-states.
+    void addInstruction(u32 physAddress, const u8* bytes, TState tStates);
+    void addHalt(u32 physAddress, TState tStates);
+
+    // Add the t-states taken to respond to an interrupt, which don't belong to any instruction.
+    void addInterrupt(TState tStates);
+
+    u64 getNumInstructions() const { return m_numInstructions; }
+    u64 getNumTStates() const { return m_numTStates; }
+    u64 getNumInterrupts() const { return m_numInterrupts; }
+
+    // The addresses that have been run, sorted, and at most maxCount of them (0 for all).
+    vector<HotSpot> getHotSpots(Sort order, size_t maxCount) const;
+
+    // Opcodes that have been run, most used first, and at most maxCount of them (0 for all).
+    vector<OpCode> getOpCodes(size_t maxCount) const;
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Reports
+    //------------------------------------------------------------------------------------------------------------------
+
+    static const char* groupName(Group group);
+
+    // The opcode's mnemonic with its operands shown as 0.
+    static string opCodeName(Group group, u8 opCode);
+
+    // Lines of text listing the hot spots and the most used opcodes.
+    vector<string> hotSpotReport(Spectrum& speccy, Sort order, size_t maxCount) const;
+    vector<string> opCodeReport(size_t maxCount) const;
+
+    // All the counts as CSV: one line per address that was run, then one per opcode that was used.
+    string csv(Spectrum& speccy) const;
+
+private:
+    vector<u64>     m_counts;       // Per physical address
+    vector<u64>     m_tStates;      // Per physical address
+    u64             m_opCodes[(int)Group::COUNT][256];
+    u64             m_numInstructions;
+    u64             m_numTStates;
+    u64             m_numInterrupts;
+    u64             m_interruptTStates;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
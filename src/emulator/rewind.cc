@@ -0,0 +1,374 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Rewind implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/rewind.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Construction
+//----------------------------------------------------------------------------------------------------------------------
+
+Rewind::Rewind(Spectrum& speccy, size_t bufferSize, int interval)
+    : m_speccy(speccy)
+    , m_interval(interval)
+    , m_buffer(bufferSize)
+    , m_head(0)
+    , m_lastFrame(0)
+    , m_eventBase(0)
+    , m_lastKempston(0)
+{
+    clear();
+}
+
+void Rewind::clear()
+{
+    m_snapshots.clear();
+    m_head = 0;
+    m_latest.clear();
+    m_events.clear();
+    m_eventBase = 0;
+    memset(m_lastKeys, 0, sizeof(m_lastKeys));
+    m_lastKempston = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Recording
+//----------------------------------------------------------------------------------------------------------------------
+
+i64 Rewind::getTime() const
+{
+    return m_speccy.getFrameCount() * m_speccy.getFrameTime() + m_speccy.getTState();
+}
+
+i64 Rewind::getOldestTime() const
+{
+    return m_snapshots.empty() ? getTime() : m_snapshots.front().time;
+}
+
+size_t Rewind::getMemoryUsed() const
+{
+    size_t size = 0;
+    for (const auto& snapshot : m_snapshots) size += snapshot.size;
+    return size;
+}
+
+void Rewind::update()
+{
+    // The history no longer leads up to the machine if it has been reset or changed model.
+    if (!m_snapshots.empty() &&
+        (getTime() < m_snapshots.back().time || m_speccy.getMemory().size() != m_latest.size()))
+    {
+        clear();
+    }
+
+    if (m_snapshots.empty() || m_speccy.getFrameCount() >= m_lastFrame + m_interval) takeSnapshot();
+    recordInput();
+}
+
+void Rewind::takeSnapshot()
+{
+    const vector<u8>& memory = m_speccy.getMemory();
+
+    Snapshot snapshot;
+    snapshot.state = m_speccy.getState();
+    snapshot.time = getTime();
+    snapshot.offset = m_head;
+    snapshot.size = 0;
+
+    if (!m_snapshots.empty())
+    {
+        // Only the chunks that have been written since the last snapshot are encoded.
+        m_encoded.clear();
+        for (size_t p = 0; p < memory.size(); p += kChunkSize)
+        {
+            if (memcmp(&memory[p], &m_latest[p], kChunkSize) != 0)
+            {
+                encodeChunk(&memory[p], &m_latest[p], u32(p / kChunkSize));
+                memcpy(&m_latest[p], &memory[p], kChunkSize);
+            }
+        }
+
+        if (m_snapshots.size() >= kMaxSnapshots) dropOldest();
+        snapshot.offset = allocate(m_encoded.size());
+        if (!m_snapshots.empty())
+        {
+            snapshot.size = m_encoded.size();
+            copy(m_encoded.begin(), m_encoded.end(), m_buffer.begin() + snapshot.offset);
+        }
+    }
+
+    // With nothing before it, a snapshot keeps the whole of memory instead of changes.
+    if (m_snapshots.empty())
+    {
+        m_latest = memory;
+        m_head = 0;
+        snapshot.offset = 0;
+    }
+
+    snapshot.firstEvent = m_eventBase + m_events.size();
+    m_snapshots.push_back(snapshot);
+    m_lastFrame = snapshot.state.frameCount;
+}
+
+void Rewind::recordInput()
+{
+    const vector<u8>& keys = m_speccy.getKeyboardState();
+    u8 kempston = m_speccy.getKempstonState();
+    if (equal(keys.begin(), keys.end(), m_lastKeys) && kempston == m_lastKempston) return;
+
+    Event event;
+    event.time = getTime();
+    copy(keys.begin(), keys.end(), event.keys);
+    event.kempstonState = kempston;
+    m_events.push_back(event);
+
+    copy(keys.begin(), keys.end(), m_lastKeys);
+    m_lastKempston = kempston;
+}
+
+size_t Rewind::allocate(size_t size)
+{
+    if (size > m_buffer.size())
+    {
+        while (!m_snapshots.empty()) dropOldest();
+        return 0;
+    }
+
+    for (;;)
+    {
+        size_t pos = m_head + size > m_buffer.size() ? 0 : m_head;
+        bool overlaps = false;
+        for (const auto& snapshot : m_snapshots)
+        {
+            if (snapshot.size && snapshot.offset < pos + size && pos < snapshot.offset + snapshot.size)
+            {
+                overlaps = true;
+                break;
+            }
+        }
+
+        if (!overlaps)
+        {
+            m_head = pos + size;
+            return pos;
+        }
+        dropOldest();
+    }
+}
+
+void Rewind::dropOldest()
+{
+    m_snapshots.pop_front();
+    if (m_snapshots.empty())
+    {
+        m_eventBase += m_events.size();
+        m_events.clear();
+        m_head = 0;
+        return;
+    }
+
+    // The new oldest snapshot's changes lead from one that has gone, so they are no longer needed.
+    Snapshot& oldest = m_snapshots.front();
+    oldest.size = 0;
+    while (m_eventBase < oldest.firstEvent)
+    {
+        m_events.pop_front();
+        ++m_eventBase;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Memory changes
+//----------------------------------------------------------------------------------------------------------------------
+
+void Rewind::encodeChunk(const u8* data, const u8* previous, u32 chunk)
+{
+    for (int i = 0; i < 4; ++i) m_encoded.push_back(u8(chunk >> (i * 8)));
+
+    // 0x80 | (n - 1) is a run of n unchanged bytes, and n - 1 is followed by n changed bytes (each up to 128).
+    size_t i = 0;
+    while (i < kChunkSize)
+    {
+        size_t n = 0;
+        while (i + n < kChunkSize && n < 128 && data[i + n] == previous[i + n]) ++n;
+        if (n)
+        {
+            m_encoded.push_back(u8(0x80 | (n - 1)));
+            i += n;
+            continue;
+        }
+
+        // A single unchanged byte is cheaper kept in a run of changes than as a run of its own.
+        size_t start = i;
+        while (i < kChunkSize && i - start < 128)
+        {
+            if (data[i] == previous[i] && (i + 1 == kChunkSize || data[i + 1] == previous[i + 1])) break;
+            ++i;
+        }
+        m_encoded.push_back(u8(i - start - 1));
+        for (size_t j = start; j < i; ++j) m_encoded.push_back(data[j] ^ previous[j]);
+    }
+}
+
+void Rewind::applyChanges(const Snapshot& snapshot, vector<u8>& memory) const
+{
+    const u8* p = m_buffer.data() + snapshot.offset;
+    const u8* end = p + snapshot.size;
+    while (p < end)
+    {
+        u32 chunk = u32(p[0]) | (u32(p[1]) << 8) | (u32(p[2]) << 16) | (u32(p[3]) << 24);
+        p += 4;
+
+        u8* out = &memory[chunk * kChunkSize];
+        size_t i = 0;
+        while (i < kChunkSize)
+        {
+            u8 token = *p++;
+            size_t n = (token & 0x7f) + 1;
+            if (!(token & 0x80))
+            {
+                for (size_t j = 0; j < n; ++j) out[i + j] ^= p[j];
+                p += n;
+            }
+            i += n;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Going back
+//----------------------------------------------------------------------------------------------------------------------
+
+int Rewind::findSnapshot(i64 time, bool before) const
+{
+    for (int i = int(m_snapshots.size()) - 1; i >= 0; --i)
+    {
+        i64 t = m_snapshots[i].time;
+        if (before ? t < time : t <= time) return i;
+    }
+    return -1;
+}
+
+void Rewind::restore(size_t index)
+{
+    // Undo the changes of each newer snapshot, newest first.
+    m_memory = m_latest;
+    for (size_t i = m_snapshots.size() - 1; i > index; --i) applyChanges(m_snapshots[i], m_memory);
+
+    // Writing memory drops decoded instructions, so only the chunks that are different are written.
+    const vector<u8>& memory = m_speccy.getMemory();
+    assert(memory.size() == m_memory.size());
+    for (size_t p = 0; p < memory.size(); p += kChunkSize)
+    {
+        if (memcmp(&memory[p], &m_memory[p], kChunkSize) != 0)
+        {
+            m_speccy.setMemory(u32(p), &m_memory[p], u32(kChunkSize));
+        }
+    }
+
+    m_latest.swap(m_memory);
+    m_snapshots.resize(index + 1);
+
+    const Snapshot& snapshot = m_snapshots.back();
+    m_speccy.setState(snapshot.state);
+    m_head = snapshot.offset + snapshot.size;
+    m_lastFrame = snapshot.state.frameCount;
+}
+
+i64 Rewind::replay(size_t index, i64 time)
+{
+    size_t e = size_t(m_snapshots[index].firstEvent - m_eventBase);
+    i64 last = getTime();
+    for (;;)
+    {
+        i64 now = getTime();
+        if (now >= time) break;
+        last = now;
+
+        for (; e < m_events.size() && m_events[e].time <= now; ++e)
+        {
+            vector<u8> keys(begin(m_events[e].keys), end(m_events[e].keys));
+            m_speccy.setKeyboardState(keys);
+            m_speccy.setKempstonState(m_events[e].kempstonState);
+        }
+
+        bool breakpointHit;
+        m_speccy.update(RunMode::StepIn, breakpointHit);
+    }
+
+    return last;
+}
+
+void Rewind::dropFuture(vector<u8>& liveKeys, u8 liveKempston)
+{
+    // What happened after here is no longer going to happen, but the input carries on from how it is now.  The next
+    // update() records the difference.
+    i64 now = getTime();
+    while (!m_events.empty() && m_events.back().time >= now) m_events.pop_back();
+
+    const vector<u8>& keys = m_speccy.getKeyboardState();
+    copy(keys.begin(), keys.end(), m_lastKeys);
+    m_lastKempston = m_speccy.getKempstonState();
+
+    m_speccy.setKeyboardState(liveKeys);
+    m_speccy.setKempstonState(liveKempston);
+}
+
+bool Rewind::seek(i64 time)
+{
+    int index = findSnapshot(time, false);
+    if (index < 0) return false;
+
+    vector<u8> liveKeys = m_speccy.getKeyboardState();
+    u8 liveKempston = m_speccy.getKempstonState();
+
+    // An instruction can't be stopped half way, so run past the time to find the last boundary at or before it, then
+    // go back again and run to that.
+    restore(index);
+    if (getTime() != time)
+    {
+        i64 last = replay(index, time + 1);
+        restore(index);
+        replay(index, last);
+    }
+
+    dropFuture(liveKeys, liveKempston);
+    return true;
+}
+
+bool Rewind::stepBack()
+{
+    i64 now = getTime();
+    if (findSnapshot(now, true) < 0) return false;
+    return seek(now - 1);
+}
+
+bool Rewind::rewindFrames(int numFrames)
+{
+    if (m_snapshots.empty()) return false;
+
+    i64 frame = m_speccy.getFrameCount() - numFrames;
+    size_t index = 0;
+    for (size_t i = m_snapshots.size(); i > 0; --i)
+    {
+        if (m_snapshots[i - 1].state.frameCount <= frame)
+        {
+            index = i - 1;
+            break;
+        }
+    }
+
+    vector<u8> liveKeys = m_speccy.getKeyboardState();
+    u8 liveKempston = m_speccy.getKempstonState();
+    restore(index);
+    dropFuture(liveKeys, liveKempston);
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,116 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Rewind
+//
+// Keeps a history of the machine so that it can be run backwards.  Every few frames the machine's state is saved along
+// with the memory that changed since the last save, XORed against it and run-length encoded.  The changes are kept in a
+// fixed-size ring buffer, and the oldest saves are dropped when it fills.  Key presses and joystick changes are
+// recorded as they happen.
+//
+// Going back to a save is instant.  Going back to any other instruction restores the save before it and runs the
+// machine forward again one instruction at a time, feeding in the recorded input, until it gets there.  The
+// emulation is deterministic, so it ends up exactly where it was.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <emulator/spectrum.h>
+#include <types.h>
+
+#include <deque>
+#include <vector>
+
+class Rewind
+{
+public:
+    static const size_t kDefaultBufferSize = 64 * 1024 * 1024;
+    static const int kDefaultInterval = 25;
+
+    Rewind(Spectrum& speccy, size_t bufferSize = kDefaultBufferSize, int interval = kDefaultInterval);
+
+    // Forget the history, such as when a new program has been loaded.
+    void clear();
+
+    // Call before every update of the machine.  Saves the state if it is time to, and records any change in the input.
+    void update();
+
+    // Go back to the instruction before the current one.  Returns false if there is no history to go back into.
+    bool stepBack();
+
+    // Go back to the latest save that is at least numFrames old, or the oldest one.  Nothing is replayed.
+    bool rewindFrames(int numFrames);
+
+    // Go back to the last instruction boundary at or before time (see getTime()).
+    bool seek(i64 time);
+
+    // T-states since the machine was reset.
+    i64 getTime() const;
+
+    // The earliest time the machine can go back to.
+    i64 getOldestTime() const;
+
+    size_t getNumSnapshots() const { return m_snapshots.size(); }
+
+    // Bytes used in the ring buffer for memory changes.
+    size_t getMemoryUsed() const;
+
+private:
+    struct Snapshot
+    {
+        Spectrum::State     state;
+        i64                 time;
+        size_t              offset;         // Where its memory changes are in the ring
+        size_t              size;
+        u64                 firstEvent;     // Index of the first input event after it was taken
+    };
+
+    struct Event
+    {
+        i64                 time;
+        u8                  keys[8];
+        u8                  kempstonState;
+    };
+
+    void takeSnapshot();
+    void recordInput();
+    size_t allocate(size_t size);
+    void dropOldest();
+
+    // Put the machine back to how it was at a snapshot and throw away the newer ones.
+    void restore(size_t index);
+
+    // Run forward from a restored snapshot, feeding in the recorded input, until time is reached or passed.  Returns
+    // the last instruction boundary before time.
+    i64 replay(size_t index, i64 time);
+    void dropFuture(vector<u8>& liveKeys, u8 liveKempston);
+
+    // The latest snapshot taken before or at time, or -1 if there isn't one.
+    int findSnapshot(i64 time, bool before) const;
+
+    // Memory changes are XORs against the previous snapshot, compressed as runs of zeros and literal bytes.
+    void encodeChunk(const u8* data, const u8* previous, u32 chunk);
+    void applyChanges(const Snapshot& snapshot, vector<u8>& memory) const;
+
+    static const size_t kChunkSize = 1024;
+    static const size_t kMaxSnapshots = 4096;
+
+private:
+    Spectrum&           m_speccy;
+    int                 m_interval;
+
+    vector<u8>          m_buffer;           // Ring of memory changes
+    size_t              m_head;             // Where the next changes will go
+    deque<Snapshot>     m_snapshots;
+    vector<u8>          m_latest;           // Memory as it was at the newest snapshot
+    vector<u8>          m_encoded;          // Changes being built for the next snapshot
+    vector<u8>          m_memory;           // Scratch for rebuilding older memory
+    i64                 m_lastFrame;        // Frame the newest snapshot was taken in
+
+    deque<Event>        m_events;
+    u64                 m_eventBase;        // Index of m_events.front() since the history started
+    u8                  m_lastKeys[8];
+    u8                  m_lastKempston;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
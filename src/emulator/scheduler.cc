@@ -0,0 +1,102 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Scheduler implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/scheduler.h>
+
+#include <algorithm>
+#include <cassert>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Events
+//----------------------------------------------------------------------------------------------------------------------
+
+Scheduler::EventId Scheduler::add(Handler handler)
+{
+    m_events.push_back({ handler, kNever, 0, false });
+    return EventId(m_events.size() - 1);
+}
+
+void Scheduler::schedule(EventId id, TState tState)
+{
+    assert(id >= 0 && id < (EventId)m_events.size());
+    Event& ev = m_events[id];
+    ++ev.generation;
+    ev.tState = tState;
+    ev.scheduled = true;
+    push(id);
+    trim();
+}
+
+void Scheduler::cancel(EventId id)
+{
+    assert(id >= 0 && id < (EventId)m_events.size());
+    Event& ev = m_events[id];
+    ++ev.generation;
+    ev.tState = kNever;
+    ev.scheduled = false;
+    trim();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------------------------------------------
+
+void Scheduler::dispatch(TState tState)
+{
+    while (!m_heap.empty() && m_heap.front().tState <= tState)
+    {
+        EventId id = m_heap.front().id;
+        pop();
+
+        // The handler may schedule this or any other event, so the heap must be tidy before calling it.
+        Event& ev = m_events[id];
+        ev.scheduled = false;
+        ev.tState = kNever;
+        ++ev.generation;
+        trim();
+        ev.handler();
+    }
+}
+
+void Scheduler::rebase(TState tStates)
+{
+    // Shifting every deadline by the same amount keeps the heap ordered.
+    for (auto& entry : m_heap)
+    {
+        entry.tState -= tStates;
+    }
+    for (auto& ev : m_events)
+    {
+        if (ev.scheduled) ev.tState -= tStates;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Heap management
+//----------------------------------------------------------------------------------------------------------------------
+
+void Scheduler::push(EventId id)
+{
+    const Event& ev = m_events[id];
+    m_heap.push_back({ ev.tState, id, ev.generation });
+    push_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+}
+
+void Scheduler::pop()
+{
+    pop_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+    m_heap.pop_back();
+}
+
+void Scheduler::trim()
+{
+    // Remove rescheduled or cancelled entries from the top so that next() is always a live deadline.
+    while (!m_heap.empty() && m_heap.front().generation != m_events[m_heap.front().id].generation)
+    {
+        pop();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
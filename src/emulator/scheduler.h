@@ -0,0 +1,76 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Timed event scheduler
+//
+// Anything outside the CPU that needs to do something at a particular t-state (the frame interrupt, a tape edge...)
+// registers an event here and schedules its next deadline.  The emulation loop runs the CPU up to next() and then
+// calls dispatch() to run whatever handlers are due, which are free to schedule themselves again.
+//
+// Each event has at most one pending deadline.  Scheduling it again replaces the old one.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <types.h>
+
+#include <functional>
+#include <limits>
+
+class Scheduler
+{
+public:
+    using EventId = int;
+    using Handler = function<void()>;
+
+    static constexpr TState kNever = numeric_limits<TState>::max();
+
+    // Register a new event.  It is not scheduled until schedule() is called.  Handlers must not add events.
+    EventId add(Handler handler);
+
+    // Set the t-state at which the event's handler will be called, replacing any earlier deadline.
+    void schedule(EventId id, TState tState);
+
+    // Stop the event from being called.
+    void cancel(EventId id);
+
+    bool isScheduled(EventId id) const { return m_events[id].scheduled; }
+    TState getTime(EventId id) const { return m_events[id].tState; }
+
+    // The earliest deadline, or kNever if nothing is scheduled.
+    TState next() const { return m_heap.empty() ? kNever : m_heap.front().tState; }
+
+    // Call the handlers of all events due at or before tState, earliest first.
+    void dispatch(TState tState);
+
+    // Move all deadlines back by tStates.  Used when the t-state counter wraps at the end of a frame.
+    void rebase(TState tStates);
+
+private:
+    void push(EventId id);
+    void pop();
+    void trim();
+
+private:
+    struct Event
+    {
+        Handler     handler;
+        TState      tState;
+        u32         generation;     // Bumped each time the event is (re)scheduled or cancelled
+        bool        scheduled;
+    };
+
+    struct Entry
+    {
+        TState      tState;
+        EventId     id;
+        u32         generation;     // Entry is stale if this doesn't match the event's generation
+
+        bool operator > (const Entry& e) const { return tState > e.tState || (tState == e.tState && id > e.id); }
+    };
+
+    vector<Event>   m_events;
+    vector<Entry>   m_heap;         // Min-heap ordered by t-state, stale entries are removed lazily
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
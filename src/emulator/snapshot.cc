@@ -0,0 +1,251 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Snapshot loading and saving
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/nxfile.h>
+#include <emulator/snapshot.h>
+#include <emulator/spectrum.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// .sna & .z80 files
+//----------------------------------------------------------------------------------------------------------------------
+
+bool loadSnaSnapshot(Spectrum& speccy, const vector<u8>& buffer)
+{
+    const u8* data = buffer.data();
+    i64 size = (i64)buffer.size();
+    auto& z80 = speccy.getZ80();
+    
+    if (size != 49179) return false;
+    
+    z80.I() = BYTE_OF(data, 0);
+    z80.HL_() = WORD_OF(data, 1);
+    z80.DE_() = WORD_OF(data, 3);
+    z80.BC_() = WORD_OF(data, 5);
+    z80.AF_() = WORD_OF(data, 7);
+    z80.HL() = WORD_OF(data, 9);
+    z80.DE() = WORD_OF(data, 11);
+    z80.BC() = WORD_OF(data, 13);
+    z80.IY() = WORD_OF(data, 15);
+    z80.IX() = WORD_OF(data, 17);
+    z80.IFF1() = (BYTE_OF(data, 19) & 0x01) != 0;
+    z80.IFF2() = (BYTE_OF(data, 19) & 0x04) != 0;
+    z80.R() = BYTE_OF(data, 20);
+    z80.AF() = WORD_OF(data, 21);
+    z80.SP() = WORD_OF(data, 23);
+    z80.IM() = BYTE_OF(data, 25);
+    speccy.setBorderColour(BYTE_OF(data, 26));
+    speccy.load(0x4000, data + 27, 0xc000);
+    
+    TState t = 0;
+    z80.PC() = z80.pop(t);
+    z80.IFF1() = z80.IFF2();
+    speccy.resetTState();
+    
+    return true;
+}
+
+vector<u8> saveSnaSnapshot(Spectrum& speccy)
+{
+    vector<u8> data;
+    data.reserve(49179);
+    auto& z80 = speccy.getZ80();
+
+    // The PC is saved on the stack, which is then put back as it was.
+    TState t = 0;
+    z80.push(z80.PC(), t);
+
+    NxFile::write8(data, z80.I());
+    NxFile::write16(data, z80.HL_());
+    NxFile::write16(data, z80.DE_());
+    NxFile::write16(data, z80.BC_());
+    NxFile::write16(data, z80.AF_());
+    NxFile::write16(data, z80.HL());
+    NxFile::write16(data, z80.DE());
+    NxFile::write16(data, z80.BC());
+    NxFile::write16(data, z80.IY());
+    NxFile::write16(data, z80.IX());
+    NxFile::write8(data, (z80.IFF1() ? 0x01 : 0) | (z80.IFF2() ? 0x04 : 0));
+    NxFile::write8(data, z80.R());
+    NxFile::write16(data, z80.AF());
+    NxFile::write16(data, z80.SP());
+    NxFile::write8(data, (u8)z80.IM());
+    NxFile::write8(data, speccy.getBorderColour());
+    for (u16 a = 0x4000; a; ++a)
+    {
+        data.emplace_back(speccy.peek(a));
+    }
+
+    z80.pop(t);
+
+    return data;
+}
+
+bool loadZ80Snapshot(Spectrum& speccy, const vector<u8>& buffer)
+{
+    const u8* data = buffer.data();
+    Z80& z80 = speccy.getZ80();
+
+    // Only support version 1.0 Z80 files now
+    if (buffer.size() < 30) return false;
+    int version = 1;
+    if (WORD_OF(data, 6) == 0)
+    {
+        if (WORD_OF(data, 30) == 23) version = 2;
+        else version = 3;
+    }
+
+    if (version > 1)
+    {
+        // Check to see if we're only 48K
+        u8 hardware = BYTE_OF(data, 34);
+        if (version == 2 && (hardware != 0 && hardware == 1)) return false;
+        if (version == 3 && (hardware != 0 || hardware == 1 || hardware == 3)) return false;
+    }
+
+    z80.A() = BYTE_OF(data, 0);
+    z80.F() = BYTE_OF(data, 1);
+    z80.BC() = WORD_OF(data, 2);
+    z80.HL() = WORD_OF(data, 4);
+    z80.PC() = WORD_OF(data, 6);
+    z80.SP() = WORD_OF(data, 8);
+    z80.I() = BYTE_OF(data, 10);
+    z80.R() = (BYTE_OF(data, 11) & 0x7f) | ((BYTE_OF(data, 12) & 0x01) << 7);
+    u8 b12 = BYTE_OF(data, 12);
+    if (b12 == 255) b12 = 1;
+    speccy.setBorderColour((b12 & 0x0e) >> 1);
+    bool compressed = (b12 & 0x20) != 0;
+    z80.DE() = WORD_OF(data, 13);
+    z80.BC_() = WORD_OF(data, 15);
+    z80.DE_() = WORD_OF(data, 17);
+    z80.HL_() = WORD_OF(data, 19);
+    u8 a_ = BYTE_OF(data, 21);
+    u8 f_ = BYTE_OF(data, 22);
+    z80.AF_() = (u16(a_) << 8) + u16(f_);
+    z80.IY() = WORD_OF(data, 23);
+    z80.IX() = WORD_OF(data, 25);
+    z80.IFF1() = BYTE_OF(data, 27) ? 1 : 0;
+    z80.IFF2() = BYTE_OF(data, 28) ? 1 : 0;
+    z80.IM() = int(BYTE_OF(data, 29) & 0x03);
+
+#define CHECK_BUFFER() do { if (size_t(mem - data) >= buffer.size()) { NX_BREAK(); return false; } } while(0)
+
+    if (version == 1)
+    {
+        if (compressed)
+        {
+            const u8* mem = data + 30;
+            u16 a = 0x4000;
+            while (1)
+            {
+                // Check we haven't run out of bytes.
+                CHECK_BUFFER();
+                u8 b = *mem++;
+                if (b == 0x00)
+                {
+                    // Not enough room for 4 terminating bytes
+                    if (size_t(mem + 3 - data) > buffer.size())
+                    {
+                        NX_BREAK();
+                        return false;
+                    }
+
+                    if (mem[0] == 0xed && mem[1] == 0xed && mem[2] == 0x00)
+                    {
+                        // Terminator.
+                        break;
+                    }
+
+                    speccy.poke(a++, 0);
+                }
+                else if (b == 0xed)
+                {
+                    CHECK_BUFFER();
+                    b = *mem++;
+                    if (b != 0xed)
+                    {
+                        speccy.poke(a++, 0xed);
+                        speccy.poke(a++, b);
+                    }
+                    else
+                    {
+                        // Two EDs - compression.
+                        CHECK_BUFFER();
+                        u8 count = *mem++;
+                        CHECK_BUFFER();
+                        b = *mem++;
+
+                        for (u8 i = 0; i < count; ++i)
+                        {
+                            speccy.poke(a++, b);
+                        }
+                    }
+                }
+                else
+                {
+                    speccy.poke(a++, b);
+                }
+            }
+        }
+        else
+        {
+            if (buffer.size() != (0xc000 + 30)) return false;
+
+            speccy.load(0x4000, data + 30, 0xc000);
+        }
+    }
+    else
+    {
+        // Version 2 & 3 files
+        const u8* mem = data + 32 + WORD_OF(data, 30);
+        z80.PC() = WORD_OF(data, 32);
+        if (version == 3)
+        {
+            speccy.setTState(TState(WORD_OF(data, 55)) + (TState(BYTE_OF(data, 57)) << 16));
+        }
+
+        u16 pages[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x8000, 0xc000, 0x0000, 0x0000, 0x4000, 0x0000, 0x0000, 0x0000 };
+        for (int i = 0; i < 3; ++i)
+        {
+            u16 a = pages[BYTE_OF(mem,2)];
+            u16 len = WORD_OF(mem, 0);
+            mem += 3;
+            bool compressed = (len != 0xffff);
+            if (!compressed) len = 0x4000;
+
+            int idx = 0;
+            while (idx < len)
+            {
+                u8 b = mem[idx++];
+                if (b == 0xed)
+                {
+                    b = mem[idx++];
+                    if (b == 0xed)
+                    {
+                        u8 count = mem[idx++];
+                        b = mem[idx++];
+                        for (int ii = 0; ii < count; ++ii)
+                        {
+                            speccy.poke(a++, b);
+                        }
+                    }
+                    else
+                    {
+                        speccy.poke(a++, 0xed);
+                        speccy.poke(a++, b);
+                    }
+                }
+                else
+                {
+                    speccy.poke(a++, b);
+                }
+            }
+            mem += len;
+        }
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
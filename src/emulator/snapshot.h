@@ -0,0 +1,24 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Snapshot loading and saving
+// Restores a Spectrum from the contents of a .sna or .z80 file, or saves one as a .sna file.  Shared by the emulator UI
+// and the headless tools.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <types.h>
+
+#include <vector>
+
+class Spectrum;
+
+// Both return false if the data isn't a snapshot they can load.  The machine may be partially written to in that case.
+bool loadSnaSnapshot(Spectrum& speccy, const vector<u8>& buffer);
+bool loadZ80Snapshot(Spectrum& speccy, const vector<u8>& buffer);
+
+// Returns the contents of a .sna file for the machine's current state.
+vector<u8> saveSnaSnapshot(Spectrum& speccy);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -18,6 +18,10 @@ Spectrum::Spectrum(function<void()> frameFunc)
     //--- Clock state ----------------------------------------------------
     : m_model(Model::ZX48)
     , m_tState(0)
+    , m_frameEvent(0)
+    , m_tapeEvent(0)
+    , m_frameDone(false)
+    , m_frameCount(0)
 
     //--- Video state ----------------------------------------------------
     , m_image(new u32[kWindowWidth * kWindowHeight])
@@ -25,16 +29,35 @@ Spectrum::Spectrum(function<void()> frameFunc)
     , m_videoWrite(0)
     , m_startTState(0)
     , m_drawTState(0)
+    , m_dirtyFirst(0)
+    , m_dirtyLast(kWindowHeight - 1)
+    , m_videoVersion(0)
 
     //--- Audio state ----------------------------------------------------
-    , m_audio(69888, frameFunc)
+    , m_audio(frameFunc)
     , m_tape(nullptr)
+    , m_tapeTState(0)
 
     //--- Memory state ---------------------------------------------------
     , m_romWritable(true)
+    , m_decodeCacheEnabled(true)
+    , m_decodePages()
+    , m_blockCacheEnabled(true)
+    , m_blocksAllowed(false)
+    , m_blockPages()
+    , m_lastCodeVersion(0)
+    , m_trackWrites(false)
+    , m_writes()
 
     //--- CPU state ------------------------------------------------------
     , m_z80(*this)
+    , m_skipHalt(true)
+    , m_blockLimit(0)
+    , m_bulkRepeat(true)
+    , m_profiling(false)
+    , m_profiler()
+    , m_callTracking(false)
+    , m_callStack()
 
     //--- ULA state ------------------------------------------------------
     , m_borderColour(7)
@@ -47,12 +70,15 @@ Spectrum::Spectrum(function<void()> frameFunc)
     , m_shadowScreen(false)
 
     //--- Breakpoints state ----------------------------------------------
+    , m_pageWatchAttrs()
     , m_break(false)
 
     //--- Kempston -------------------------------------------------------
     , m_kempstonJoystick(false)
     , m_kempstonState(0)
 {
+    initEvents();
+    updateWatchpoints();
     reset(Model::ZX48);
 }
 
@@ -69,12 +95,6 @@ Spectrum::~Spectrum()
 // State
 //----------------------------------------------------------------------------------------------------------------------
 
-sf::Sprite& Spectrum::getVideoSprite()
-{
-    m_videoTexture.update((const sf::Uint8 *)m_image);
-    return m_videoSprite;
-}
-
 void Spectrum::setKeyboardState(vector<u8> &rows)
 {
     m_keys = rows;
@@ -88,6 +108,7 @@ void Spectrum::setBorderColour(u8 borderColour)
 void Spectrum::setRomWriteState(bool writable)
 {
     m_romWritable = writable;
+    updateMemoryMap();
 }
 
 vector<u32> Spectrum::findSequence(vector<u8> seq)
@@ -183,6 +204,28 @@ string Spectrum::addressName(u32 address, bool moreInfo)
     return s;
 }
 
+string Spectrum::physicalAddressName(u32 physAddress)
+{
+    if (m_model == Model::ZX48)
+    {
+        return stringFormat("${0}", hexWord(u16(physAddress)));
+    }
+
+    int bank = int(physAddress / getBankSize());
+    u16 offset = u16(physAddress % getBankSize());
+    string s = stringFormat("{0}:${1}", m_bankNames[bank], hexWord(offset));
+
+    for (int i = 0; i < getNumSlots(); ++i)
+    {
+        if (m_slots[i] == bank)
+        {
+            s += stringFormat(" (${0})", hexWord(u16(offset + (i * getBankSize()))));
+        }
+    }
+
+    return s;
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Overrides
 //----------------------------------------------------------------------------------------------------------------------
@@ -194,56 +237,197 @@ void Spectrum::reset(Model model)
     initMemory();
     initVideo();
     initIo();
+    updateMemoryMap();      // The screen being displayed depends on the I/O state
     m_z80.restart();
     m_tState = 0;
+    m_tapeTState = 0;
+    m_frameCount = 0;
     m_audio.start();
+    m_audio.seek(0, m_speaker, m_tapeEar);
+    m_scheduler.schedule(m_frameEvent, getFrameTime());
 }
 
 //----------------------------------------------------------------------------------------------------------------------
 // Frame emulation
 //----------------------------------------------------------------------------------------------------------------------
 
-void Spectrum::updateTape(TState numTStates)
+void Spectrum::updateTape()
 {
     if (m_tape)
     {
-        m_tapeEar = m_tape->play(numTStates);
+        m_tapeEar = m_tape->play(m_tState - m_tapeTState);
     }
+    m_tapeTState = m_tState;
+}
+
+void Spectrum::scheduleTape()
+{
+    if (m_tape && m_tape->isPlaying())
+    {
+        // If the tape has only just been started, its output changes after the next instruction.
+        if (!m_scheduler.isScheduled(m_tapeEvent))
+        {
+            m_tapeTState = m_tState;
+            m_scheduler.schedule(m_tapeEvent, m_tState + 1);
+        }
+    }
+    else if (m_tape && m_tapeEar)
+    {
+        // The tape has been stopped but the EAR bit is still set.  It will be cleared after the next instruction.
+        m_tapeTState = m_tState;
+        m_scheduler.schedule(m_tapeEvent, m_tState + 1);
+    }
+    else
+    {
+        m_scheduler.cancel(m_tapeEvent);
+    }
+}
+
+bool Spectrum::canSkipHalt()
+{
+    // A halted CPU fetches the HALT every 4 t-states.  That can only be done in bulk if the fetches are never delayed
+    // by contention.
+    return m_skipHalt && !isContended(m_z80.PC());
+}
+
+bool Spectrum::runSlice(bool single)
+{
+    // The CPU runs until the next event is due, with the video only brought up to date when an instruction is about to
+    // change what it reads (see syncVideo).  The audio is only told when a level changes.  Block instructions get the
+    // same limit.
+    TState until = m_scheduler.next();
+    m_blockLimit = m_bulkRepeat && !isTrackingCalls() ? until : 0;
+
+    StopConditions stop = { true, m_skipHalt, single };
+    bool hit = isTrackingCalls() ? runTracked(until, stop) : m_z80.run(m_tState, until, stop);
+    if (!hit && m_z80.isHalted() && m_tState < until && canSkipHalt())
+    {
+        // Nothing will happen until the next event.  PC cannot change and the HALT has already been checked for
+        // breakpoints, so jump straight there.
+        TState start = m_tState;
+        m_z80.skipHalt(m_tState, until);
+        if (m_profiling) m_profiler.addHalt(physicalAddress(m_z80.PC()), m_tState - start);
+        if (isTrackingCalls()) m_callStack.addTime(m_tState - start);
+    }
+
+    m_scheduler.dispatch(m_tState);
+    if (m_frameDone) updateVideo(m_tState);
+    m_blockLimit = 0;
+
+    if (hit) m_break = false;
+    return hit;
+}
+
+bool Spectrum::runTracked(TState until, StopConditions stop)
+{
+    // Run one instruction at a time, as Z80Core::run would, so that each one can be counted and its calls and returns
+    // followed.
+    for (;;)
+    {
+        u16 pc = m_z80.PC();
+        u16 sp = m_z80.SP();
+        u8 bytes[4] = { peek(pc), peek(pc + 1), peek(pc + 2), peek(pc + 3) };
+        bool interrupt = m_z80.isInterruptDue();
+        TState start = m_tState;
+
+        bool hit = m_z80.run(m_tState, until, { stop.breakpoints, stop.halt, true });
+        TState tStates = m_tState - start;
+        if (m_profiling)
+        {
+            if (interrupt)
+            {
+                m_profiler.addInterrupt(tStates);
+            }
+            else
+            {
+                m_profiler.addInstruction(physicalAddress(pc), bytes, tStates);
+            }
+        }
+
+        u16 newPC = m_z80.PC();
+        u16 newSP = m_z80.SP();
+        m_callStack.step(bytes, sp, interrupt, newPC, physicalAddress(newPC), newSP,
+            u16(peek(newSP) | (peek(newSP + 1) << 8)), tStates);
+
+        if (hit) return true;
+        if (stop.single || m_tState >= until || (stop.halt && m_z80.isHalted())) return false;
+    }
+}
+
+void Spectrum::setProfiling(bool enabled)
+{
+    // Calls made while nothing was following them can't be trusted.
+    if (enabled && !isTrackingCalls()) m_callStack.clearFrames();
+
+    // The address tables are only allocated once there is something to count.
+    if (enabled && m_profiler.getMemorySize() != m_ram.size()) m_profiler.reset(m_ram.size());
+    m_profiling = enabled;
+}
+
+void Spectrum::clearProfiler()
+{
+    m_profiler.reset(m_profiling ? m_ram.size() : 0);
+    m_callStack.clearCounts();
+}
+
+void Spectrum::setCallTracking(bool enabled)
+{
+    if (enabled && !isTrackingCalls()) m_callStack.clearFrames();
+    m_callTracking = enabled;
+}
+
+bool Spectrum::canRunBlocks() const
+{
+    return !isTrackingCalls() && m_userBreakpoints.empty() && m_tempBreakpoints.empty() && m_dataBreakpoints.empty();
+}
+
+void Spectrum::endFrame()
+{
+    TState frameTime = getFrameTime();
+    ++m_frameCount;
+    m_tState -= frameTime;
+    m_tapeTState -= frameTime;
+    m_scheduler.rebase(frameTime);
+    m_scheduler.schedule(m_frameEvent, frameTime);
+    m_audio.endFrame(frameTime);
+    m_z80.interrupt();
 }
 
 bool Spectrum::update(RunMode runMode, bool& breakpointHit)
 {
-    bool result = false;
     breakpointHit = false;
-    TState frameTime = getFrameTime();
-    TState startTState;
+    m_frameDone = false;
+
+    // The tape may have been started, stopped or changed since the last update.
+    scheduleTape();
 
     switch (runMode)
     {
     case RunMode::Normal:
-        while (m_tState < frameTime)
+        m_blocksAllowed = canRunBlocks();
+        while (!m_frameDone)
         {
-            startTState = m_tState;
-            m_z80.step(m_tState);
-            updateVideo();
-            updateTape(m_tState - startTState);
-            m_audio.updateBeeper(m_tState, m_speaker, m_tapeEar ? 1 : 0);
-            //m_audio.updateBeeper(m_tState, m_tapeEar ? 1 : 0);
-            if ((runMode == RunMode::Normal) && (shouldBreak(m_z80.PC()) || m_break))
+            if (runSlice(false))
             {
                 breakpointHit = true;
-                m_break = false;
                 break;
             }
         }
+        m_blocksAllowed = false;
         break;
 
     case RunMode::StepIn:
     case RunMode::StepOver:
-        startTState = m_tState;
-        m_z80.step(m_tState);
-        updateVideo();
-        updateTape(m_tState - startTState);
+        if (isTrackingCalls())
+        {
+            runTracked(0, { false, false, false });
+        }
+        else
+        {
+            m_z80.run(m_tState, 0, { false, false, false });
+        }
+        m_scheduler.dispatch(m_tState);
+        updateVideo(m_tState);
         break;
 
     case RunMode::Stopped:
@@ -251,14 +435,139 @@ bool Spectrum::update(RunMode runMode, bool& breakpointHit)
         break;
     }
 
-    if (m_tState >= frameTime)
+    if (m_frameDone) endFrame();
+    return m_frameDone;
+}
+
+bool Spectrum::updateSlice(bool& breakpointHit)
+{
+    m_frameDone = false;
+
+    // Rescheduling the tape only changes anything when it has been started or stopped from outside, so doing it every
+    // slice gives the same result as doing it every frame.
+    scheduleTape();
+
+    m_blocksAllowed = canRunBlocks();
+    breakpointHit = runSlice(true);
+    m_blocksAllowed = false;
+
+    if (m_frameDone) endFrame();
+    return m_frameDone;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Machine state
+//----------------------------------------------------------------------------------------------------------------------
+
+Spectrum::State Spectrum::getState()
+{
+    State state;
+    state.z80 = m_z80.getState();
+    state.frameCount = m_frameCount;
+    state.tState = m_tState;
+    state.frameEvent = m_scheduler.getTime(m_frameEvent);
+    state.tapeEvent = m_scheduler.isScheduled(m_tapeEvent) ? m_scheduler.getTime(m_tapeEvent) : Scheduler::kNever;
+    state.tapeTState = m_tapeTState;
+    state.tape = m_tape;
+    state.tapePosition = m_tape ? m_tape->getPosition() : Tape::Position{};
+
+    assert(m_slots.size() <= sizeof(state.slots));
+    fill(begin(state.slots), end(state.slots), 0);
+    copy(m_slots.begin(), m_slots.end(), state.slots);
+    state.pagingDisabled = m_pagingDisabled;
+    state.shadowScreen = m_shadowScreen;
+
+    state.borderColour = m_borderColour;
+    state.speaker = m_speaker;
+    state.tapeEar = m_tapeEar;
+    copy(m_keys.begin(), m_keys.end(), state.keys);
+    state.kempstonState = m_kempstonState;
+
+    state.frameCounter = m_frameCounter;
+    state.videoWrite = m_videoWrite;
+    state.drawTState = m_drawTState;
+    return state;
+}
+
+void Spectrum::setState(const State& state)
+{
+    m_z80.setState(state.z80);
+    m_frameCount = state.frameCount;
+    m_tState = state.tState;
+    m_scheduler.schedule(m_frameEvent, state.frameEvent);
+    if (state.tapeEvent == Scheduler::kNever)
     {
-        m_tState -= frameTime;
-        m_z80.interrupt();
-        result = true;
+        m_scheduler.cancel(m_tapeEvent);
     }
+    else
+    {
+        m_scheduler.schedule(m_tapeEvent, state.tapeEvent);
+    }
+    m_tapeTState = state.tapeTState;
+    if (m_tape && m_tape == state.tape) m_tape->setPosition(state.tapePosition);
+
+    copy(state.slots, state.slots + m_slots.size(), m_slots.begin());
+    m_pagingDisabled = state.pagingDisabled;
+    m_shadowScreen = state.shadowScreen;
+    updateMemoryMap();
+
+    m_borderColour = state.borderColour;
+    m_speaker = state.speaker;
+    m_tapeEar = state.tapeEar;
+
+    // The audio only produces output, so it just carries on from the new time.
+    m_audio.seek(m_tState, m_speaker, m_tapeEar);
+    m_keys.assign(begin(state.keys), end(state.keys));
+    m_kempstonState = state.kempstonState;
+
+    m_frameCounter = state.frameCounter;
+    m_videoWrite = state.videoWrite;
+    m_drawTState = state.drawTState;
+
+    m_frameDone = false;
+    m_break = false;
+    m_callStack.clearFrames();
+}
 
-    return result;
+void Spectrum::setMemory(u32 physAddress, const u8* data, u32 size)
+{
+    assert(physAddress + size <= m_ram.size());
+    copy(data, data + size, m_ram.begin() + physAddress);
+    invalidateDecode(physAddress, size);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Events
+//----------------------------------------------------------------------------------------------------------------------
+
+void Spectrum::initEvents()
+{
+    m_frameEvent = m_scheduler.add([this] { onFrameEnd(); });
+    m_tapeEvent = m_scheduler.add([this] { onTapeEdge(); });
+}
+
+void Spectrum::onFrameEnd()
+{
+    // The wrap and interrupt are done by update() once everything else due has been dealt with and the video has
+    // caught up.
+    m_frameDone = true;
+}
+
+void Spectrum::onTapeEdge()
+{
+    // The EAR bit changes at the end of this instruction.  Everything up to its start heard the old value.
+    updateTape();
+    updateAudio(m_z80.getInstructionStart());
+
+    if (m_tape && m_tape->isPlaying())
+    {
+        m_scheduler.schedule(m_tapeEvent, m_tapeTState + m_tape->nextEdge());
+    }
+    else if (m_tapeEar)
+    {
+        // The tape has just finished.  Stopped tapes output 0.
+        m_scheduler.schedule(m_tapeEvent, m_tState + 1);
+    }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -273,7 +582,7 @@ extern const u8 gRomPlus2_1[16384];
 
 void Spectrum::initMemory()
 {
-    setRomWriteState(true);
+    m_romWritable = true;
 
     switch (m_model)
     {
@@ -330,6 +639,15 @@ void Spectrum::initMemory()
         assert(0);
         break;
     }
+    m_decodeCache.assign(m_ram.size(), 0);
+    m_decodeUsed.assign(m_ram.size() >> kPageShift, false);
+    m_profiler.reset(m_profiling ? m_ram.size() : 0);
+    m_callStack.reset();
+    m_blockSlots.assign(m_ram.size(), 0);
+    m_codeBits.assign(m_ram.size() / 8, 0);
+    m_codeVersions.resize(m_ram.size() >> kCodeLineShift);
+    newCodeVersions(0, (u32)m_codeVersions.size());
+    updateMemoryMap();
     m_contention.resize(70930);
 
     // Build contention table
@@ -392,109 +710,174 @@ void Spectrum::initMemory()
         assert(0);
     }
     setRomWriteState(false);
+    initBreakpoints();
 }
 
-u8 Spectrum::peek(u16 address)
+u8 Spectrum::bankPeek(u16 bank, u16 address) const
 {
-    return m_ram[m_slots[address / getBankSize()] * getBankSize() + (address % getBankSize())];
+    assert(bank < getNumBanks());
+    assert(address < getBankSize());
+    return m_ram[bank * getBankSize() + (address % getBankSize())];
+}
+
+void Spectrum::bankPoke(u16 bank, u16 address, u8 byte)
+{
+    assert(bank < getNumBanks());
+    assert(address < getBankSize());
+    u32 physAddress = bank * getBankSize() + (address % getBankSize());
+    m_ram[physAddress] = byte;
+    invalidateDecode(physAddress, 1);
 }
 
-u8 Spectrum::peek(u16 address, TState& t)
+void Spectrum::load(u16 address, const void* buffer, i64 size)
 {
-    contend(address, 3, 1, t);
-    return peek(address);
+    u32 realAddress = m_slots[address/getBankSize()] * getBankSize() + (address % getBankSize());
+    copy((u8*)buffer, (u8*)buffer + size, m_ram.begin() + realAddress);
+    invalidateDecode(realAddress, (u32)size);
 }
 
-u16 Spectrum::peek16(u16 address, TState& t)
+void Spectrum::load(u16 address, const vector<u8>& buffer)
 {
-    return peek(address, t) + 256 * peek(address + 1, t);
+    load(address, buffer.data(), buffer.size());
 }
 
-void Spectrum::poke(u16 address, u8 x)
+void Spectrum::bank(int slot, int bank)
 {
-    for (const auto& br : m_dataBreakpoints)
-    {
-        if (address >= br.address && address < (br.address + br.len))
-        {
-            m_break = true;
-        }
-    }
+    assert(slot >= 0 && slot < getNumSlots());
+    assert(bank >= 0 && bank < (m_ram.size() / getBankSize()));
 
-    if (m_romWritable || address >= getRomSize())
-    {
-        m_ram[m_slots[address / getBankSize()] * getBankSize() + (address % getBankSize())] = x;
-    }
+    m_slots[slot] = bank;
+    updateMemoryMap();
 }
 
-u8 Spectrum::bankPeek(u16 bank, u16 address) const
+void Spectrum::updateMemoryMap()
 {
-    assert(bank < getNumBanks());
-    assert(address < getBankSize());
-    return m_ram[bank * getBankSize() + (address % getBankSize())];
+    int pagesPerSlot = getBankSize() >> kPageShift;
+
+    for (int page = 0; page < kNumPages; ++page)
+    {
+        int bank = m_slots[page / pagesPerSlot];
+        u8 attrs = 0;
+
+        if (!m_romWritable && isRomBank(bank)) attrs |= kPageReadOnly;
+        if (isContendedBank(bank)) attrs |= kPageContended;
+
+        u32 physAddress = bank * getBankSize() + (page % pagesPerSlot) * (kPageMask + 1);
+        if (m_decodeUsed[physAddress >> kPageShift]) attrs |= kPageExecuted;
+
+        m_pages[page] = m_ram.data() + physAddress;
+        m_pageAttrs[page] = attrs | m_pageWatchAttrs[page] | (m_trackWrites ? kPageTrackWrites : 0);
+        m_decodePages[page] = m_decodeCacheEnabled ? m_decodeCache.data() + physAddress : nullptr;
+        bool blocks = m_blockCacheEnabled && !(attrs & kPageContended);
+        m_blockPages[page] = blocks ? m_blockSlots.data() + physAddress : nullptr;
+        if (physAddress == u32(getVideoBank() * getBankSize())) m_pageAttrs[page] |= kPageVideo;
+    }
 }
 
-void Spectrum::bankPoke(u16 bank, u16 address, u8 byte)
+//----------------------------------------------------------------------------------------------------------------------
+// Predecode cache
+//----------------------------------------------------------------------------------------------------------------------
+
+void Spectrum::setDecodeCache(bool enabled)
 {
-    assert(bank < getNumBanks());
-    assert(address < getBankSize());
-    m_ram[bank * getBankSize() + (address % getBankSize())] = byte;
+    m_decodeCacheEnabled = enabled;
+    invalidateDecode(0, (u32)m_ram.size());
+    updateMemoryMap();
 }
 
-void Spectrum::poke(u16 address, u8 x, TState& t)
+void Spectrum::setBlockCache(bool enabled)
 {
-    contend(address, 3, 1, t);
-    poke(address, x);
+    m_blockCacheEnabled = enabled;
+    updateMemoryMap();
 }
 
-void Spectrum::poke16(u16 address, u16 w, TState& t)
+void Spectrum::setWriteTracking(bool enabled)
 {
-    Reg r(w);
-    poke(address, r.l, t);
-    poke(address + 1, r.h, t);
+    m_trackWrites = enabled;
+    m_writes.clear();
+    updateMemoryMap();
 }
 
-void Spectrum::load(u16 address, const void* buffer, i64 size)
+void Spectrum::markExecuted(u16 address)
 {
-    u32 realAddress = m_slots[address/getBankSize()] * getBankSize() + (address % getBankSize());
-    copy((u8*)buffer, (u8*)buffer + size, m_ram.begin() + realAddress);
+    if (m_pageAttrs[address >> kPageShift] & kPageExecuted) return;
+
+    // Every page that maps the same memory has to invalidate on writes too.
+    u32 physAddress = physicalAddress(address) & ~(u32)kPageMask;
+    m_decodeUsed[physAddress >> kPageShift] = true;
+    for (int page = 0; page < kNumPages; ++page)
+    {
+        if (m_pages[page] == m_ram.data() + physAddress) m_pageAttrs[page] |= kPageExecuted;
+    }
 }
 
-void Spectrum::load(u16 address, const vector<u8>& buffer)
+bool Spectrum::canDecode(u16 pc)
 {
-    load(address, buffer.data(), buffer.size());
+    markExecuted(pc);
+
+    // The next page may be paged out from under an instruction that reaches into it.
+    return (pc & kPageMask) <= kPageMask - 3;
 }
 
-bool Spectrum::isContended(u16 addr) const
+int Spectrum::blockSize(u16 pc)
 {
-    return ((addr & 0xc000) == 0x4000);
+    // Blocks stay within their page and the 2 lines covered by their code version.
+    int toPageEnd = (kPageMask + 1) - (pc & kPageMask);
+    int toLineEnd = (2 << kCodeLineShift) - (pc & ((1 << kCodeLineShift) - 1));
+    return min(toPageEnd, toLineEnd);
 }
 
-void Spectrum::contend(u16 address, TState delay, int num, TState& t)
+void Spectrum::addCode(u16 address, int size)
 {
-    if (isContended(address))
+    markExecuted(address);
+    u32 p = physicalAddress(address);
+    for (int i = 0; i < size; ++i, ++p)
     {
-        for (int i = 0; i < num; ++i)
-        {
-            t += contention(t) + delay;
-        }
+        m_codeBits[p >> 3] |= u8(1 << (p & 7));
     }
-    else
+}
+
+void Spectrum::invalidateDecode(u32 physAddress, u32 size)
+{
+    u32 start = physAddress < 3 ? 0 : physAddress - 3;
+    u32 end = min(physAddress + size, (u32)m_decodeCache.size());
+    if (start < end) fill(m_decodeCache.begin() + start, m_decodeCache.begin() + end, 0);
+
+    // Lines before the first one hold versions that cover it.
+    u32 firstLine = physAddress >> kCodeLineShift;
+    newCodeVersions(firstLine ? firstLine - 1 : 0, (end + (1 << kCodeLineShift) - 1) >> kCodeLineShift);
+}
+
+void Spectrum::newCodeVersions(u32 firstLine, u32 endLine)
+{
+    for (u32 line = firstLine; line < endLine; ++line)
     {
-        t += delay * num;
+        m_codeVersions[line] = ++m_lastCodeVersion;
     }
 }
 
-TState Spectrum::contention(TState tStates)
+bool Spectrum::isRomBank(int bank) const
 {
-    return m_contention[tStates];
+    switch (m_model)
+    {
+    case Model::ZX48:       return bank == 0;
+    case Model::ZX128:
+    case Model::ZXPlus2:    return bank >= 8;
+    case Model::ZXNext:     return bank >= 96;
+
+    default:
+        assert(0);
+        return false;
+    }
 }
 
-void Spectrum::bank(int slot, int bank)
+bool Spectrum::isContendedBank(int bank) const
 {
-    assert(slot >= 0 && slot < getNumSlots());
-    assert(bank >= 0 && bank < (m_ram.size() / getBankSize()));
+    if (m_model == Model::ZX48) return bank == 1;
 
-    m_slots[slot] = bank;
+    // The 128K machines contend the odd 16K RAM banks wherever they are paged in.
+    int bank16 = (bank * getBankSize()) / KB(16);
+    return bank16 < 8 && (bank16 & 1) != 0;
 }
 
 int Spectrum::getBank(int slot) const
@@ -640,8 +1023,10 @@ void Spectrum::out(u16 port, u8 x, TState& t)
     //
     if (isUlaPort)
     {
+        if ((x & 7) != m_borderColour) syncVideo();
         m_borderColour = x & 7;
         m_speaker = (x & 0x10) ? 1 : 0;
+        updateAudio(t);
     }
 
     //
@@ -652,6 +1037,8 @@ void Spectrum::out(u16 port, u8 x, TState& t)
     {
         if (!m_pagingDisabled && (port & 0x8002) == 0)
         {
+            // The screen being displayed may change.
+            syncVideo();
             u8 page = x & 0x07;
             u8 shadow = x & 0x08;
             u8 rom = x & 0x10;
@@ -661,6 +1048,7 @@ void Spectrum::out(u16 port, u8 x, TState& t)
             m_shadowScreen = (shadow != 0);
             m_slots[0] = int(rom) ? 9 : 8;
             m_pagingDisabled = (disable != 0);
+            updateMemoryMap();
         }
     }
 
@@ -691,6 +1079,9 @@ void Spectrum::out(u16 port, u8 x, TState& t)
 static const u16 kDoNotDraw = 0xffff;
 static const u16 kBorder = 0xfffe;
 
+// A cell key that nothing is drawn from
+static const u32 kNoCell = 0xffffffff;
+
 // This needs to be called every time the video bank changes
 void Spectrum::recalcVideoMaps()
 {
@@ -788,34 +1179,100 @@ void Spectrum::recalcVideoMaps()
     {
         m_videoMap[t++] = kDoNotDraw;
     }
+
+    // Note when each byte of the screen is read.  The video is drawn a cell (4 t-states) at a time from m_startTState.
+    m_firstRead.assign(0x1b00, u32(getFrameTime()));
+    m_lastRead.assign(0x1b00, 0);
+    for (t = int(m_startTState); t < getFrameTime(); t += 4)
+    {
+        u16 paddr = m_videoMap[t];
+        if (paddr >= kBorder) continue;
+
+        u16 aaddr = ((paddr & 0x1800) >> 3) + (paddr & 0x00ff) + 0x1800;
+        m_firstRead[paddr] = min(m_firstRead[paddr], u32(t));
+        m_lastRead[paddr] = max(m_lastRead[paddr], u32(t));
+        m_firstRead[aaddr] = min(m_firstRead[aaddr], u32(t));
+        m_lastRead[aaddr] = max(m_lastRead[aaddr], u32(t));
+    }
 }
 
 void Spectrum::initVideo()
 {
-    m_videoTexture.create(kWindowWidth, kWindowHeight);
-    m_videoSprite.setTexture(m_videoTexture);
     recalcVideoMaps();
+
+    // Nothing has been drawn from the new maps yet.
+    m_cellKeys.assign(kWindowWidth * kWindowHeight / 8, kNoCell);
+    m_dirtyFirst = 0;
+    m_dirtyLast = kWindowHeight - 1;
 }
 
-void Spectrum::renderVideo()
+int Spectrum::getVideoBank() const
 {
-    TState t = m_tState;
-    m_tState = 69888;
-    updateVideo();
-    m_tState = t;
+    // The 48K has no shadow screen.
+    return m_model != Model::ZX48 && m_shadowScreen ? m_shadowVideoBank : m_videoBank;
 }
 
-void Spectrum::updateVideo()
+void Spectrum::renderVideo()
 {
-    bool flash = (m_frameCounter & 16) != 0;
-    TState tState = m_tState;
+    updateVideo(69888);
+}
 
-    static const u32 colours[16] =
+// Each cell of the screen is 8 pixels of either the paper or the ink colour of its attribute.  The attribute gives
+// the pair of colours (swapped if flashing) and the pixel byte gives a mask per pixel to pick between them.
+namespace
+{
+    struct VideoTables
     {
-        0xff000000, 0xffd70000, 0xff0000d7, 0xffd700d7, 0xff00d700, 0xffd7d700, 0xff00d7d7, 0xffd7d7d7,
-        0xff000000, 0xffff0000, 0xff0000ff, 0xffff00ff, 0xff00ff00, 0xffffff00, 0xff00ffff, 0xffffffff,
+        u32     colours[2][256][2];     // [flash phase][attribute] -> paper, ink
+        u32     masks[256][8];          // [pixel byte] -> ~0 for each pixel that is ink
+
+        VideoTables()
+        {
+            static const u32 palette[16] =
+            {
+                0xff000000, 0xffd70000, 0xff0000d7, 0xffd700d7, 0xff00d700, 0xffd7d700, 0xff00d7d7, 0xffd7d7d7,
+                0xff000000, 0xffff0000, 0xff0000ff, 0xffff00ff, 0xff00ff00, 0xffffff00, 0xff00ffff, 0xffffffff,
+            };
+
+            for (int attr = 0; attr < 256; ++attr)
+            {
+                // Bright is either 0x08 or 0x00
+                int bright = (attr & 0x40) >> 3;
+                u32 paper = palette[((attr & 0x38) >> 3) + bright];
+                u32 ink = palette[(attr & 0x07) + bright];
+                bool swap = (attr & 0x80) != 0;
+
+                colours[0][attr][0] = paper;
+                colours[0][attr][1] = ink;
+                colours[1][attr][0] = swap ? ink : paper;
+                colours[1][attr][1] = swap ? paper : ink;
+            }
+
+            for (int pixels = 0; pixels < 256; ++pixels)
+            {
+                for (int p = 0; p < 8; ++p) masks[pixels][p] = (pixels & (0x80 >> p)) ? 0xffffffff : 0;
+            }
+        }
     };
 
+    const VideoTables gVideoTables;
+}
+
+bool Spectrum::takeDirtyLines(int& firstLine, int& lastLine)
+{
+    if (m_dirtyFirst > m_dirtyLast) return false;
+
+    firstLine = m_dirtyFirst;
+    lastLine = m_dirtyLast;
+    m_dirtyFirst = kWindowHeight;
+    m_dirtyLast = -1;
+    return true;
+}
+
+void Spectrum::updateVideo(TState t)
+{
+    TState tState = t;
+
     // Nothing to draw yet
     if (tState < m_startTState) return;
     if (tState >= getFrameTime())
@@ -826,75 +1283,66 @@ void Spectrum::updateVideo()
     // It takes 4 t-states to write 1 byte.
     int elapsedTStates = int(tState + 1 - m_drawTState);
     int numBytes = (elapsedTStates >> 2) + ((elapsedTStates % 4) > 0 ? 1 : 0);
-    int vramBank = m_model == Model::ZX48
-        ? m_videoBank
-        : m_shadowScreen ? m_shadowVideoBank : m_videoBank;
-    int bankSize = getBankSize();
 
-    for (int i = 0; i < numBytes; ++i)
+    // The screen is always within the first page of its bank.
+    const u8* vram = m_ram.data() + getVideoBank() * getBankSize();
+    const auto& colours = gVideoTables.colours[(m_frameCounter & 16) ? 1 : 0];
+    const u16* map = m_videoMap.data();
+    u32 border = gVideoTables.colours[0][getBorderColour() << 3][0];
+
+    // Each cell remembers what it was last drawn from, so cells that haven't changed since are skipped, and only lines
+    // that really change are marked dirty.  An unchanging screen is then neither drawn nor uploaded again.
+    u32 flashKey = (m_frameCounter & 16) ? 0x10000 : 0;
+    u32 borderKey = 0x1000000 | getBorderColour();
+    int firstChanged = kWindowHeight;
+    int lastChanged = -1;
+    for (int i = 0; i < numBytes; ++i, m_drawTState += 4)
     {
-        if (m_videoMap[m_drawTState] < kBorder)
-        {
-            // Pixel address
-            // #todo: refactor bank sizes to log-2?
-            u16 paddr = m_videoMap[m_drawTState];
-            u16 bank = (u16)vramBank + (paddr / (u16)bankSize);
-            u16 offset = paddr % (u16)bankSize;
-            u8 pixelData = bankPeek(bank, offset);
+        u16 paddr = map[m_drawTState];
+        if (paddr == kDoNotDraw) continue;
+
+        assert(m_videoWrite + 8 <= (kWindowWidth * kWindowHeight));
+        u32* out = m_image + m_videoWrite;
+        u32& key = m_cellKeys[m_videoWrite >> 3];
+        m_videoWrite += 8;
 
+        if (paddr == kBorder)
+        {
+            if (key == borderKey) continue;
+            key = borderKey;
+            fill(out, out + 8, border);
+        }
+        else
+        {
             // Calculate attribute address
             // 000S SRRR CCCX XXXX --> 0001 10SS CCCX XXXX
             u16 aaddr = ((paddr & 0x1800) >> 3) + (paddr & 0x00ff) + 0x1800;
-            bank = (u16)vramBank + (aaddr / (u16)bankSize);
-            offset = aaddr % (u16)bankSize;
-            u8 attr = bankPeek(bank, offset);
-
-            u8 lastAttrData = attr;
-
-            // Bright is either 0x08 or 0x00
-            u8 bright = (attr & 0x40) >> 3;
-            u8 ink = (attr & 0x07);
-            u8 paper = (attr & 0x38) >> 3;
-            u32 c0 = colours[paper + bright];
-            u32 c1 = colours[ink + bright];
-
-            if (flash && (attr & 0x80))
-            {
-                std::swap(c0, c1);
-            }
-
-            // We have a byte of pixel data and a byte of attr data - draw 8 pixels
-            for (int p = 0; p < 8; ++p)
-            {
-                if ((pixelData & 0x80) != 0)
-                {
-                    assert(m_videoWrite < (kWindowWidth * kWindowHeight));
-                    m_image[m_videoWrite++] = c1;
-                    lastAttrData = ink;
-                }
-                else
-                {
-                    assert(m_videoWrite < (kWindowWidth * kWindowHeight));
-                    m_image[m_videoWrite++] = c0;
-                    lastAttrData = paper;
-                }
-                pixelData <<= 1;
-            }
-        } // pixel data
-        else if (m_videoMap[m_drawTState] == kBorder)
-        {
-            u32 border = colours[getBorderColour()];
-            for (int b = 0; b < 8; ++b)
-            {
-                assert(m_videoWrite < (kWindowWidth * kWindowHeight));
-                m_image[m_videoWrite++] = border;
-            }
+            u8 attr = vram[aaddr];
+            u8 pixels = vram[paddr];
+            u32 cellKey = pixels | (attr << 8) | ((attr & 0x80) ? flashKey : 0);
+            if (key == cellKey) continue;
+            key = cellKey;
+
+            const u32* pair = colours[attr];
+            const u32* mask = gVideoTables.masks[pixels];
+            u32 paper = pair[0];
+            u32 diff = pair[0] ^ pair[1];
+            for (int p = 0; p < 8; ++p) out[p] = paper ^ (diff & mask[p]);
         }
 
-        m_drawTState += 4;
-    } // for numbytes
+        int line = int(out - m_image) / kWindowWidth;
+        firstChanged = min(firstChanged, line);
+        lastChanged = max(lastChanged, line);
+    }
+
+    if (firstChanged <= lastChanged)
+    {
+        m_dirtyFirst = min(m_dirtyFirst, firstChanged);
+        m_dirtyLast = max(m_dirtyLast, lastChanged);
+        ++m_videoVersion;
+    }
 
-    if (m_tState >= getFrameTime())
+    if (t >= getFrameTime())
     {
         m_videoWrite = 0;
         m_drawTState = m_startTState;
@@ -902,105 +1350,144 @@ void Spectrum::updateVideo()
     }
 }
 
+void Spectrum::syncVideo()
+{
+    updateVideo(m_z80.getInstructionStart());
+}
+
+void Spectrum::updateAudio(TState tState)
+{
+    m_audio.setLevels(tState, m_speaker, m_tapeEar ? 1 : 0);
+}
+
+void Spectrum::videoWrite(u16 address, u8 x)
+{
+    u16 offset = address & kPageMask;
+    if (offset >= m_firstRead.size() || m_pages[address >> kPageShift][offset] == x) return;
+
+    TState t = m_z80.getInstructionStart();
+    if (m_firstRead[offset] <= t && m_lastRead[offset] >= m_drawTState) updateVideo(t);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Breakpoints
 //----------------------------------------------------------------------------------------------------------------------
 
-vector<Spectrum::Breakpoint>::const_iterator Spectrum::findBreakpoint(u16 address) const
+void Spectrum::initBreakpoints()
 {
-    return find_if(m_breakpoints.begin(), m_breakpoints.end(),
-        [address](const auto& br) -> bool {
-            return br.address == address;
-        });
+    // Physical memory may have changed size with the model, so rebuild the bitmap and drop anything that no longer
+    // exists.
+    m_breakpointBits.assign((m_ram.size() + 7) / 8, 0);
+    m_userBreakpoints.erase(remove_if(m_userBreakpoints.begin(), m_userBreakpoints.end(),
+        [this](u32 p) -> bool { return p >= m_ram.size(); }), m_userBreakpoints.end());
+    for (u32 p : m_userBreakpoints)
+    {
+        m_breakpointBits[p >> 3] |= u8(1 << (p & 7));
+    }
+    m_tempBreakpoints.clear();
 }
 
-vector<Spectrum::DataBreakpoint>::const_iterator Spectrum::findDataBreakpoint(u16 address, u16 len) const
+vector<Spectrum::DataBreakpoint>::const_iterator Spectrum::findDataBreakpoint(u16 address, u16 len,
+    DataBreakpointType type) const
 {
     return find_if(m_dataBreakpoints.begin(), m_dataBreakpoints.end(),
-        [address, len](const auto& br) -> bool {
-            return br.address == address && br.len == len;
+        [address, len, type](const auto& br) -> bool {
+            return br.address == address && br.len == len && br.type == type;
         });
 }
 
+void Spectrum::updateWatchpoints()
+{
+    static const u8 kPageFlags[] = { kPageWatchWrite, kPageWatchRead, kPageWatchExecute };
+
+    for (auto& bits : m_watchBits)
+    {
+        bits.assign(KB(64) / 8, 0);
+    }
+    fill(begin(m_pageWatchAttrs), end(m_pageWatchAttrs), 0);
+
+    for (const auto& br : m_dataBreakpoints)
+    {
+        vector<u8>& bits = m_watchBits[(int)br.type];
+        for (int i = 0; i < br.len; ++i)
+        {
+            u16 a = u16(br.address + i);
+            bits[a >> 3] |= u8(1 << (a & 7));
+            m_pageWatchAttrs[a >> kPageShift] |= kPageFlags[(int)br.type];
+        }
+    }
+}
+
 void Spectrum::toggleBreakpoint(u16 address)
 {
-    auto it = findBreakpoint(address);
-    if (it == m_breakpoints.end())
+    u32 p = physicalAddress(address);
+    auto it = find(m_userBreakpoints.begin(), m_userBreakpoints.end(), p);
+    if (it == m_userBreakpoints.end())
     {
-        m_breakpoints.emplace_back(Breakpoint{ BreakpointType::User, address });
+        m_userBreakpoints.emplace_back(p);
     }
     else
     {
-        m_breakpoints.erase(it);
+        m_userBreakpoints.erase(it);
     }
+    m_breakpointBits[p >> 3] ^= u8(1 << (p & 7));
 }
 
-void Spectrum::toggleDataBreakpoint(u16 address, u16 len)
+void Spectrum::toggleDataBreakpoint(u16 address, u16 len, DataBreakpointType type)
 {
-    auto it = findDataBreakpoint(address, len);
+    auto it = findDataBreakpoint(address, len, type);
     if (it == m_dataBreakpoints.end())
     {
-        m_dataBreakpoints.emplace_back(DataBreakpoint{ address, len });
+        m_dataBreakpoints.emplace_back(DataBreakpoint{ address, len, type });
     }
     else
     {
         m_dataBreakpoints.erase(it);
     }
+    updateWatchpoints();
+    updateMemoryMap();
+}
+
+void Spectrum::clearDataBreakpoints()
+{
+    m_dataBreakpoints.clear();
+    updateWatchpoints();
+    updateMemoryMap();
 }
 
 void Spectrum::addTemporaryBreakpoint(u16 address)
 {
-    auto it = findBreakpoint(address);
-    if (it == m_breakpoints.end())
+    if (find(m_tempBreakpoints.begin(), m_tempBreakpoints.end(), address) == m_tempBreakpoints.end())
     {
-        m_breakpoints.emplace_back(Breakpoint{ BreakpointType::Temporary, address });
+        m_tempBreakpoints.emplace_back(address);
     }
 }
 
-bool Spectrum::shouldBreak(u16 address)
+bool Spectrum::hitTemporaryBreakpoint(u16 address)
 {
-    if (m_breakpoints.size() == 0) return false;
-    auto it = findBreakpoint(address);
-    bool result = it != m_breakpoints.end();
-    if (result && (it->type == BreakpointType::Temporary))
-    {
-        m_breakpoints.erase(it);
-    }
+    auto it = find(m_tempBreakpoints.begin(), m_tempBreakpoints.end(), address);
+    if (it == m_tempBreakpoints.end()) return false;
 
-    return result;
+    m_tempBreakpoints.erase(it);
+    return true;
 }
 
 bool Spectrum::hasUserBreakpointAt(u16 address) const
 {
-    auto it = findBreakpoint(address);
-    return (it != m_breakpoints.end() && it->type == BreakpointType::User);
+    u32 p = physicalAddress(address);
+    return (m_breakpointBits[p >> 3] & (1 << (p & 7))) != 0;
 }
 
-bool Spectrum::hasDataBreakpoint(u16 address, u16 len) const
+bool Spectrum::hasDataBreakpoint(u16 address, u16 len, DataBreakpointType type) const
 {
-    auto it = findDataBreakpoint(address, len);
+    auto it = findDataBreakpoint(address, len, type);
     return (it != m_dataBreakpoints.end());
 }
 
-vector<u16> Spectrum::getUserBreakpoints() const
-{
-    vector<u16> breakpoints;
-    for (const auto& br : m_breakpoints)
-    {
-        if (br.type == BreakpointType::User)
-        {
-            breakpoints.push_back(br.address);
-        }
-    }
-    return breakpoints;
-}
-
 void Spectrum::clearUserBreakpoints()
 {
-    decltype(m_breakpoints) newbps;
-    copy_if(m_breakpoints.begin(), m_breakpoints.end(), back_inserter(newbps), 
-        [](const auto& br) -> bool { return br.type != BreakpointType::User; });
-    swap(m_breakpoints, newbps);
+    m_userBreakpoints.clear();
+    fill(m_breakpointBits.begin(), m_breakpointBits.end(), 0);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
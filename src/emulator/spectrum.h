@@ -6,11 +6,13 @@
 
 #include <audio/audio.h>
 #include <config.h>
+#include <emulator/callstack.h>
+#include <emulator/profiler.h>
+#include <emulator/scheduler.h>
 #include <emulator/z80.h>
+#include <tape/tape.h>
 #include <types.h>
 
-#include <SFML/Graphics.hpp>
-
 #include <array>
 #include <string>
 #include <vector>
@@ -76,9 +78,7 @@ enum class RunMode
 // Each model must override this and implement the specifics
 //----------------------------------------------------------------------------------------------------------------------
 
-class Tape;
-
-class Spectrum: public IExternals
+class Spectrum
 {
 public:
     // TState counter
@@ -102,28 +102,50 @@ public:
     //------------------------------------------------------------------------------------------------------------------
 
     Model           getModel            () const { return m_model; }
-    sf::Sprite&     getVideoSprite      ();
+    const u32*      getVideoImage       () const { return m_image; }
+
+    // The lines of the video image that have changed since the last call.  Returns false if none have.
+    bool            takeDirtyLines      (int& firstLine, int& lastLine);
+
+    // Goes up every time the video image changes, so a presenter can tell if it has anything new to show.
+    u64             getVideoVersion     () const { return m_videoVersion; }
     TState          getFrameTime        () const { return 69888; }
     u8              getBorderColour     () const { return m_borderColour; }
-    Z80&            getZ80              () { return m_z80; }
+    Z80Core<Spectrum>&
+                    getZ80              () { return m_z80; }
     TState          getTState           () { return m_tState;}
     Audio&          getAudio            () { return m_audio; }
+    Scheduler&      getScheduler        () { return m_scheduler; }
     Tape*           getTape             () { return m_tape; }
     bool            isShadowScreen      () const { return m_shadowScreen; }
+    int             getVideoBank        () const;
     bool            isPagingDisabled    () const { return m_pagingDisabled; }
 
     //------------------------------------------------------------------------------------------------------------------
-    // IExternals interface
+    // Z80 bus interface
+    // Z80Core<Spectrum> calls these directly, so the memory accesses are inline (see bottom of this file).
     //------------------------------------------------------------------------------------------------------------------
 
-    u8              peek                (u16 address) override;
-    u8              peek                (u16 address, TState& t) override;
-    u16             peek16              (u16 address, TState& t) override;
-    void            poke                (u16 address, u8 x, TState& t) override;
-    void            poke16              (u16 address, u16 x, TState& t) override;
-    void            contend             (u16 address, TState delay, int num, TState& t) override;
-    u8              in                  (u16 port, TState& t) override;
-    void            out                 (u16 port, u8 x, TState& t) override;
+    // The untimed peeks are for the debugger and UI: they aren't contended and never trigger read watchpoints.
+    u8              peek                (u16 address);
+    u16             peek16              (u16 address);
+    u8              peek                (u16 address, TState& t);
+    u16             peek16              (u16 address, TState& t);
+    void            poke                (u16 address, u8 x, TState& t);
+    void            poke16              (u16 address, u16 x, TState& t);
+    void            contend             (u16 address, TState delay, int num, TState& t);
+    u8              in                  (u16 port, TState& t);
+    void            out                 (u16 port, u8 x, TState& t);
+    bool            shouldBreak         (u16 pc);
+    TState          blockLimit          (u16 pc);
+    bool            isBlockSafe         (u16 address) const;
+    bool            isBlockSafePort     (u16 port) const;
+    u16*            decodeSlot          (u16 pc);
+    bool            canDecode           (u16 pc);
+    u16*            blockSlot           (u16 pc);
+    int             blockSize           (u16 pc);
+    void            addCode             (u16 address, int size);
+    const u64*      codeVersion         (u16 pc);
 
     //------------------------------------------------------------------------------------------------------------------
     // General functionality, not specific to a model
@@ -133,6 +155,10 @@ public:
     // a frame was complete.
     bool            update              (RunMode runMode, bool& breakpointHit);
 
+    // Run as little as possible of a frame: one instruction, one block, or a halt up to the next event.  Calling this
+    // repeatedly runs the same frames as update(RunMode::Normal).  Returns true if the frame was completed.
+    bool            updateSlice         (bool& breakpointHit);
+
     // Emulation control
     void            togglePause         ();
     
@@ -143,10 +169,10 @@ public:
     void            setBorderColour     (u8 borderColour);
 
     // Reset the tState counter
-    void            resetTState         () { m_tState = 0; }
+    void            resetTState         () { m_tState = 0; m_tapeTState = 0; }
 
     // Set the tState counter
-    void            setTState           (TState t) { m_tState = t;}
+    void            setTState           (TState t) { m_tState = t; m_tapeTState = t; }
 
     // Set the tape, it will be played if not stopped.
     void            setTape             (Tape* tape) { m_tape = tape;}
@@ -154,6 +180,85 @@ public:
     // Render all video, irregardless of t-state.
     void            renderVideo         ();
 
+    // When enabled (the default), a halted CPU jumps straight to the next interrupt rather than re-executing the HALT.
+    void            setHaltSkip         (bool enabled) { m_skipHalt = enabled; }
+    bool            isHaltSkip          () const { return m_skipHalt; }
+
+    // When enabled (the default), instructions are decoded once and kept until the memory they came from is written.
+    void            setDecodeCache      (bool enabled);
+    bool            isDecodeCache       () const { return m_decodeCacheEnabled; }
+
+    // When enabled (the default), code in uncontended memory is run from the decoded-block cache while there are no
+    // breakpoints.
+    void            setBlockCache      (bool enabled);
+    bool            isBlockCache       () const { return m_blockCacheEnabled; }
+
+    // When enabled (the default), repeating block instructions run many iterations per step (see IExternals::blockLimit).
+    void            setBulkRepeat       (bool enabled) { m_bulkRepeat = enabled; }
+    bool            isBulkRepeat        () const { return m_bulkRepeat; }
+
+    // While enabled, the physical address of every byte the CPU writes is added to getWrites(), which the caller
+    // empties.  Used to compare the memory of machines running in lockstep.
+    void            setWriteTracking    (bool enabled);
+    vector<u32>&    getWrites           () { return m_writes; }
+
+    // While profiling, instructions are run one at a time (no blocks or bulk repeats) and each is added to the
+    // profiler and the call stack.  Turning it off keeps the counts until it is turned on again, the profiler is
+    // cleared or the machine is reset.  It costs nothing when off: the per-address counts are only allocated when it
+    // is turned on, and clearing the profiler while it is off frees them.
+    void            setProfiling        (bool enabled);
+    bool            isProfiling         () const { return m_profiling; }
+    Profiler&       getProfiler         () { return m_profiler; }
+    void            clearProfiler       ();
+
+    // Call tracking follows the call stack (see CallStack) without the rest of the profiling, for the debugger.
+    void            setCallTracking     (bool enabled);
+    CallStack&      getCallStack        () { return m_callStack; }
+    bool            isTrackingCalls     () const { return m_profiling || m_callTracking; }
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Machine state
+    // Everything that changes as the machine runs, apart from memory, can be saved between instructions and put back
+    // later (see Rewind).  Nothing the user sets up, such as breakpoints or the tape's contents, is part of it.
+    //------------------------------------------------------------------------------------------------------------------
+
+    struct State
+    {
+        Z80::State      z80;
+        i64             frameCount;
+        TState          tState;
+        TState          frameEvent;
+        TState          tapeEvent;          // Scheduler::kNever if not scheduled
+        TState          tapeTState;
+        Tape*           tape;               // The position is only put back into the same tape
+        Tape::Position  tapePosition;
+        u8              slots[8];
+        bool            pagingDisabled;
+        bool            shadowScreen;
+        u8              borderColour;
+        u8              speaker;
+        u8              tapeEar;
+        u8              keys[8];
+        u8              kempstonState;
+        u8              frameCounter;
+        int             videoWrite;
+        TState          drawTState;
+    };
+
+    State           getState            ();
+    void            setState            (const State& state);
+
+    // Frames completed since the last reset.
+    i64             getFrameCount       () const { return m_frameCount; }
+
+    // All of physical memory.  Writing it drops any decoded instructions and blocks that came from it.
+    const vector<u8>&
+                    getMemory           () const { return m_ram; }
+    void            setMemory           (u32 physAddress, const u8* data, u32 size);
+
+    const vector<u8>&
+                    getKeyboardState    () const { return m_keys; }
+
     //------------------------------------------------------------------------------------------------------------------
     // Memory interface
     //------------------------------------------------------------------------------------------------------------------
@@ -179,6 +284,8 @@ public:
     vector<u32>     findString          (string str);
     u32             convertAddress      (size_t ramOffset);
     string          addressName         (u32 address, bool moreInfo);
+    u32             physicalAddress     (u16 address) const;
+    string          physicalAddressName (u32 physAddress);
 
     //------------------------------------------------------------------------------------------------------------------
     // Video interface
@@ -203,41 +310,95 @@ public:
     // Debugger interface
     //------------------------------------------------------------------------------------------------------------------
 
+    // User breakpoints are set on the physical address that is paged in at the time, so they only fire in that
+    // bank.  Temporary breakpoints (used for stepping) are on logical addresses.
     void            toggleBreakpoint        (u16 address);
     void            addTemporaryBreakpoint  (u16 address);
     bool            hasUserBreakpointAt     (u16 address) const;
-    vector<u16>     getUserBreakpoints      () const;
+    const vector<u32>&
+                    getUserBreakpoints      () const { return m_userBreakpoints; }
     void            clearUserBreakpoints    ();
 
+    // Data breakpoints (watchpoints) are on logical addresses and fire when a byte in the range is accessed.
+    enum class DataBreakpointType
+    {
+        Write,
+        Read,
+        Execute,
+
+        COUNT
+    };
+
     struct DataBreakpoint
     {
-        u16     address;
-        u16     len;
+        u16                 address;
+        u16                 len;
+        DataBreakpointType  type;
     };
 
-    void            toggleDataBreakpoint    (u16 address, u16 len);
-    bool            hasDataBreakpoint       (u16 address, u16 len) const;
+    void            toggleDataBreakpoint    (u16 address, u16 len, DataBreakpointType type = DataBreakpointType::Write);
+    bool            hasDataBreakpoint       (u16 address, u16 len, DataBreakpointType type = DataBreakpointType::Write) const;
     const vector<DataBreakpoint>&
                     getDataBreakpoints      () const { return m_dataBreakpoints; }
-    void            clearDataBreakpoints    () { m_dataBreakpoints.clear(); }
+    void            clearDataBreakpoints    ();
 
 private:
     //
     // Memory
     //
     void            initMemory          ();
+    void            updateMemoryMap     ();
+    bool            isRomBank           (int bank) const;
+    bool            isContendedBank     (int bank) const;
+
+    // Predecode and decoded-block caches.  There are decode and block slots for every byte of m_ram, and the pages that
+    // have had either used are flagged kPageExecuted so that writes to them clear the decode slots of any instruction
+    // they overlap.  Writes to bytes that are part of a block also change the code version of the lines around them.
+    void            markExecuted        (u16 address);
+    void            invalidateDecode    (u16 address);
+    void            invalidateDecode    (u32 physAddress, u32 size);
+    void            newCodeVersions     (u32 firstLine, u32 endLine);
+
+    // Each code version covers a line and the line after it, so a block can cover up to 2 lines from its start.
+    static const int kCodeLineShift = 8;
+
+    // The 64K address space is split into 8K pages, each with a host pointer and attribute flags, so memory accesses
+    // are a shift, a load and a flag test whatever the model's bank size is.  The map is rebuilt whenever the
+    // paging changes.
+    static const int kPageShift = 13;
+    static const int kNumPages = 8;
+    static const u16 kPageMask = (1 << kPageShift) - 1;
+
+    static const u8 kPageReadOnly = 0x01;       // ROM: writes are ignored
+    static const u8 kPageContended = 0x02;      // Accesses are subject to ULA contention
+    static const u8 kPageExecuted = 0x04;       // Code from this page has been cached; writes must invalidate it
+    static const u8 kPageWatchWrite = 0x08;     // A write data breakpoint covers part of this page
+    static const u8 kPageWatchRead = 0x10;      // A read data breakpoint covers part of this page
+    static const u8 kPageWatchExecute = 0x20;   // An execute data breakpoint covers part of this page
+    static const u8 kPageTrackWrites = 0x40;    // Writes are added to m_writes
+    static const u8 kPageVideo = 0x80;          // Holds the screen being displayed (see videoWrite)
 
     //
     // Video
     //
     void            initVideo           ();
-    void            updateVideo         ();
+    void            updateVideo         (TState tState);
+
+    // Bring the video up to the start of the current instruction before it changes something it reads.
+    void            syncVideo           ();
+
+    // A write to the displayed screen only needs the video brought up to date if the beam has passed a cell that reads
+    // the byte and the cell hasn't been drawn yet.  Otherwise the cell is drawn later with the new value either way.
+    void            videoWrite          (u16 address, u8 x);
 
     //
     // Audio
     //
     void            initAudio           ();
 
+    // The speaker or EAR level has just changed, taking effect at tState.
+    void            updateAudio         (TState tState);
+
     //
     // I/O
     //
@@ -246,27 +407,34 @@ private:
     //
     // Tape
     //
-    void            updateTape          (TState numTStates);
+    void            updateTape          ();
+    void            scheduleTape        ();
 
     //
-    // Breakpoints
+    // Events
     //
-    enum class BreakpointType
-    {
-        User,       // User added breakpoint, only user can remove it
-        Temporary,  // System added breakpoint, and it should be removed when hit.
-    };
+    void            initEvents          ();
+    void            onFrameEnd          ();
+    void            onTapeEdge          ();
 
-    struct Breakpoint
-    {
-        BreakpointType  type;
-        u16             address;
-    };
+    //
+    // CPU
+    //
+    bool            canSkipHalt         ();
+    bool            runSlice            (bool single);
+    bool            runTracked          (TState until, StopConditions stop);
+    bool            canRunBlocks        () const;
+    void            endFrame            ();
 
-    vector<Breakpoint>::const_iterator      findBreakpoint          (u16 address) const;
-    bool                                    shouldBreak             (u16 address);
+    //
+    // Breakpoints
+    //
+    void                                    initBreakpoints         ();
+    bool                                    hitTemporaryBreakpoint  (u16 address);
 
-    vector<DataBreakpoint>::const_iterator  findDataBreakpoint  (u16 address, u16 len) const;
+    vector<DataBreakpoint>::const_iterator  findDataBreakpoint      (u16 address, u16 len, DataBreakpointType type) const;
+    void                                    updateWatchpoints       ();
+    bool                                    isWatched               (u16 address, DataBreakpointType type) const;
 
 private:
     // Model
@@ -277,23 +445,33 @@ private:
 
     // Clock state
     TState                      m_tState;
+    Scheduler                   m_scheduler;
+    Scheduler::EventId          m_frameEvent;
+    Scheduler::EventId          m_tapeEvent;
+    bool                        m_frameDone;
+    i64                         m_frameCount;
 
     // Video state
     int                         m_videoBank;
     int                         m_shadowVideoBank;
     u32*                        m_image;
-    sf::Texture                 m_videoTexture;
-    sf::Sprite                  m_videoSprite;
     u8                          m_frameCounter;
     vector<u16>                 m_videoMap;         // Maps t-states to addresses
     vector<u16>                 m_shadowVideoMap;   // Maps t-states to addresses
+    vector<u32>                 m_firstRead;        // Per byte of the screen: first cell's t-state that reads it
+    vector<u32>                 m_lastRead;         // Per byte of the screen: last cell's t-state that reads it
     int                         m_videoWrite;       // Write point into 2D image array
     TState                      m_startTState;      // Starting t-state for top-left of window
     TState                      m_drawTState;       // Current t-state that has been draw to
+    vector<u32>                 m_cellKeys;         // Per 8 pixels of m_image: the bytes or border it was drawn from
+    int                         m_dirtyFirst;       // Lines of m_image changed since takeDirtyLines()
+    int                         m_dirtyLast;
+    u64                         m_videoVersion;
 
     // Audio state
     Audio                       m_audio;
     Tape*                       m_tape;
+    TState                      m_tapeTState;       // T-state the tape was last played up to
 
     // Memory state
     vector<u8>                  m_slots;
@@ -301,9 +479,31 @@ private:
     vector<u8>                  m_ram;
     vector<u8>                  m_contention;
     bool                        m_romWritable;
+    u8*                         m_pages[kNumPages];
+    u8                          m_pageAttrs[kNumPages];
+    bool                        m_decodeCacheEnabled;
+    vector<u16>                 m_decodeCache;      // Z80Core decoded instructions, per byte of m_ram (0 = empty)
+    vector<bool>                m_decodeUsed;       // Per 8K physical page: has had a decode slot filled
+    u16*                        m_decodePages[kNumPages];
+    bool                        m_blockCacheEnabled;
+    bool                        m_blocksAllowed;    // Only while running normally with no breakpoints
+    vector<u16>                 m_blockSlots;       // Z80Core block indices, per byte of m_ram (0 = none)
+    u16*                        m_blockPages[kNumPages];
+    vector<u8>                  m_codeBits;         // 1 bit per byte of m_ram: part of a decoded block
+    vector<u64>                 m_codeVersions;     // Per line of m_ram
+    u64                         m_lastCodeVersion;
+    bool                        m_trackWrites;
+    vector<u32>                 m_writes;           // Physical addresses written while tracking
 
     // CPU state
-    Z80                         m_z80;
+    Z80Core<Spectrum>           m_z80;
+    bool                        m_skipHalt;
+    TState                      m_blockLimit;       // Block instructions can run in bulk up to here (0 = don't)
+    bool                        m_bulkRepeat;
+    bool                        m_profiling;
+    Profiler                    m_profiler;
+    bool                        m_callTracking;
+    CallStack                   m_callStack;
 
     // ULA state
     u8                          m_borderColour;
@@ -316,11 +516,203 @@ private:
     bool                        m_shadowScreen;
 
     // Debugger state
-    vector<Breakpoint>          m_breakpoints;
+    vector<u32>                 m_userBreakpoints;      // Physical addresses
+    vector<u8>                  m_breakpointBits;       // 1 bit per byte of physical memory
+    vector<u16>                 m_tempBreakpoints;      // Logical addresses, removed when hit
     vector<DataBreakpoint>      m_dataBreakpoints;
+    vector<u8>                  m_watchBits[(int)DataBreakpointType::COUNT];    // 1 bit per logical address
+    u8                          m_pageWatchAttrs[kNumPages];                    // kPageWatchXXX flags per page
     bool                        m_break;
 
     // Kempston
     bool                        m_kempstonJoystick;
     u8                          m_kempstonState;
 };
+
+extern template class Z80Core<Spectrum>;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Inline memory access
+//----------------------------------------------------------------------------------------------------------------------
+
+inline u8 Spectrum::peek(u16 address)
+{
+    return m_pages[address >> kPageShift][address & kPageMask];
+}
+
+inline u16 Spectrum::peek16(u16 address)
+{
+    return peek(address) + 256 * peek(address + 1);
+}
+
+inline u8 Spectrum::peek(u16 address, TState& t)
+{
+    contend(address, 3, 1, t);
+    if ((m_pageAttrs[address >> kPageShift] & kPageWatchRead) && isWatched(address, DataBreakpointType::Read))
+    {
+        m_break = true;
+    }
+    return peek(address);
+}
+
+inline u16 Spectrum::peek16(u16 address, TState& t)
+{
+    return peek(address, t) + 256 * peek(address + 1, t);
+}
+
+inline void Spectrum::poke(u16 address, u8 x)
+{
+    u8 attrs = m_pageAttrs[address >> kPageShift];
+
+    if ((attrs & kPageWatchWrite) && isWatched(address, DataBreakpointType::Write))
+    {
+        m_break = true;
+    }
+
+    if (!(attrs & kPageReadOnly))
+    {
+        m_pages[address >> kPageShift][address & kPageMask] = x;
+        if (attrs & kPageExecuted) invalidateDecode(address);
+        if (attrs & kPageTrackWrites) m_writes.push_back(physicalAddress(address));
+    }
+}
+
+inline void Spectrum::poke(u16 address, u8 x, TState& t)
+{
+    contend(address, 3, 1, t);
+    if (m_pageAttrs[address >> kPageShift] & kPageVideo) videoWrite(address, x);
+    poke(address, x);
+}
+
+inline void Spectrum::poke16(u16 address, u16 w, TState& t)
+{
+    Reg r(w);
+    poke(address, r.l, t);
+    poke(address + 1, r.h, t);
+}
+
+inline u32 Spectrum::physicalAddress(u16 address) const
+{
+    return u32(m_pages[address >> kPageShift] - m_ram.data()) + (address & kPageMask);
+}
+
+inline bool Spectrum::isWatched(u16 address, DataBreakpointType type) const
+{
+    return (m_watchBits[(int)type][address >> 3] & (1 << (address & 7))) != 0;
+}
+
+inline bool Spectrum::isContended(u16 addr) const
+{
+    return (m_pageAttrs[addr >> kPageShift] & kPageContended) != 0;
+}
+
+inline TState Spectrum::contention(TState tStates)
+{
+    return m_contention[tStates];
+}
+
+inline void Spectrum::contend(u16 address, TState delay, int num, TState& t)
+{
+    if (isContended(address))
+    {
+        for (int i = 0; i < num; ++i)
+        {
+            t += contention(t) + delay;
+        }
+    }
+    else
+    {
+        t += delay * num;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Inline predecode cache
+//----------------------------------------------------------------------------------------------------------------------
+
+inline u16* Spectrum::decodeSlot(u16 pc)
+{
+    u16* slots = m_decodePages[pc >> kPageShift];
+    return slots ? slots + (pc & kPageMask) : nullptr;
+}
+
+inline void Spectrum::invalidateDecode(u16 address)
+{
+    // Any instruction starting up to 3 bytes before the write could include it.
+    u16* slots = m_decodePages[address >> kPageShift];
+    int offset = address & kPageMask;
+    if (slots)
+    {
+        for (int i = offset < 3 ? 0 : offset - 3; i <= offset; ++i) slots[i] = 0;
+    }
+
+    u32 p = physicalAddress(address);
+    if (m_codeBits[p >> 3] & (1 << (p & 7)))
+    {
+        u32 line = p >> kCodeLineShift;
+        m_codeVersions[line] = ++m_lastCodeVersion;
+        if (line) m_codeVersions[line - 1] = ++m_lastCodeVersion;
+    }
+}
+
+inline u16* Spectrum::blockSlot(u16 pc)
+{
+    u16* slots = m_blockPages[pc >> kPageShift];
+    return slots && m_blocksAllowed ? slots + (pc & kPageMask) : nullptr;
+}
+
+inline const u64* Spectrum::codeVersion(u16 pc)
+{
+    return &m_codeVersions[physicalAddress(pc) >> kCodeLineShift];
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Inline block instruction checks
+// Iterations of a block instruction run in bulk all look like one instruction to syncVideo and updateAudio, so they
+// must not touch anything that syncs: contended pages (screen memory is always contended), watched pages or ports with
+// side effects (ULA, 128K paging).
+//----------------------------------------------------------------------------------------------------------------------
+
+inline TState Spectrum::blockLimit(u16 pc)
+{
+    if (!m_blockLimit) return 0;
+
+    // The breakpoint check after each step would stop at pc every iteration.
+    if (!m_tempBreakpoints.empty()) return 0;
+    if ((m_pageAttrs[pc >> kPageShift] & kPageWatchExecute) && isWatched(pc, DataBreakpointType::Execute)) return 0;
+    u32 p = physicalAddress(pc);
+    if (m_breakpointBits[p >> 3] & (1 << (p & 7))) return 0;
+
+    return m_blockLimit;
+}
+
+inline bool Spectrum::isBlockSafe(u16 address) const
+{
+    return (m_pageAttrs[address >> kPageShift] & (kPageContended | kPageWatchRead | kPageWatchWrite)) == 0;
+}
+
+inline bool Spectrum::isBlockSafePort(u16 port) const
+{
+    if ((port & 1) == 0) return false;
+    if ((m_model == Model::ZX128 || m_model == Model::ZXPlus2) && (port & 0x8002) == 0) return false;
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Inline breakpoint checks
+//----------------------------------------------------------------------------------------------------------------------
+
+inline bool Spectrum::shouldBreak(u16 address)
+{
+    if (!m_tempBreakpoints.empty() && hitTemporaryBreakpoint(address)) return true;
+    if ((m_pageAttrs[address >> kPageShift] & kPageWatchExecute) && isWatched(address, DataBreakpointType::Execute))
+    {
+        return true;
+    }
+
+    u32 p = physicalAddress(address);
+    return (m_breakpointBits[p >> 3] & (1 << (p & 7))) != 0 || m_break;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 
 
 #include <emulator/z80.h>
+#include <emulator/spectrum.h>
 
 #include <algorithm>
 #include <cassert>
@@ -53,12 +54,78 @@ void Z80::setFlags(u8 flags, bool value)
     }
 }
 
+inline void Z80::lazyFlags(u8 op, u8 operand1, u8 operand2, u16 result)
+{
+    m_flagOp = op;
+    m_flagOperand1 = operand1;
+    m_flagOperand2 = operand2;
+    m_flagResult = result;
+}
+
+inline u8 Z80::carryFlag() const
+{
+    switch (m_flagOp)
+    {
+    case kFlagsAdd:
+    case kFlagsSub:
+    case kFlagsCp:      return (m_flagResult >> 8) & F_CARRY;
+    case kFlagsInc:
+    case kFlagsDec:     return m_flagOperand1;
+    case kFlagsLogic:   return 0;
+    default:            return m_af.l & F_CARRY;
+    }
+}
+
+void Z80::resolveFlags()
+{
+    u8 a = m_flagOperand1;
+    u8 b = m_flagOperand2;
+    u16 t = m_flagResult;
+    u8 result = (u8)t;
+    u8 x = (u8)(((a & 0x88) >> 3) | ((b & 0x88) >> 2) | ((t & 0x88) >> 1));
+
+    switch (m_flagOp)
+    {
+    case kFlagsAdd:
+        m_af.l = ((t & 0x100) ? F_CARRY : 0) | kHalfCarryAdd[x & 0x07] | kOverflowAdd[x >> 4] | m_SZ53[result];
+        break;
+
+    case kFlagsSub:
+        m_af.l = ((t & 0x100) ? F_CARRY : 0) | F_NEG | kHalfCarrySub[x & 0x07] | kOverflowSub[x >> 4] | m_SZ53[result];
+        break;
+
+    case kFlagsCp:
+        // Bits 3 and 5 come from the operand rather than the result.
+        m_af.l = ((t & 0x100) ? F_CARRY : (result ? 0 : F_ZERO)) | F_NEG | kHalfCarrySub[x & 0x07] |
+            kOverflowSub[x >> 4] | (b & (F_3 | F_5)) | (result & F_SIGN);
+        break;
+
+    case kFlagsInc:
+        m_af.l = a | ((result == 0x80) ? F_PARITY : 0) | ((result & 0x0f) ? 0 : F_HALF) | m_SZ53[result];
+        break;
+
+    case kFlagsDec:
+        m_af.l = a | (((result & 0x0f) == 0x0f) ? F_HALF : 0) | F_NEG | (result == 0x7f ? F_PARITY : 0) |
+            m_SZ53[result];
+        break;
+
+    case kFlagsLogic:
+        m_af.l = a | m_SZ53P[result];
+        break;
+    }
+
+    m_flagOp = kFlagsReady;
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Initialisation
 //----------------------------------------------------------------------------------------------------------------------
 
-Z80::Z80(IExternals& ext)
-    : m_ext(ext)
+Z80::Z80()
+    : m_flagOp(kFlagsReady)
+    , m_flagOperand1(0)
+    , m_flagOperand2(0)
+    , m_flagResult(0)
     , m_halt(false)
     , m_iff1(true)
     , m_iff2(true)
@@ -66,6 +133,7 @@ Z80::Z80(IExternals& ext)
     , m_interrupt(false)
     , m_nmi(false)
     , m_eiHappened(false)
+    , m_instructionStart(0)
 {
     restart();
     for (int i = 0; i < 256; ++i)
@@ -105,6 +173,59 @@ void Z80::restart()
     m_interrupt = m_nmi = m_eiHappened = false;
 }
 
+Z80::State Z80::getState()
+{
+    State state;
+    state.af = AF();
+    state.bc = BC();
+    state.de = DE();
+    state.hl = HL();
+    state.ix = IX();
+    state.iy = IY();
+    state.sp = SP();
+    state.pc = PC();
+    state.ir = IR();
+    state.af_ = AF_();
+    state.bc_ = BC_();
+    state.de_ = DE_();
+    state.hl_ = HL_();
+    state.mp = MP();
+    state.im = u8(m_im);
+    state.halt = m_halt;
+    state.iff1 = m_iff1;
+    state.iff2 = m_iff2;
+    state.interrupt = m_interrupt;
+    state.nmi = m_nmi;
+    state.eiHappened = m_eiHappened;
+    return state;
+}
+
+void Z80::setState(const State& state)
+{
+    newF();
+    AF() = state.af;
+    BC() = state.bc;
+    DE() = state.de;
+    HL() = state.hl;
+    IX() = state.ix;
+    IY() = state.iy;
+    SP() = state.sp;
+    PC() = state.pc;
+    IR() = state.ir;
+    AF_() = state.af_;
+    BC_() = state.bc_;
+    DE_() = state.de_;
+    HL_() = state.hl_;
+    MP() = state.mp;
+    m_im = state.im;
+    m_halt = state.halt;
+    m_iff1 = state.iff1;
+    m_iff2 = state.iff2;
+    m_interrupt = state.interrupt;
+    m_nmi = state.nmi;
+    m_eiHappened = state.eiHappened;
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Instruction utilities
 //----------------------------------------------------------------------------------------------------------------------
@@ -131,7 +252,7 @@ void Z80::incReg8(u8& reg)
     // P: Result is 0x80
     // N: Reset
     // C: Unaffected
-    F() = (F() & F_CARRY) | ((reg == 0x80) ? F_PARITY : 0) | ((reg & 0x0f) ? 0 : F_HALF) | m_SZ53[reg];
+    lazyFlags(kFlagsInc, carryFlag(), 0, reg);
 }
 
 void Z80::decReg8(u8& reg)
@@ -142,9 +263,8 @@ void Z80::decReg8(u8& reg)
     // P: Result is 0x7f
     // N: Set
     // C: Unaffected
-    F() = (F() & F_CARRY) | ((reg & 0x0f) ? 0 : F_HALF) | F_NEG;
     --reg;
-    F() |= (reg == 0x7f ? F_PARITY : 0) | m_SZ53[reg];
+    lazyFlags(kFlagsDec, carryFlag(), 0, reg);
 }
 
 void Z80::addReg16(u16& r1, u16& r2)
@@ -172,9 +292,8 @@ void Z80::addReg8(u8& reg)
     // N: Reset
     // C: Carry from bit 7
     u16 t = A() + reg;
-    u8 x = (u8)(((A() & 0x88) >> 3) | ((reg & 0x88) >> 2) | ((t & 0x88) >> 1));
+    lazyFlags(kFlagsAdd, A(), reg, t);
     A() = (u8)t;
-    F() = ((t & 0x100) ? F_CARRY : 0) | kHalfCarryAdd[x & 0x07] | kOverflowAdd[x >> 4] | m_SZ53[A()];
 }
 
 // Result always goes into HL
@@ -186,12 +305,12 @@ void Z80::adcReg16(u16& reg)
     // P: Not affected
     // N: Reset
     // C: Carry from bit 15
-    u32 t = (u32)HL() + (u32)reg + (F() & F_CARRY);
+    u32 t = (u32)HL() + (u32)reg + carryFlag();
     u8 x = (u8)(((HL() & 0x8800) >> 11) | ((reg & 0x8800) >> 10) | ((t & 0x8800) >> 9));
     MP() = HL() + 1;
     HL() = (u16)t;
-    F() = ((t & 0x10000) ? F_CARRY : 0) | kOverflowAdd[x >> 4] | (H() & (F_3 | F_5 | F_SIGN)) | kHalfCarryAdd[x & 0x07] |
-        (HL() ? 0 : F_ZERO);
+    newF() = ((t & 0x10000) ? F_CARRY : 0) | kOverflowAdd[x >> 4] | (H() & (F_3 | F_5 | F_SIGN)) |
+        kHalfCarryAdd[x & 0x07] | (HL() ? 0 : F_ZERO);
 }
 
 // Result always goes into A
@@ -203,10 +322,9 @@ void Z80::adcReg8(u8& reg)
     // P: Set if overflow
     // N: Reset
     // C: Carry from bit 7
-    u16 t = (u16)A() + reg + (F() & F_CARRY);
-    u8 x = (u8)(((A() & 0x88) >> 3) | ((reg & 0x88) >> 2) | ((t & 0x88) >> 1));
+    u16 t = (u16)A() + reg + carryFlag();
+    lazyFlags(kFlagsAdd, A(), reg, t);
     A() = (u8)t;
-    F() = ((t & 0x100) ? F_CARRY : 0) | kHalfCarryAdd[x & 0x07] | kOverflowAdd[x >> 4] | m_SZ53[A()];
 }
 
 void Z80::subReg8(u8& reg)
@@ -218,9 +336,8 @@ void Z80::subReg8(u8& reg)
     // N: Set
     // C: Set if borrowed
     u16 t = (u16)A() - reg;
-    u8 x = (u8)(((A() & 0x88) >> 3) | ((reg & 0x88) >> 2) | ((t & 0x88) >> 1));
+    lazyFlags(kFlagsSub, A(), reg, t);
     A() = (u8)t;
-    F() = ((t & 0x100) ? F_CARRY : 0) | F_NEG | kHalfCarrySub[x & 0x07] | kOverflowSub[x >> 4] | m_SZ53[A()];
 }
 
 void Z80::sbcReg8(u8& reg)
@@ -231,10 +348,9 @@ void Z80::sbcReg8(u8& reg)
     // P: Set if overflow
     // N: Set
     // C: Set if borrowed
-    u16 t = (u16)A() - reg - (F() & F_CARRY);
-    u8 x = (u8)(((A() & 0x88) >> 3) | ((reg & 0x88) >> 2) | ((t & 0x88) >> 1));
+    u16 t = (u16)A() - reg - carryFlag();
+    lazyFlags(kFlagsSub, A(), reg, t);
     A() = (u8)t;
-    F() = ((t & 0x100) ? F_CARRY : 0) | F_NEG | kHalfCarrySub[x & 0x07] | kOverflowSub[x >> 4] | m_SZ53[A()];
 }
 
 void Z80::sbcReg16(u16& reg)
@@ -245,11 +361,11 @@ void Z80::sbcReg16(u16& reg)
     // P: Set if overflow
     // N: Set
     // C: Set if borrowed
-    u32 t = (u32)HL() - reg - (F() & F_CARRY);
+    u32 t = (u32)HL() - reg - carryFlag();
     u8 x = (u8)(((HL() & 0x8800) >> 11) | ((reg & 0x8800) >> 10) | ((t & 0x8800) >> 9));
     MP() = HL() + 1;
     HL() = (u16)t;
-    F() = ((t & 0x10000) ? F_CARRY : 0) | F_NEG | kOverflowSub[x >> 4] | (H() & (F_3 | F_5 | F_SIGN))
+    newF() = ((t & 0x10000) ? F_CARRY : 0) | F_NEG | kOverflowSub[x >> 4] | (H() & (F_3 | F_5 | F_SIGN))
         | kHalfCarrySub[x & 0x07] | (HL() ? 0 : F_ZERO);
 }
 
@@ -261,9 +377,7 @@ void Z80::cpReg8(u8& reg)
     // N: Set
     // C: Set if borrowed (r > A)
     u16 t = (int)A() - reg;
-    u8 x = (u8)(((A() & 0x88) >> 3) | ((reg & 0x88) >> 2) | ((t & 0x88) >> 1));
-    F() = ((t & 0x100) ? F_CARRY : (t ? 0 : F_ZERO)) | F_NEG | kHalfCarrySub[x & 7] | kOverflowSub[x >> 4] |
-        (reg & (F_3 | F_5)) | ((u8)t & F_SIGN);
+    lazyFlags(kFlagsCp, A(), reg, t);
 }
 
 void Z80::andReg8(u8& reg)
@@ -275,7 +389,7 @@ void Z80::andReg8(u8& reg)
     // P: Overflow
     // N: Reset
     // C: Reset
-    F() = F_HALF | m_SZ53P[A()];
+    lazyFlags(kFlagsLogic, F_HALF, 0, A());
 }
 
 void Z80::orReg8(u8& reg)
@@ -287,7 +401,7 @@ void Z80::orReg8(u8& reg)
     // P: Overflow
     // N: Reset
     // C: Reset
-    F() = m_SZ53P[A()];
+    lazyFlags(kFlagsLogic, 0, 0, A());
 }
 
 void Z80::xorReg8(u8& reg)
@@ -299,7 +413,7 @@ void Z80::xorReg8(u8& reg)
     // P: Overflow
     // N: Reset
     // C: Reset
-    F() = m_SZ53P[A()];
+    lazyFlags(kFlagsLogic, 0, 0, A());
 }
 
 //         +-------------------------------------+
@@ -315,7 +429,7 @@ void Z80::rlcReg8(u8& reg)
     // N: Reset
     // C: bit 7
     reg = ((reg << 1) | (reg >> 7));
-    F() = (reg & F_CARRY) | m_SZ53P[reg];
+    newF() = (reg & F_CARRY) | m_SZ53P[reg];
 }
 
 //  +-------------------------------------+
@@ -330,7 +444,7 @@ void Z80::rrcReg8(u8& reg)
     // P: Set on even parity
     // N: Reset
     // C: bit 0
-    F() = reg & F_CARRY;
+    newF() = reg & F_CARRY;
     reg = ((reg >> 1) | (reg << 7));
     F() |= m_SZ53P[reg];
 }
@@ -348,8 +462,8 @@ void Z80::rlReg8(u8& reg)
     // N: Reset
     // C: bit 7
     u8 t = reg;
-    reg = ((reg << 1) | (F() & F_CARRY));
-    F() = (t >> 7) | m_SZ53P[reg];
+    reg = ((reg << 1) | carryFlag());
+    newF() = (t >> 7) | m_SZ53P[reg];
 }
 
 //  +-----------------------------------------------+
@@ -365,8 +479,8 @@ void Z80::rrReg8(u8& reg)
     // N: Reset
     // C: bit 0
     u8 t = reg;
-    reg = ((reg >> 1) | (F() << 7));
-    F() = (t & F_CARRY) | m_SZ53P[reg];
+    reg = ((reg >> 1) | (carryFlag() << 7));
+    newF() = (t & F_CARRY) | m_SZ53P[reg];
 }
 
 //  +---+     +---+---+---+---+---+---+---+---+
@@ -380,7 +494,7 @@ void Z80::slaReg8(u8& reg)
     // P: Set on even parity
     // N: Reset
     // C: bit 7
-    F() = reg >> 7;
+    newF() = reg >> 7;
     reg = (reg << 1);
     F() |= m_SZ53P[reg];
 }
@@ -399,7 +513,7 @@ void Z80::sraReg8(u8& reg)
     // P: Set on even parity
     // N: Reset
     // C: bit 0
-    F() = reg & F_CARRY;
+    newF() = reg & F_CARRY;
     reg = ((reg & 0x80) | (reg >> 1));
     F() |= m_SZ53P[reg];
 }
@@ -415,7 +529,7 @@ void Z80::sl1Reg8(u8& reg)
     // P: Set on even parity
     // N: Reset
     // C: bit 7
-    F() = reg >> 7;
+    newF() = reg >> 7;
     reg = ((reg << 1) | 0x01);
     F() |= m_SZ53P[reg];
 }
@@ -431,7 +545,7 @@ void Z80::srlReg8(u8& reg)
     // P: Set on even parity
     // N: Reset
     // C: bit 0
-    F() = reg & F_CARRY;
+    newF() = reg & F_CARRY;
     reg = (reg >> 1);
     F() |= m_SZ53P[reg];
 }
@@ -444,7 +558,8 @@ void Z80::bitReg8(u8& reg, int b)
     // P: Undefined (same as Z)
     // N: Reset
     // C: Preserved
-    F() = (F() & F_CARRY) | F_HALF | (reg & (F_3 | F_5));
+    u8 carry = carryFlag();
+    newF() = carry | F_HALF | (reg & (F_3 | F_5));
     if (!(reg & (1 << b))) F() |= F_PARITY | F_ZERO;
     if ((b == 7) && (reg & 0x80)) F() |= F_SIGN;
 }
@@ -457,7 +572,8 @@ void Z80::bitReg8MP(u8& reg, int b)
     // P: Undefined (same as Z)
     // N: Reset
     // C: Preserved
-    F() = (F() & F_CARRY) | F_HALF | (m_mp.h & (F_3 | F_5));
+    u8 carry = carryFlag();
+    newF() = carry | F_HALF | (m_mp.h & (F_3 | F_5));
     if (!(reg & (1 << b))) F() |= F_PARITY | F_ZERO;
     if ((b == 7) && (reg & 0x80)) F() |= F_SIGN;
 }
@@ -512,144 +628,110 @@ int Z80::displacement(u8 x)
     return (128 ^ (int)x) - 128;
 }
 
-u16 Z80::pop(TState& inOutTState)
+template <typename Bus>
+u16 Z80Core<Bus>::pop(TState& inOutTState)
 {
     u16 x = m_ext.peek16(SP(), inOutTState);
     SP() += 2;
     return x;
 }
 
-void Z80::push(u16 x, TState& inOutTState)
+template <typename Bus>
+void Z80Core<Bus>::push(u16 x, TState& inOutTState)
 {
     Reg r(x);
     m_ext.poke(--SP(), r.h, inOutTState);
     m_ext.poke(--SP(), r.l, inOutTState);
 }
 
+
 //----------------------------------------------------------------------------------------------------------------------
-// z80Step
-// Run a single instruction
+// Operand decoding
+// All of these are parameterised on fields of the opcode so that they resolve at compile time.
 //----------------------------------------------------------------------------------------------------------------------
 
-u8& Z80::getReg8(u8 y)
+template <int R>
+u8& Z80::reg8()
 {
-    static u8 dummy = 0;
-
-    switch (y)
-    {
-    case 0:     return B();
-    case 1:     return C();
-    case 2:     return D();
-    case 3:     return E();
-    case 4:     return H();
-    case 5:     return L();
-    case 7:     return A();
-
-    default:    assert(0);
-                return dummy;
-    }
+    static_assert(R >= 0 && R < 8 && R != 6, "Register index 6 is (HL) and must be handled by the caller");
+
+    if constexpr (R == 0)       return B();
+    else if constexpr (R == 1)  return C();
+    else if constexpr (R == 2)  return D();
+    else if constexpr (R == 3)  return E();
+    else if constexpr (R == 4)  return H();
+    else if constexpr (R == 5)  return L();
+    else                        return A();
 }
 
-u16& Z80::getReg16_1(u8 p)
+template <int P>
+u16& Z80::reg16_1()
 {
-    switch (p)
-    {
-    case 0: return BC();
-    case 1: return DE();
-    case 2: return HL();
-    case 3: return SP();
-    }
-
-    static u16 _;
-    return _;
+    if constexpr (P == 0)       return BC();
+    else if constexpr (P == 1)  return DE();
+    else if constexpr (P == 2)  return HL();
+    else                        return SP();
 }
 
-
-u16& Z80::getReg16_2(u8 p)
+template <int P>
+u16& Z80::reg16_2()
 {
-    switch (p)
-    {
-    case 0: return BC();
-    case 1: return DE();
-    case 2: return HL();
-    case 3: return AF();
-    }
-
-    static u16 _;
-    return _;
+    if constexpr (P == 0)       return BC();
+    else if constexpr (P == 1)  return DE();
+    else if constexpr (P == 2)  return HL();
+    else                        return AF();
 }
 
-bool Z80::getFlag(u8 y, u8 flags)
+template <int Y>
+bool Z80::condition()
 {
-    switch (y)
-    {
-    case 0: return (!(flags & F_ZERO)) != 0;
-    case 1: return (flags & F_ZERO) != 0;
-    case 2: return (!(flags & F_CARRY)) != 0;
-    case 3: return (flags & F_CARRY) != 0;
-    case 4: return (!(flags & F_PARITY)) != 0;
-    case 5: return (flags & F_PARITY) != 0;
-    case 6: return (!(flags & F_SIGN)) != 0;
-    case 7: return (flags & F_SIGN) != 0;
-    }
-
-    return true;
+    // Every lazy operation sets Z and S from its 8-bit result.
+    if constexpr (Y == 0)       return m_flagOp ? (u8)m_flagResult != 0 : !(m_af.l & F_ZERO);
+    else if constexpr (Y == 1)  return m_flagOp ? (u8)m_flagResult == 0 : (m_af.l & F_ZERO) != 0;
+    else if constexpr (Y == 2)  return !carryFlag();
+    else if constexpr (Y == 3)  return carryFlag() != 0;
+    else if constexpr (Y == 4)  return !(F() & F_PARITY);
+    else if constexpr (Y == 5)  return (F() & F_PARITY) != 0;
+    else if constexpr (Y == 6)  return m_flagOp ? !(m_flagResult & 0x80) : !(m_af.l & F_SIGN);
+    else                        return m_flagOp ? (m_flagResult & 0x80) != 0 : (m_af.l & F_SIGN) != 0;
 }
 
-
-Z80::ALUFunc Z80::getAlu(u8 y)
+template <int Y>
+void Z80::alu(u8& reg)
 {
-    static ALUFunc funcs[8] =
-    {
-        std::bind(&Z80::addReg8, this, std::placeholders::_1),
-        std::bind(&Z80::adcReg8, this, std::placeholders::_1),
-        std::bind(&Z80::subReg8, this, std::placeholders::_1),
-        std::bind(&Z80::sbcReg8, this, std::placeholders::_1),
-        std::bind(&Z80::andReg8, this, std::placeholders::_1),
-        std::bind(&Z80::xorReg8, this, std::placeholders::_1),
-        std::bind(&Z80::orReg8, this, std::placeholders::_1),
-        std::bind(&Z80::cpReg8, this, std::placeholders::_1),
-    };
-
-    return funcs[y];
-};
+    if constexpr (Y == 0)       addReg8(reg);
+    else if constexpr (Y == 1)  adcReg8(reg);
+    else if constexpr (Y == 2)  subReg8(reg);
+    else if constexpr (Y == 3)  sbcReg8(reg);
+    else if constexpr (Y == 4)  andReg8(reg);
+    else if constexpr (Y == 5)  xorReg8(reg);
+    else if constexpr (Y == 6)  orReg8(reg);
+    else                        cpReg8(reg);
+}
 
-Z80::RotShiftFunc Z80::getRotateShift(u8 y)
+template <int Y>
+void Z80::rotateShift(u8& reg)
 {
-    static RotShiftFunc funcs[8] =
-    {
-        std::bind(&Z80::rlcReg8, this, std::placeholders::_1),
-        std::bind(&Z80::rrcReg8, this, std::placeholders::_1),
-        std::bind(&Z80::rlReg8, this, std::placeholders::_1),
-        std::bind(&Z80::rrReg8, this, std::placeholders::_1),
-        std::bind(&Z80::slaReg8, this, std::placeholders::_1),
-        std::bind(&Z80::sraReg8, this, std::placeholders::_1),
-        std::bind(&Z80::sl1Reg8, this, std::placeholders::_1),
-        std::bind(&Z80::srlReg8, this, std::placeholders::_1),
-    };
-
-    return funcs[y];
+    if constexpr (Y == 0)       rlcReg8(reg);
+    else if constexpr (Y == 1)  rrcReg8(reg);
+    else if constexpr (Y == 2)  rlReg8(reg);
+    else if constexpr (Y == 3)  rrReg8(reg);
+    else if constexpr (Y == 4)  slaReg8(reg);
+    else if constexpr (Y == 5)  sraReg8(reg);
+    else if constexpr (Y == 6)  sl1Reg8(reg);
+    else                        srlReg8(reg);
 }
 
-
 #define PEEK(a) m_ext.peek((a), tState)
 #define POKE(a, b) m_ext.poke((a), (b), tState)
 #define PEEK16(a) m_ext.peek16((a), tState)
 #define POKE16(a, w) m_ext.poke16((a), (w), tState)
 #define CONTEND(a, t, n) m_ext.contend((a), (t), (n), tState)
 
-void Z80::decodeInstruction(u8 opCode, u8& x, u8& y, u8& z, u8& p, u8& q)
-{
-    x = (opCode & 0xc0) >> 6;
-    y = (opCode & 0x38) >> 3;
-    z = (opCode & 0x07);
-    p = (y & 6) >> 1;
-    q = (y & 1);
-}
-
-u8 Z80::fetchInstruction(i64& tState)
+template <typename Bus>
+u8 Z80Core<Bus>::fetchInstruction(TState& tState)
 {
-    // Fetch opcode and decode it.  The opcode can be viewed as XYZ fields with Y being sub-decoded to PQ fields:
+    // Fetch opcode.  The opcode can be viewed as XYZ fields with Y being sub-decoded to PQ fields:
     //
     //    7   6   5   4   3   2   1   0
     //  +---+---+---+---+---+---+---+---+
@@ -658,6 +740,8 @@ u8 Z80::fetchInstruction(i64& tState)
     //  |       |   P   | Q |           |
     //  +---+---+---+---+---+---+---+---+
     //
+    // Decoding is done at compile time: each opcode indexes a table of handlers that have been specialised on
+    // these fields.
     //
     // See http://www.z80.info/decoding.htm
     //
@@ -668,878 +752,305 @@ u8 Z80::fetchInstruction(i64& tState)
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-// Basic opcode interpretation
+// Block instructions
+// A repeating block instruction (LDIR, CPIR, INIR, OTIR...) rewinds PC so that it is fetched and executed again on the
+// next step.  If the bus allows it, the next iteration is run straight away instead, saving the machine an update per
+// byte.  The re-fetch is still timed exactly so the result is the same as stepping.
 //----------------------------------------------------------------------------------------------------------------------
 
-#define II idx.r
-#define IH idx.h
-#define IL idx.l
-
-void Z80::executeDDFDCB(Reg& idx, i64& tState)
+template <typename Bus>
+bool Z80Core<Bus>::repeatBlock(TState& tState, TState limit, u16 address1, u16 address2)
 {
-    u8 x, y, z;
-    u8 opCode;
+    if (tState >= limit || !m_ext.isBlockSafe(address1) || !m_ext.isBlockSafe(address2)) return false;
 
-    CONTEND(PC(), 3, 1);
-    MP() = II + (i8)m_ext.peek(PC());
-    ++PC();
-    CONTEND(PC(), 3, 1);
-    opCode = m_ext.peek(PC());
-    CONTEND(PC(), 1, 2);
-    ++PC();
+    // Fetch the ED prefix and opcode again.
+    u8 r = R();
+    R() = (r & 0x80) | ((r + 2) & 0x7f);
+    CONTEND(PC(), 4, 1);
+    CONTEND(PC() + 1, 4, 1);
+    PC() += 2;
+    return true;
+}
 
-    x = (opCode & 0xc0) >> 6;
-    y = (opCode & 0x38) >> 3;
-    z = (opCode & 0x07);
+//----------------------------------------------------------------------------------------------------------------------
+// Predecoded instructions
+// Prefixed instructions go through two or three handlers before reaching the one that does the work.  The bus can
+// keep the final handler for each instruction so that this only happens the first time it runs.  Operands are still
+// read by the handlers as each read has its own timing.
+//----------------------------------------------------------------------------------------------------------------------
 
-    u8* r = 0;
-    u8 v = 0;
+// CB, DD, ED or FD
+static bool isPrefix(u8 op)
+{
+    return op == 0xcb || (op != 0xcd && (op & 0xcf) == 0xcd);
+}
 
-    switch (x)
+template <typename Bus>
+u16 Z80Core<Bus>::decode(u16 pc)
+{
+    u8 op = m_ext.peek(pc);
+    u8 op2 = m_ext.peek(pc + 1);
+    switch (op)
     {
-    case 0:     // LD R[z],rot/shift[y] (IX+d)      or rot/shift[y] (IX+d) (z == 6)
-        r = (z == 6) ? &v : &getReg8(z);
-        *r = PEEK(MP());
-        CONTEND(MP(), 1, 1);
-        getRotateShift(y)(*r);
-        POKE(MP(), *r);
-        break;
-
-    case 1:     // BIT y,(IX+d)
-        v = PEEK(MP());
-        CONTEND(MP(), 1, 1);
-        bitReg8MP(v, y);
-        break;
+    case 0xcb:  return kDecodedCB | op2;
+    case 0xed:  return kDecodedED | op2;
 
-    case 2:     // LD R[z],RES y,(IX+d)             or RES y,(IX+d)  (z == 6)
-        r = (z == 6) ? &v : &getReg8(z);
-        *r = PEEK(MP());
-        resReg8(*r, y);
-        CONTEND(MP(), 1, 1);
-        POKE(MP(), *r);
-        break;
+    case 0xdd:
+    case 0xfd:
+        if (op2 == 0xdd || op2 == 0xfd || op2 == 0xed) return kNotDecoded;
+        if (op2 == 0xcb)
+        {
+            u8 op4 = m_ext.peek(pc + 3);
+            if (op == 0xdd) return kDecodedDDCB | op4; else return kDecodedFDCB | op4;
+        }
+        if (op == 0xdd) return kDecodedDD | op2; else return kDecodedFD | op2;
 
-    case 3:     // LD R[z],SET y,(IX+d)             or SET y,(IX+d)  (z == 6)
-        r = (z == 6) ? &v : &getReg8(z);
-        *r = PEEK(MP());
-        setReg8(*r, y);
-        CONTEND(MP(), 1, 1);
-        POKE(MP(), *r);
-        break;
+    default:
+        assert(0);
+        return kNotDecoded;
     }
 }
 
-void Z80::executeDDFD(Reg& idx, i64& tState)
+template <typename Bus>
+bool Z80Core<Bus>::executeDecoded(TState& tState)
 {
-    u8 x, y, z, p, q;
-    u8 opCode = fetchInstruction(tState);
-    decodeInstruction(opCode, x, y, z, p, q);
-
-    i8 d = 0;
-    u8 v = 0;
-    u16 tt = 0;
-    u8* r = 0;
-    u16* rr = 0;
-
-    switch (x)
-    {
-    case 0: // x = 0
-        switch (z)
-        {
-        case 1:
-            if (0 == q)
-            {
-                // 21 - LD IX,nn
-                if (2 == p)
-                {
-                    II = PEEK16(PC());
-                    PC() += 2;
-                }
-                else goto invalid_instruction;
-            }
-            else
-            {
-                // 09 19 29 39 - ADD IX,BC/DE/IX/SP
-                CONTEND(IR(), 1, 7);
-                MP() = II + 1;
-                rr = &getReg16_1(p);
-                rr = (rr == &HL()) ? &II : rr;
-                addReg16(II, *rr);
-            }
-            break;
+    // The prefix has already been fetched.
+    u16 pc = PC() - 1;
+    u16* slot = m_ext.decodeSlot(pc);
+    if (!slot) return false;
+    if (!*slot) *slot = m_ext.canDecode(pc) ? decode(pc) : kNotDecoded;
 
-        case 2:
-            if (2 == p)
-            {
-                if (0 == q)
-                {
-                    // 22 - LD (nn),IX
-                    tt = PEEK16(PC());
-                    POKE16(tt, II);
-                    MP() = tt + 1;
-                    PC() += 2;
-                }
-                else
-                {
-                    // 2A - LD IX,(nn)
-                    tt = PEEK16(PC());
-                    II = PEEK16(tt);
-                    PC() += 2;
-                    MP() = tt + 1;
-                }
-            }
-            else
-            {
-                goto invalid_instruction;
-            }
-            break;
+    u16 decoded = *slot;
+    if (decoded == kNotDecoded) return false;
+    u8 op = (u8)decoded;
 
-        case 3:
-            if (p == 2)
-            {
-                if (0 == q)
-                {
-                    // 23 - INC IX
-                    CONTEND(IR(), 1, 2);
-                    ++II;
-                }
-                else
-                {
-                    // 2B - DEC IX
-                    CONTEND(IR(), 1, 2);
-                    --II;
-                }
-            }
-            else goto invalid_instruction;
-            break;
+    u8 r = R();
+    R() = (r & 0x80) | ((r + 1) & 0x7f);
+    CONTEND(PC(), 4, 1);
+    ++PC();
 
-        case 4:
-            switch (y)
-            {
-            case 4: // 24 - INC IXH
-                incReg8(IH);
-                break;
+    switch (decoded & 0xff00)
+    {
+    case kDecodedCB:    (this->*kCBOps[op])(tState);    break;
+    case kDecodedED:    (this->*kEDOps[op])(tState);    break;
+    case kDecodedDD:    (this->*kDDOps[op])(tState);    break;
+    case kDecodedFD:    (this->*kFDOps[op])(tState);    break;
 
-            case 5: // 2C - INC IXL
-                incReg8(IL);
-                break;
+    default:
+        {
+            // DDCB/FDCB: the displacement and opcode reads done by the DD/FD handler.
+            u16 idx = (decoded & 0xff00) == kDecodedDDCB ? IX() : IY();
+            CONTEND(PC(), 3, 1);
+            MP() = idx + (i8)m_ext.peek(PC());
+            ++PC();
+            CONTEND(PC(), 3, 1);
+            CONTEND(PC(), 1, 2);
+            ++PC();
+            (this->*kDDFDCBOps[op])(tState);
+        }
+        break;
+    }
 
-            case 6: // 34 - INC (IX+d)
-                d = PEEK(PC());
-                CONTEND(PC(), 1, 5);
-                ++PC();
-                MP() = II + d;
-                v = PEEK(MP());
-                CONTEND(MP(), 1, 1);
-                incReg8(v);
-                POKE(MP(), v);
-                break;
+    return true;
+}
 
-            default:
-                goto invalid_instruction;
-            }
-            break;
+//----------------------------------------------------------------------------------------------------------------------
+// Decoded-block cache
+// Blocks are decoded while running the instructions normally.  Running one again does what step() does for each of them
+// apart from the checks that can't change anything mid-block: interrupts only arrive between calls to run(), and
+// the bus only gives out slots when there are no breakpoints to check.
+//----------------------------------------------------------------------------------------------------------------------
 
-        case 5:
-            switch (y)
-            {
-            case 4: // 25 - DEC IXH
-                decReg8(IH);
-                break;
+template <typename Bus>
+void Z80Core<Bus>::runDecodedBlock(u16& slot, TState& tState, TState until)
+{
+    const u64* version = m_ext.codeVersion(PC());
+    if (!slot || slot > m_decodedBlocks.size() || m_decodedBlocks[slot - 1].pc != PC())
+    {
+        decodeBlock(slot, tState, until, kMinStaleLimit);
+        return;
+    }
 
-            case 5: // 2D - DEC IXL
-                decReg8(IL);
-                break;
+    DecodedBlock& block = m_decodedBlocks[slot - 1];
+    if (block.version != *version && isSameCode(block))
+    {
+        // Something else near the block was written.
+        block.version = *version;
+    }
+    if (block.version != *version)
+    {
+        if (++block.numStaleRuns >= block.staleLimit)
+        {
+            u32 staleLimit = block.staleLimit < kMaxStaleLimit ? block.staleLimit * 2 : block.staleLimit;
+            block.numStaleRuns = 0;
+            decodeBlock(slot, tState, until, staleLimit);
+        }
+        else
+        {
+            m_instructionStart = tState;
+            step(tState);
+        }
+        return;
+    }
 
-            case 6: // 35 - DEC (IX+d)
-                d = PEEK(PC());
-                CONTEND(PC(), 1, 5);
-                ++PC();
-                MP() = II + d;
-                v = PEEK(MP());
-                CONTEND(MP(), 1, 1);
-                decReg8(v);
-                POKE(MP(), v);
-                break;
+    const DecodedOp* op = &m_decodedOps[block.firstOp];
+    const DecodedOp* end = op + block.numOps;
+    m_nmi = false;
 
-            default:
-                goto invalid_instruction;
-            }
-            break;
+    for (;;)
+    {
+        m_instructionStart = tState;
+        m_eiHappened = false;
 
-        case 6: // z = 6
-            switch (y)
-            {
-            case 4: // 26 - LD IXH,n
-                IH = PEEK(PC()++);
-                break;
+        u8 r = R();
+        R() = (r & 0x80) | ((r + op->numFetches) & 0x7f);
+        tState += 4 * op->numFetches;
+        PC() = op->pc + op->numFetches;
 
-            case 5: // 2E - LD IXL,n
-                IL = PEEK(PC()++);
-                break;
+        if (op->index)
+        {
+            // The displacement and opcode reads done by the DD/FD handler.
+            MP() = (op->index == 1 ? IX() : IY()) + (i8)m_ext.peek(PC());
+            PC() += 2;
+            tState += 8;
+        }
 
-            case 6: // 36 - LD (IX+d),n
-                d = PEEK(PC()++);
-                v = PEEK(PC());
-                CONTEND(PC(), 1, 2);
-                ++PC();
-                MP() = II + d;
-                POKE(MP(), v);
-                break;
+        (this->*op->handler)(tState);
+        if (++op == end || tState >= until || PC() != op->pc || *version != block.version) break;
+    }
+}
 
-            default:
-                goto invalid_instruction;
-            }
-            break;
+template <typename Bus>
+void Z80Core<Bus>::decodeBlock(u16& slot, TState& tState, TState until, u32 staleLimit)
+{
+    if (m_decodedBlocks.size() == kMaxDecodedBlocks)
+    {
+        // Start again.  Slots still holding old indices fail the pc and version checks.
+        m_decodedBlocks.clear();
+        m_decodedOps.clear();
+        m_decodedBytes.clear();
+    }
 
-        default:
-            goto invalid_instruction;
-        } // switch(z), x = 0
-        break;
+    u16 start = PC();
+    int size = m_ext.blockSize(start);
+    DecodedBlock block = { *m_ext.codeVersion(start), start, 0, (u32)m_decodedOps.size(), (u32)m_decodedBytes.size(),
+        0, 0, staleLimit };
+    bool complete = false;
 
-    case 1: // x = 1
-        // LD R,R
-        if (y != 6 || z != 6)
+    while (block.numOps < kMaxDecodedOps && u16(PC() - start) + 4 <= size)
+    {
+        u16 pc = PC();
+        DecodedOp op = { kBaseOps[m_ext.peek(pc)], pc, 1, 0 };
+        if (isPrefix(m_ext.peek(pc)))
         {
-            u8* r1 = 0;
-            u8* r2 = 0;
+            u16 decoded = decode(pc);
+            if (decoded == kNotDecoded) break;
 
-            switch (y)
+            u8 opCode = (u8)decoded;
+            op.numFetches = 2;
+            switch (decoded & 0xff00)
             {
-            case 4:     // LD IXH,R
-            case 5:     // LD IXL,R
-                r1 = y == 4 ? &IH : &IL;
-                switch (z)
-                {
-                case 4:     r2 = &IH;   break;  // 64/6C - LD IXH/IXL,IXH
-                case 5:     r2 = &IL;   break;  // 65/6D - LD IXH/IXL,IXL
-                case 6:
-                    // 66/6E - LD H/L,(IX+d)
-                    r1 = &getReg8(y);
-                    d = PEEK(PC());
-                    CONTEND(PC(), 1, 5);
-                    ++PC();
-                    MP() = II + d;
-                    x = PEEK(MP());
-                    r2 = &x;
-                    break;
-
-                default:
-                    // LD IXH,R
-                    r2 = &getReg8(z);
-                }
-                break;
-
-            case 6:     // LD (IX+d),R
-                d = PEEK(PC());
-                CONTEND(PC(), 1, 5);
-                ++PC();
-                MP() = II + d;
-                POKE(MP(), getReg8(z));
-                break;
-
-            default:
-                switch (z)
-                {
-                case 4:     // LD R,IXH
-                case 5:     // LD R,IXL
-                    r2 = z == 4 ? &IH : &IL;
-                    r1 = &getReg8(y);
-                    break;
-
-                case 6:     // LD R,(IX+d)
-                    r1 = &getReg8(y);
-                    d = PEEK(PC());
-                    CONTEND(PC(), 1, 5);
-                    ++PC();
-                    MP() = II + d;
-                    x = PEEK(MP());
-                    r2 = &x;
-                    break;
-
-                default:
-                    goto invalid_instruction;
-                }
+            case kDecodedCB:    op.handler = kCBOps[opCode];                    break;
+            case kDecodedED:    op.handler = kEDOps[opCode];                    break;
+            case kDecodedDD:    op.handler = kDDOps[opCode];                    break;
+            case kDecodedFD:    op.handler = kFDOps[opCode];                    break;
+            case kDecodedDDCB:  op.handler = kDDFDCBOps[opCode]; op.index = 1;  break;
+            default:            op.handler = kDDFDCBOps[opCode]; op.index = 2;  break;
             }
-            if (r1) *r1 = *r2;
         }
-        else goto invalid_instruction;
-        break;
 
-    case 2: // x = 2
-        switch (z)
+        // Keep the code as it was when this instruction ran.  Instructions never start more than 4 bytes apart.
+        m_ext.addCode(pc, 4);
+        block.numBytes = u16(pc - start) + 4;
+        m_decodedBytes.resize(block.firstByte + block.numBytes);
+        for (int i = 0; i < 4; ++i)
         {
-        case 4: r = &IH; break;
-        case 5: r = &IL; break;
-        case 6:
-            d = PEEK(PC());
-            CONTEND(PC(), 1, 5);
-            ++PC();
-            MP() = II + d;
-            v = PEEK(MP());
-            r = &v;
-            break;
-
-        default:
-            goto invalid_instruction;
+            m_decodedBytes[block.firstByte + u16(pc - start) + i] = m_ext.peek(u16(pc + i));
         }
 
-        getAlu(y)(*r);
-        break;
+        m_instructionStart = tState;
+        step(tState);
+        m_decodedOps.push_back(op);
+        ++block.numOps;
 
-    case 3: // x = 3
-        switch (opCode)
+        // Jumps, calls, returns, repeats and halts all end the block.
+        if (m_halt || u16(PC() - pc - 1) > 3)
         {
-        case 0xcb:  // DDCB prefixes
-            executeDDFDCB(idx, tState);
-            break;
-
-        case 0xe1:  // POP IX
-            II = pop(tState);
+            complete = true;
             break;
-
-        case 0xe3:  // EX (SP),IX
-            {
-                Reg t;
-                t.l = PEEK(SP());
-                t.h = PEEK(SP() + 1);
-                CONTEND(SP() + 1, 1, 1);
-                POKE(SP() + 1, IH);
-                POKE(SP(), IL);
-                CONTEND(SP(), 1, 2);
-                II = MP() = t.r;
-            }
-            break;
-
-        case 0xe5:  // PUSH IX
-            CONTEND(IR(), 1, 1);
-            push(II, tState);
-            break;
-
-        case 0xe9:  // JP (IX)
-            PC() = II;
-            break;
-
-        case 0xf9:  // LD (SP),IX
-            CONTEND(IR(), 1, 2);
-            SP() = II;
-            break;
-
-        default:
-            goto invalid_instruction;
         }
-        break;
+        if (tState >= until) break;
     }
 
-    return;
+    // A block cut short by the time limit would stay short, so it is decoded again next time.
+    if (block.numOps && (complete || tState < until))
+    {
+        m_decodedBlocks.push_back(block);
+        slot = (u16)m_decodedBlocks.size();
+    }
+    else
+    {
+        m_decodedOps.resize(block.firstOp);
+        m_decodedBytes.resize(block.firstByte);
+        if (!block.numOps)
+        {
+            m_instructionStart = tState;
+            step(tState);
+        }
+    }
+}
 
-invalid_instruction:
-    execute(opCode, tState);
-    return;
+template <typename Bus>
+bool Z80Core<Bus>::isSameCode(const DecodedBlock& block)
+{
+    const u8* bytes = &m_decodedBytes[block.firstByte];
+    for (u16 i = 0; i < block.numBytes; ++i)
+    {
+        if (m_ext.peek(u16(block.pc + i)) != bytes[i]) return false;
+    }
+    return true;
 }
 
-void Z80::executeED(i64& tState)
+//----------------------------------------------------------------------------------------------------------------------
+// Basic opcode interpretation
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename Bus>
+template <int X, int Y, int Z>
+void Z80Core<Bus>::executeBase(TState& tState)
 {
-    u8 x, y, z, p, q;
-    u8 opCode = fetchInstruction(tState);
-    decodeInstruction(opCode, x, y, z, p, q);
+    constexpr int P = Y >> 1;
+    constexpr int Q = Y & 1;
 
-    u8* r = 0;
-    u8 v = 0;
+    // Opcode hex calculated from:
+    //
+    //      X = $00, $40, $80, $c0
+    //      Y = add: $08, $10, $18, $20, $28, $30, $38
+    //      Z = add: Z
+    //      P = add: $00, $10, $20, $30
+    //      Q = add: $00, $08
 
-    switch (x)
+    if constexpr (X == 0)
     {
-    case 0:     // x = 0: 00-3F
-        goto invalid_instruction;
-
-    case 1:     // x = 1: 40-7F
-        switch (z)
+        if constexpr (Z == 0)
         {
-        case 0:
-            r = (y == 6) ? &v : &getReg8(y);
-            MP() = BC() + 1;
-            *r = m_ext.in(BC(), tState);
-            NX_LOG_IN(BC(), *r);
-            F() = (F() & F_CARRY) | m_SZ53P[*r];
-            break;
-
-        case 1:
-            v = 0;
-            r = (y == 6) ? &v : &getReg8(y);
-            NX_LOG_OUT(BC(), *r);
-            m_ext.out(BC(), *r, tState);
-            MP() = BC() + 1;
-            break;
-
-        case 2:
-            if (0 == q)
-            {
-                // SBC HL,RR
-                CONTEND(IR(), 1, 7);
-                sbcReg16(getReg16_1(p));
-            }
-            else
+            if constexpr (Y == 0)
             {
-                // ADC HL,RR
-                CONTEND(IR(), 1, 7);
-                adcReg16(getReg16_1(p));
+                // 00 - NOP
             }
-            break;
-
-        case 3:
-            if (0 == q)
+            else if constexpr (Y == 1)
             {
-                // LD (nn),RR
-                u16 tt = PEEK16(PC());
-                u16* rr = &getReg16_1(p);
-                PC() += 2;
-                POKE16(tt, *rr);
-                MP() = tt + 1;
+                // 08 - EX AF,AF'
+                exAfAf();
             }
-            else
+            else if constexpr (Y == 2)
             {
-                // LD RR,(nn)
-                u16 tt = PEEK16(PC());
-                u16* rr = &getReg16_1(p);
-                PC() += 2;
-                *rr = PEEK16(tt);
-                MP() = tt + 1;
-            }
-            break;
-
-        case 4: // NEG
-            v = A();
-            A() = 0;
-            subReg8(v);
-            break;
-
-        case 5: // RETI & RETN
-            IFF1() = IFF2();
-            PC() = pop(tState);
-            MP() = PC();
-            break;
-
-        case 6: // IM ?
-            y &= 3;
-            IM() = (y == 0) ? 0 : y - 1;
-            break;
-
-        case 7:
-            switch (y)
-            {
-            case 0: // LD I,A()
-                CONTEND(IR(), 1, 1);
-                I() = A();
-                break;
-
-            case 1: // LD R,A()
-                CONTEND(IR(), 1, 1);
-                R() = A();
-                break;
-
-            case 2: // LD A(),I
-                CONTEND(IR(), 1, 1);
-                A() = I();
-                F() = (F() & F_CARRY) | m_SZ53[A()] | (IFF2() ? F_PARITY : 0);
-                // #todo: handle IFF2 event
-                break;
-
-            case 3: // LD A(),R
-                CONTEND(IR(), 1, 1);
-                A() = R();
-                F() = (F() & F_CARRY) | m_SZ53[A()] | (IFF2() ? F_PARITY : 0);
-                break;
-
-            case 4: // RRD
-                v = PEEK(HL());
-                CONTEND(HL(), 1, 4);
-                POKE(HL(), (A() << 4) | (v >> 4));
-                A() = (A() & 0xf0) | (v & 0x0f);
-                F() = (F() & F_CARRY) | m_SZ53P[A()];
-                MP() = HL() + 1;
-                break;
-
-            case 5: // RLD
-                v = PEEK(HL());
-                CONTEND(HL(), 1, 4);
-                POKE(HL(), (v << 4) | (A() & 0x0f));
-                A() = (A() & 0xf0) | (v >> 4);
-                F() = (F() & F_CARRY) | m_SZ53P[A()];
-                MP() = HL() + 1;
-                break;
-
-            case 6:
-            case 7: // NOP
-                break;
-            }
-            break;
-        }
-        break;
-
-    case 2:     // x = 2: 80-BF
-        switch (opCode)
-        {
-        case 0xa0:  // LDI
-            v = PEEK(HL());
-            --BC();
-            POKE(DE(), v);
-            CONTEND(DE(), 1, 2);
-            ++DE();
-            ++HL();
-            v += A();
-            F() = (F() & (F_CARRY | F_ZERO | F_SIGN)) | (BC() ? F_PARITY : 0) |
-                (v & F_3) | ((v & 0x02) ? F_5 : 0);
-            break;
-
-        case 0xa1:  // CPI
-            {
-                v = PEEK(HL());
-                u8 t = A() - v;
-                u8 lookup = ((A() & 0x08) >> 3) | ((v & 0x08) >> 2) | ((t & 0x08) >> 1);
-                CONTEND(HL(), 1, 5);
-                ++HL();
-                --BC();
-                F() = (F() & F_CARRY) | (BC() ? (F_PARITY | F_NEG) : F_NEG) |
-                    kHalfCarrySub[lookup] | (t ? 0 : F_ZERO) | (t & F_SIGN);
-                if (F() & F_HALF) --t;
-                F() |= (t & F_3) | ((t & 0x02) ? F_5 : 0);
-                ++MP();
-            }
-            break;
-
-        case 0xa2:  // INI
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = m_ext.in(BC(), tState);
-                NX_LOG_IN(BC(), t1);
-                POKE(HL(), t1);
-                MP() = BC() + 1;
-                --B();
-                ++HL();
-                t2 = t1 + C() + 1;
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-            }
-            break;
-
-        case 0xa3:  // OUTI
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = PEEK(HL());
-                --B();
-                MP() = BC() + 1;
-                m_ext.out(BC(), t1, tState);
-                ++HL();
-                t2 = t1 + L();
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-            }
-            break;
-
-        case 0xa8:  // LDD
-            v = PEEK(HL());
-            --BC();
-            POKE(DE(), v);
-            CONTEND(DE(), 1, 2);
-            --DE();
-            --HL();
-            v += A();
-            F() = (F() & (F_CARRY | F_ZERO | F_SIGN)) | (BC() ? F_PARITY : 0) |
-                (v & F_3) | ((v & 0x02) ? F_5 : 0);
-            break;
-
-        case 0xa9:  // CPD
-            {
-                v = PEEK(HL());
-                u8 t = A() - v;
-                u8 lookup = ((A() & 0x08) >> 3) | ((v & 0x08) >> 2) | ((t & 0x08) >> 1);
-                CONTEND(HL(), 1, 5);
-                --HL();
-                --BC();
-                F() = (F() & F_CARRY) | (BC() ? (F_PARITY | F_NEG) : F_NEG) |
-                    kHalfCarrySub[lookup] | (t ? 0 : F_ZERO) | (t & F_SIGN);
-                if (F() & F_HALF) --t;
-                F() |= (t & F_3) | ((t & 0x02) ? F_5 : 0);
-                --MP();
-            }
-            break;
-
-        case 0xaa:  // IND
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = m_ext.in(BC(), tState);
-                NX_LOG_IN(BC(), t1);
-                POKE(HL(), t1);
-                MP() = BC() - 1;
-                --B();
-                --HL();
-                t2 = t1 + C() - 1;
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-            }
-            break;
-
-        case 0xab:  // OUTD
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = PEEK(HL());
-                --B();
-                MP() = BC() - 1;
-                NX_LOG_OUT(BC(), t1);
-                m_ext.out(BC(), t1, tState);
-                --HL();
-                t2 = t1 + L();
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-            }
-            break;
-
-        case 0xb0:  // LDIR
-            v = PEEK(HL());
-            POKE(DE(), v);
-            CONTEND(DE(), 1, 2);
-            --BC();
-            v += A();
-            F() = (F() & (F_CARRY | F_ZERO | F_SIGN)) | (BC() ? F_PARITY : 0) |
-                (v & F_3) | ((v & 0x02) ? F_5 : 0);
-            if (BC())
-            {
-                CONTEND(DE(), 1, 5);
-                PC() -= 2;
-                MP() = PC() + 1;
-            }
-            ++DE();
-            ++HL();
-            break;
-
-        case 0xb1:  // CPIR
-            {
-                v = PEEK(HL());
-                u8 t = A() - v;
-                u8 lookup = ((A() & 0x08) >> 3) | ((v & 0x08) >> 2) | ((t & 0x08) >> 1);
-                CONTEND(HL(), 1, 5);
-                --BC();
-                F() = (F() & F_CARRY) | (BC() ? (F_PARITY | F_NEG) : F_NEG) |
-                    kHalfCarrySub[lookup] | (t ? 0 : F_ZERO) | (t & F_SIGN);
-                if (F() & F_HALF) --t;
-                F() |= (t & F_3) | ((t & 0x02) ? F_5 : 0);
-                if ((F() & (F_PARITY | F_ZERO)) == F_PARITY)
-                {
-                    CONTEND(HL(), 1, 5);
-                    PC() -= 2;
-                    MP() = PC() + 1;
-                }
-                else
-                {
-                    ++MP();
-                }
-                ++HL();
-            }
-            break;
-
-        case 0xb2:  // INIR
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = m_ext.in(BC(), tState);
-                NX_LOG_IN(BC(), t1);
-                POKE(HL(), t1);
-                MP() = BC() + 1;
-                --B();
-                t2 = t1 + C() + 1;
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-                if (B())
-                {
-                    CONTEND(HL(), 1, 5);
-                    PC() -= 2;
-                }
-                ++HL();
-            }
-            break;
-
-        case 0xb3:  // OTIR
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = PEEK(HL());
-                --B();
-                MP() = BC() + 1;
-                NX_LOG_OUT(BC(), t1);
-                m_ext.out(BC(), t1, tState);
-                ++HL();
-                t2 = t1 + L();
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-                if (B())
-                {
-                    CONTEND(BC(), 1, 5);
-                    PC() -= 2;
-                }
-            }
-            break;
-
-        case 0xb8:  // LDDR
-            v = PEEK(HL());
-            POKE(DE(), v);
-            CONTEND(DE(), 1, 2);
-            --BC();
-            v += A();
-            F() = (F() & (F_CARRY | F_ZERO | F_SIGN)) | (BC() ? F_PARITY : 0) |
-                (v & F_3) | ((v & 0x02) ? F_5 : 0);
-            if (BC())
-            {
-                CONTEND(DE(), 1, 5);
-                PC() -= 2;
-                MP() = PC() + 1;
-            }
-            --DE();
-            --HL();
-            break;
-
-        case 0xb9:  // CPDR
-            {
-                v = PEEK(HL());
-                u8 t = A() - v;
-                u8 lookup = ((A() & 0x08) >> 3) | ((v & 0x08) >> 2) | ((t & 0x08) >> 1);
-                CONTEND(HL(), 1, 5);
-                --BC();
-                F() = (F() & F_CARRY) | (BC() ? (F_PARITY | F_NEG) : F_NEG) |
-                    kHalfCarrySub[lookup] | (t ? 0 : F_ZERO) | (t & F_SIGN);
-                if (F() & F_HALF) --t;
-                F() |= (t & F_3) | ((t & 0x02) ? F_5 : 0);
-                if ((F() & (F_PARITY | F_ZERO)) == F_PARITY)
-                {
-                    CONTEND(HL(), 1, 5);
-                    PC() -= 2;
-                    MP() = PC() + 1;
-                }
-                else
-                {
-                    --MP();
-                }
-                --HL();
-            }
-            break;
-
-        case 0xba:  // INDR
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = m_ext.in(BC(), tState);
-                NX_LOG_IN(BC(), t1);
-                POKE(HL(), t1);
-                MP() = BC() - 1;
-                --B();
-                t2 = t1 + C() - 1;
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-                if (B())
-                {
-                    CONTEND(HL(), 1, 5);
-                    PC() -= 2;
-                }
-                --HL();
-            }
-            break;
-
-        case 0xbb:  // OTDR
-            {
-                u8 t1, t2;
-                CONTEND(IR(), 1, 1);
-                t1 = PEEK(HL());
-                --B();
-                MP() = BC() - 1;
-                NX_LOG_OUT(BC(), t1);
-                m_ext.out(BC(), t1, tState);
-                --HL();
-                t2 = t1 + L();
-                F() = (t1 & 0x80 ? F_NEG : 0) |
-                    ((t2 < t1) ? F_HALF | F_CARRY : 0) |
-                    (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
-                    m_SZ53[B()];
-                if (B())
-                {
-                    CONTEND(BC(), 1, 5);
-                    PC() -= 2;
-                }
-            }
-            break;
-
-        default:
-            goto invalid_instruction;
-        }
-        break;
-
-    case 3:     // x = 3: C0-FF
-        goto invalid_instruction;
-    }
-
-    return;
-
-invalid_instruction:
-    execute(opCode, tState);
-    return;
-}
-
-void Z80::execute(u8 opCode, i64& tState)
-{
-    u8 x, y, z, p, q;
-    decodeInstruction(opCode, x, y, z, p, q);
-
-    // Commonly used local variables
-    i8 d = 0;       // Used for displacement
-    u8 r8 = 0;      // Temporary space for 8-bit register
-    u16 tt = 0;     // Temporary for an address
-    u8* r;          // Temporary for a reference
-
-    // Opcode hex calculated from:
-    //
-    //      X = $00, $40, $80, $c0
-    //      Y = add: $08, $10, $18, $20, $28, $30, $38
-    //      Z = add: Z
-    //      P = add: $00, $10, $20, $30
-    //      Q = add: $00, $08
-
-    switch (x)
-    {
-    case 0:
-        switch (z)
-        {
-        case 0: // x, z = (0, 0)
-            switch (y)
-            {
-            case 0:     // 00 - NOP
-                break;
-
-            case 1:     // 08 - EX AF,AF'
-                exAfAf();
-                break;
-
-            case 2:     // 10 - DJNZ d
+                // 10 - DJNZ d
                 CONTEND(IR(), 1, 1);
                 --B();
                 if (B() != 0)
                 {
-                    d = displacement(PEEK(PC()));
+                    i8 d = displacement(PEEK(PC()));
                     CONTEND(PC(), 1, 5);
                     PC() += (u16)(d + 1);
                     MP() = PC();
@@ -1549,19 +1060,21 @@ void Z80::execute(u8 opCode, i64& tState)
                     CONTEND(PC(), 3, 1);
                     ++PC();
                 }
-                break;
-
-            case 3:     // 18 - JR d
-                d = displacement(PEEK(PC()));
+            }
+            else if constexpr (Y == 3)
+            {
+                // 18 - JR d
+                i8 d = displacement(PEEK(PC()));
                 CONTEND(PC(), 1, 5);
                 PC() += (u16)(d + 1);
                 MP() = PC();
-                break;
-
-            default:    // 20, 28, 30, 38 - JR cc(y-4),d
-                if (getFlag(y - 4, F()))
+            }
+            else
+            {
+                // 20, 28, 30, 38 - JR cc(y-4),d
+                if (condition<Y - 4>())
                 {
-                    d = displacement(PEEK(PC()));
+                    i8 d = displacement(PEEK(PC()));
                     CONTEND(PC(), 1, 5);
                     PC() += (u16)(d + 1);
                     MP() = PC();
@@ -1572,480 +1085,1008 @@ void Z80::execute(u8 opCode, i64& tState)
                     ++PC();
                 }
             }
-            break;
-
-        case 1: // x, z = (0, 1)
-            if (0 == q)
+        }
+        else if constexpr (Z == 1)
+        {
+            if constexpr (Q == 0)
             {
-                // 01, 11, 21, 31 - LD BC()/DE()/HL()/SP(), nnnn
-                u16* rr = &getReg16_1(p);
-                *rr = PEEK16(PC());
+                // 01, 11, 21, 31 - LD BC/DE/HL/SP, nnnn
+                reg16_1<P>() = PEEK16(PC());
                 PC() += 2;
             }
             else
             {
-                // 09, 19, 29, 39 - ADD HL(), BC()/DE()/HL()/SP()
+                // 09, 19, 29, 39 - ADD HL, BC/DE/HL/SP
                 CONTEND(IR(), 1, 7);
                 MP() = HL() + 1;
-                addReg16(HL(), getReg16_1(p));
+                addReg16(HL(), reg16_1<P>());
             }
-            break;
-
-        case 2: // x, z = (0, 2)
-            switch (y)
+        }
+        else if constexpr (Z == 2)
+        {
+            if constexpr (Y == 0)
             {
-            case 0:     // 02 - LD (BC()),A()
+                // 02 - LD (BC),A
                 POKE(BC(), A());
                 MP() = (((BC() + 1) & 0xff) | (A() << 8));
-                break;
-
-            case 1:     // 0A - LD A(),(BC())
+            }
+            else if constexpr (Y == 1)
+            {
+                // 0A - LD A,(BC)
                 A() = PEEK(BC());
                 MP() = BC() + 1;
-                break;
-
-            case 2:     // 12 - LD (DE()),A()
+            }
+            else if constexpr (Y == 2)
+            {
+                // 12 - LD (DE),A
                 POKE(DE(), A());
                 MP() = (((DE() + 1) & 0xff) | (A() << 8));
-                break;
-
-            case 3:     // 1A - LD A(),(DE())
+            }
+            else if constexpr (Y == 3)
+            {
+                // 1A - LD A,(DE)
                 A() = PEEK(DE());
                 MP() = DE() + 1;
-                break;
-
-            case 4:     // 22 - LD (nn),HL()
-                tt = PEEK16(PC());
+            }
+            else if constexpr (Y == 4)
+            {
+                // 22 - LD (nn),HL
+                u16 tt = PEEK16(PC());
                 POKE16(tt, HL());
                 MP() = tt + 1;
                 PC() += 2;
-                break;
-
-            case 5:     // 2A - LD HL(),(nn)
-                tt = PEEK16(PC());
+            }
+            else if constexpr (Y == 5)
+            {
+                // 2A - LD HL,(nn)
+                u16 tt = PEEK16(PC());
                 HL() = PEEK16(tt);
                 PC() += 2;
                 MP() = tt + 1;
-                break;
-
-            case 6:     // 32 - LD (nn),A()
-                tt = PEEK16(PC());
+            }
+            else if constexpr (Y == 6)
+            {
+                // 32 - LD (nn),A
+                u16 tt = PEEK16(PC());
                 PC() += 2;
                 POKE(tt, A());
                 m_mp.l = (u8)(tt + 1);
                 m_mp.h = A();
-                break;
-
-            case 7:     // 3A - LD A(),(nn)
-                tt = PEEK16(PC());
-                MP() = tt + 1;
-                A() = PEEK(tt);
-                PC() += 2;
-                break;
-            }
-            break;
-
-        case 3: // x, z = (0, 3)
-            if (0 == q)
-            {
-                // 03, 13, 23, 33 - INC BC()/DE()/HL()/SP()
-                CONTEND(IR(), 1, 2);
-                ++(*&getReg16_1(p));
             }
             else
             {
-                // 0B, 1B, 2B, 3B - DEC BC()/DE()/HL()/SP()
-                CONTEND(IR(), 1, 2);
-                --(*&getReg16_1(p));
+                // 3A - LD A,(nn)
+                u16 tt = PEEK16(PC());
+                MP() = tt + 1;
+                A() = PEEK(tt);
+                PC() += 2;
             }
-            break;
-
-        case 4: // x, z = (0, 4)
-            // 04, 0C, 14, 1C, 24, 2C, 34, 3C - INC B()/C()/D/E/H/L()/(HL())/A()
-            if (y == 6)
+        }
+        else if constexpr (Z == 3)
+        {
+            // 03, 13, 23, 33 - INC BC/DE/HL/SP
+            // 0B, 1B, 2B, 3B - DEC BC/DE/HL/SP
+            CONTEND(IR(), 1, 2);
+            if constexpr (Q == 0) ++reg16_1<P>(); else --reg16_1<P>();
+        }
+        else if constexpr (Z == 4)
+        {
+            // 04, 0C, 14, 1C, 24, 2C, 34, 3C - INC B/C/D/E/H/L/(HL)/A
+            if constexpr (Y == 6)
             {
-                r8 = PEEK(HL());
+                u8 r8 = PEEK(HL());
                 CONTEND(HL(), 1, 1);
                 incReg8(r8);
                 POKE(HL(), r8);
             }
             else
             {
-                incReg8(getReg8(y));
+                incReg8(reg8<Y>());
             }
-            break;
-
-        case 5: // x, z = (0, 5)
-            // 05, 0D, 15, 1D, 25, 2D, 35, 3D - DEC B()/C()/D/E/H/L()/(HL())/A()
-            if (y == 6)
+        }
+        else if constexpr (Z == 5)
+        {
+            // 05, 0D, 15, 1D, 25, 2D, 35, 3D - DEC B/C/D/E/H/L/(HL)/A
+            if constexpr (Y == 6)
             {
-                r8 = PEEK(HL());
+                u8 r8 = PEEK(HL());
                 CONTEND(HL(), 1, 1);
                 decReg8(r8);
                 POKE(HL(), r8);
             }
             else
             {
-                decReg8(getReg8(y));
+                decReg8(reg8<Y>());
             }
-            break;
-
-        case 6: // x, z = (0, 6)
-            // 06, 0E, 16, 1E, 26, 2E, 36, 3E - LD B()/C()/D/E/H/L()/(HL())/A(), n
-            if (y == 6)
+        }
+        else if constexpr (Z == 6)
+        {
+            // 06, 0E, 16, 1E, 26, 2E, 36, 3E - LD B/C/D/E/H/L/(HL)/A, n
+            if constexpr (Y == 6)
             {
                 POKE(HL(), PEEK(PC()++));
             }
             else
             {
-                r = &getReg8(y);
-                *r = PEEK(PC()++);
+                reg8<Y>() = PEEK(PC()++);
             }
-            break;
-
-        case 7: // x, z = (0, 7)
-            switch (y)
+        }
+        else
+        {
+            if constexpr (Y == 0)
             {
-            case 0:     // 07 - RLCA
+                // 07 - RLCA
                 A() = ((A() << 1) | (A() >> 7));
                 F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_CARRY | F_3 | F_5));
-                break;
-
-            case 1:     // 0F - RRCA
+            }
+            else if constexpr (Y == 1)
+            {
+                // 0F - RRCA
                 F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & F_CARRY);
                 A() = ((A() >> 1) | (A() << 7));
                 F() |= (A() & (F_3 | F_5));
-                break;
-
-            case 2:     // 17 - RLA
-                d = A();
+            }
+            else if constexpr (Y == 2)
+            {
+                // 17 - RLA
+                u8 t = A();
                 A() = (A() << 1) | (F() & F_CARRY);
-                F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | (d >> 7);
-                break;
-
-            case 3:     // 1F - RRA
-                d = A();
+                F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | (t >> 7);
+            }
+            else if constexpr (Y == 3)
+            {
+                // 1F - RRA
+                u8 t = A();
                 A() = (A() >> 1) | (F() << 7);
-                F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | (d & F_CARRY);
-                break;
-
-            case 4:     // 27 - DAA
+                F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | (t & F_CARRY);
+            }
+            else if constexpr (Y == 4)
+            {
+                // 27 - DAA
                 daa();
-                break;
-
-            case 5:     // 2F - CPL
+            }
+            else if constexpr (Y == 5)
+            {
+                // 2F - CPL
                 A() = A() ^ 0xff;
                 F() = (F() & (F_CARRY | F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | F_NEG | F_HALF;
-                break;
-
-            case 6:     // 37 - SCF
+            }
+            else if constexpr (Y == 6)
+            {
+                // 37 - SCF
                 F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | F_CARRY;
-                break;
-
-            case 7:     // 3F - CCF
+            }
+            else
+            {
+                // 3F - CCF
                 F() = (F() & (F_PARITY | F_ZERO | F_SIGN)) | (A() & (F_3 | F_5)) | ((F() & F_CARRY) ? F_HALF : F_CARRY);
-                break;
             }
-            break;
+        }
+    }
+    else if constexpr (X == 1)
+    {
+        if constexpr (Y == 6 && Z == 6)
+        {
+            // 76 - HALT
+            m_halt = true;
+            --PC();
+        }
+        else if constexpr (Y == 6)
+        {
+            // 70-77 - LD (HL),R
+            POKE(HL(), reg8<Z>());
+        }
+        else if constexpr (Z == 6)
+        {
+            // 46-7E - LD R,(HL)
+            reg8<Y>() = PEEK(HL());
+        }
+        else
+        {
+            // 40-7F - LD R,R
+            reg8<Y>() = reg8<Z>();
+        }
+    }
+    else if constexpr (X == 2)
+    {
+        if constexpr (Z == 6)
+        {
+            // ALU(y) (HL)
+            u8 r8 = PEEK(HL());
+            alu<Y>(r8);
+        }
+        else
+        {
+            alu<Y>(reg8<Z>());
+        }
+    }
+    else
+    {
+        if constexpr (Z == 0)
+        {
+            // C0, C8, D0, D8, E0, E8, F0, F8 - RET flag
+            CONTEND(IR(), 1, 1);
+            if (condition<Y>())
+            {
+                PC() = pop(tState);
+                MP() = PC();
+            }
+        }
+        else if constexpr (Z == 1)
+        {
+            if constexpr (Q == 0)
+            {
+                // C1, D1, E1, F1 - POP RR
+                reg16_2<P>() = pop(tState);
+            }
+            else if constexpr (P == 0)
+            {
+                // C9 - RET
+                PC() = pop(tState);
+                MP() = PC();
+            }
+            else if constexpr (P == 1)
+            {
+                // D9 - EXX
+                exx();
+            }
+            else if constexpr (P == 2)
+            {
+                // E9 - JP HL
+                PC() = HL();
+            }
+            else
+            {
+                // F9 - LD SP, HL
+                CONTEND(IR(), 1, 2);
+                SP() = HL();
+            }
+        }
+        else if constexpr (Z == 2)
+        {
+            // C2, CA, D2, DA, E2, EA, F2, FA - JP flag,nn
+            u16 tt = PEEK16(PC());
+            if (condition<Y>())
+            {
+                PC() = tt;
+            }
+            else
+            {
+                PC() += 2;
+            }
+            MP() = tt;
+        }
+        else if constexpr (Z == 3)
+        {
+            if constexpr (Y == 0)
+            {
+                // C3 - JP nn
+                PC() = PEEK16(PC());
+                MP() = PC();
+            }
+            else if constexpr (Y == 1)
+            {
+                // CB (prefix)
+                u8 opCode = fetchInstruction(tState);
+                (this->*kCBOps[opCode])(tState);
+            }
+            else if constexpr (Y == 2)
+            {
+                // D3 - OUT (n),A       A -> $AAnn
+                u8 r8 = PEEK(PC());
+                NX_LOG_OUT((u16)r8 | ((u16)A() << 8), A());
+                m_ext.out((u16)r8 | ((u16)A() << 8), A(), tState);
+                m_mp.h = A();
+                m_mp.l = (u8)(r8 + 1);
+                ++PC();
+            }
+            else if constexpr (Y == 3)
+            {
+                // DB - IN A,(n)        A <- $AAnn
+                u8 r8 = PEEK(PC());
+                u16 tt = ((u16)A() << 8) | r8;
+                m_mp.h = A();
+                m_mp.l = (u8)(r8 + 1);
+                A() = m_ext.in(tt, tState);
+                NX_LOG_IN(tt, A());
+                ++PC();
+            }
+            else if constexpr (Y == 4)
+            {
+                // E3 - EX (SP),HL
+                u16 tt = PEEK16(SP());
+                CONTEND(SP() + 1, 1, 1);
+                POKE(SP() + 1, H());
+                POKE(SP(), L());
+                CONTEND(SP(), 1, 2);
+                HL() = tt;
+                MP() = HL();
+            }
+            else if constexpr (Y == 5)
+            {
+                // EB - EX DE,HL
+                std::swap(DE(), HL());
+            }
+            else if constexpr (Y == 6)
+            {
+                // F3 - DI
+                IFF1() = false;
+                IFF2() = false;
+            }
+            else
+            {
+                // FB - EI
+                IFF1() = true;
+                IFF2() = true;
+                m_eiHappened = true;
+            }
+        }
+        else if constexpr (Z == 4)
+        {
+            // C4 CC D4 DC E4 EC F4 FC - CALL F,nn
+            u16 tt = PEEK16(PC());
+            MP() = tt;
+            if (condition<Y>())
+            {
+                CONTEND(PC() + 1, 1, 1);
+                push(PC() + 2, tState);
+                PC() = tt;
+            }
+            else
+            {
+                PC() += 2;
+            }
+        }
+        else if constexpr (Z == 5)
+        {
+            if constexpr (Q == 0)
+            {
+                // C5 D5 E5 F5 - PUSH RR
+                CONTEND(IR(), 1, 1);
+                push(reg16_2<P>(), tState);
+            }
+            else if constexpr (P == 0)
+            {
+                // CD - CALL nn
+                u16 tt = PEEK16(PC());
+                MP() = tt;
+                CONTEND(PC() + 1, 1, 1);
+                push(PC() + 2, tState);
+                PC() = tt;
+            }
+            else if constexpr (P == 1)
+            {
+                // DD - IX prefix
+                u8 opCode = fetchInstruction(tState);
+                (this->*kDDOps[opCode])(tState);
+            }
+            else if constexpr (P == 2)
+            {
+                // ED - extensions prefix
+                u8 opCode = fetchInstruction(tState);
+                (this->*kEDOps[opCode])(tState);
+            }
+            else
+            {
+                // FD - IY prefix
+                u8 opCode = fetchInstruction(tState);
+                (this->*kFDOps[opCode])(tState);
+            }
+        }
+        else if constexpr (Z == 6)
+        {
+            // C6, CE, D6, DE, E6, EE, F6, FE - ALU A,n
+            u8 r8 = PEEK(PC()++);
+            alu<Y>(r8);
+        }
+        else
+        {
+            // C7, CF, D7, DF, E7, EF, F7, FF - RST n
+            CONTEND(IR(), 1, 1);
+            push(PC(), tState);
+            PC() = (u16)Y * 8;
+            MP() = PC();
+        }
+    }
+}
 
-        } // switch(z)
-        break; // x == 0
+//----------------------------------------------------------------------------------------------------------------------
+// CB prefixed opcodes
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename Bus>
+template <int X, int Y, int Z>
+void Z80Core<Bus>::executeCB(TState& tState)
+{
+    if constexpr (Z == 6)
+    {
+        u8 r8 = PEEK(HL());
+        CONTEND(HL(), 1, 1);
 
-    case 1:
-        if (z == 6 && y == 6)
+        if constexpr (X == 0)
+        {
+            // 06-3E: Rotate/Shift (HL)
+            rotateShift<Y>(r8);
+            POKE(HL(), r8);
+        }
+        else if constexpr (X == 1)
+        {
+            // 46-7E: BIT n,(HL)
+            bitReg8MP(r8, Y);
+        }
+        else if constexpr (X == 2)
+        {
+            // 86-BE: RES n,(HL)
+            resReg8(r8, Y);
+            POKE(HL(), r8);
+        }
+        else
+        {
+            // C6-FE: SET n,(HL)
+            setReg8(r8, Y);
+            POKE(HL(), r8);
+        }
+    }
+    else
+    {
+        if constexpr (X == 0)       rotateShift<Y>(reg8<Z>());     // 00-3F: Rotate/Shift instructions
+        else if constexpr (X == 1)  bitReg8(reg8<Z>(), Y);         // 40-7F: BIT instructions
+        else if constexpr (X == 2)  resReg8(reg8<Z>(), Y);         // 80-BF: RES instructions
+        else                        setReg8(reg8<Z>(), Y);         // C0-FF: SET instructions
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// ED prefixed opcodes
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename Bus>
+template <int X, int Y, int Z>
+void Z80Core<Bus>::executeED(TState& tState)
+{
+    constexpr int P = Y >> 1;
+    constexpr int Q = Y & 1;
+    constexpr u8 kOpCode = (u8)((X << 6) | (Y << 3) | Z);
+
+    if constexpr (X == 1)
+    {
+        // x = 1: 40-7F
+        if constexpr (Z == 0)
+        {
+            // IN R,(C)         or IN F,(C) (y == 6)
+            MP() = BC() + 1;
+            u8 v = m_ext.in(BC(), tState);
+            NX_LOG_IN(BC(), v);
+            if constexpr (Y != 6) reg8<Y>() = v;
+            F() = (F() & F_CARRY) | m_SZ53P[v];
+        }
+        else if constexpr (Z == 1)
+        {
+            // OUT (C),R        or OUT (C),0 (y == 6)
+            u8 v = 0;
+            if constexpr (Y != 6) v = reg8<Y>();
+            NX_LOG_OUT(BC(), v);
+            m_ext.out(BC(), v, tState);
+            MP() = BC() + 1;
+        }
+        else if constexpr (Z == 2)
+        {
+            CONTEND(IR(), 1, 7);
+            if constexpr (Q == 0)
+            {
+                // SBC HL,RR
+                sbcReg16(reg16_1<P>());
+            }
+            else
+            {
+                // ADC HL,RR
+                adcReg16(reg16_1<P>());
+            }
+        }
+        else if constexpr (Z == 3)
+        {
+            u16 tt = PEEK16(PC());
+            PC() += 2;
+            if constexpr (Q == 0)
+            {
+                // LD (nn),RR
+                POKE16(tt, reg16_1<P>());
+            }
+            else
+            {
+                // LD RR,(nn)
+                reg16_1<P>() = PEEK16(tt);
+            }
+            MP() = tt + 1;
+        }
+        else if constexpr (Z == 4)
+        {
+            // NEG
+            u8 v = A();
+            A() = 0;
+            subReg8(v);
+        }
+        else if constexpr (Z == 5)
+        {
+            // RETI & RETN
+            IFF1() = IFF2();
+            PC() = pop(tState);
+            MP() = PC();
+        }
+        else if constexpr (Z == 6)
         {
-            // 76 - HALT
-            m_halt = true;
-            --PC();
+            // IM ?
+            constexpr int kMode = Y & 3;
+            IM() = (kMode == 0) ? 0 : kMode - 1;
         }
         else
         {
-            // 40 - 7F - LD R,R
-            if (y == 6)
+            if constexpr (Y == 0)
             {
-                // LD (HL()),R
-                u8* r = &getReg8(z);
-                POKE(HL(), *r);
+                // LD I,A
+                CONTEND(IR(), 1, 1);
+                I() = A();
             }
-            else if (z == 6)
+            else if constexpr (Y == 1)
             {
-                // LD R,(HL())
-                u8* r = &getReg8(y);
-                *r = PEEK(HL());
+                // LD R,A
+                CONTEND(IR(), 1, 1);
+                R() = A();
             }
-            else
+            else if constexpr (Y == 2)
             {
-                u8* r1 = &getReg8(y);
-                u8* r2 = &getReg8(z);
-                *r1 = *r2;
+                // LD A,I
+                CONTEND(IR(), 1, 1);
+                A() = I();
+                F() = (F() & F_CARRY) | m_SZ53[A()] | (IFF2() ? F_PARITY : 0);
+                // #todo: handle IFF2 event
             }
-        }
-        break; // x == 1
-
-    case 2:
-        {
-            if (z == 6)
+            else if constexpr (Y == 3)
             {
-                // ALU(y) (HL())
-                r8 = PEEK(HL());
-                getAlu(y)(r8);
+                // LD A,R
+                CONTEND(IR(), 1, 1);
+                A() = R();
+                F() = (F() & F_CARRY) | m_SZ53[A()] | (IFF2() ? F_PARITY : 0);
+            }
+            else if constexpr (Y == 4)
+            {
+                // RRD
+                u8 v = PEEK(HL());
+                CONTEND(HL(), 1, 4);
+                POKE(HL(), (A() << 4) | (v >> 4));
+                A() = (A() & 0xf0) | (v & 0x0f);
+                F() = (F() & F_CARRY) | m_SZ53P[A()];
+                MP() = HL() + 1;
+            }
+            else if constexpr (Y == 5)
+            {
+                // RLD
+                u8 v = PEEK(HL());
+                CONTEND(HL(), 1, 4);
+                POKE(HL(), (v << 4) | (A() & 0x0f));
+                A() = (A() & 0xf0) | (v >> 4);
+                F() = (F() & F_CARRY) | m_SZ53P[A()];
+                MP() = HL() + 1;
             }
             else
             {
-                getAlu(y)(getReg8(z));
+                // NOP
             }
         }
-        break; // x == 2
+    }
+    else if constexpr (kOpCode == 0xa0 || kOpCode == 0xa8 || kOpCode == 0xb0 || kOpCode == 0xb8)
+    {
+        // LDI, LDD, LDIR, LDDR
+        constexpr bool kRepeat = kOpCode >= 0xb0;
+        constexpr u16 kDir = (kOpCode & 0x08) ? 0xffff : 0x0001;
+
+        TState limit = kRepeat ? m_ext.blockLimit(PC() - 2) : 0;
 
-    case 3:
-        switch (z)
+        do
         {
-        case 0:
-            // C0, C8, D0, D8, E0, E8, F0, F8 - RET flag
-            CONTEND(IR(), 1, 1);
-            if (getFlag(y, F()))
+            u8 v = PEEK(HL());
+            POKE(DE(), v);
+            CONTEND(DE(), 1, 2);
+            --BC();
+            v += A();
+            F() = (F() & (F_CARRY | F_ZERO | F_SIGN)) | (BC() ? F_PARITY : 0) |
+                (v & F_3) | ((v & 0x02) ? F_5 : 0);
+            if (kRepeat && BC())
             {
-                PC() = pop(tState);
-                MP() = PC();
+                CONTEND(DE(), 1, 5);
+                PC() -= 2;
+                MP() = PC() + 1;
             }
-            break;  // x, z = (3, 0)
+            DE() += kDir;
+            HL() += kDir;
+        }
+        while (kRepeat && BC() && repeatBlock(tState, limit, HL(), DE()));
+    }
+    else if constexpr (kOpCode == 0xa1 || kOpCode == 0xa9 || kOpCode == 0xb1 || kOpCode == 0xb9)
+    {
+        // CPI, CPD, CPIR, CPDR
+        constexpr bool kRepeat = kOpCode >= 0xb0;
+        constexpr u16 kDir = (kOpCode & 0x08) ? 0xffff : 0x0001;
 
-        case 1:
-            if (0 == q)
+        TState limit = kRepeat ? m_ext.blockLimit(PC() - 2) : 0;
+        bool repeat;
+
+        do
+        {
+            u8 v = PEEK(HL());
+            u8 t = A() - v;
+            u8 lookup = ((A() & 0x08) >> 3) | ((v & 0x08) >> 2) | ((t & 0x08) >> 1);
+            CONTEND(HL(), 1, 5);
+            --BC();
+            F() = (F() & F_CARRY) | (BC() ? (F_PARITY | F_NEG) : F_NEG) |
+                kHalfCarrySub[lookup] | (t ? 0 : F_ZERO) | (t & F_SIGN);
+            if (F() & F_HALF) --t;
+            F() |= (t & F_3) | ((t & 0x02) ? F_5 : 0);
+            repeat = kRepeat && (F() & (F_PARITY | F_ZERO)) == F_PARITY;
+            if (repeat)
             {
-                // C1, D1, E1, F1 - POP RR
-                *&getReg16_2(p) = pop(tState);
+                CONTEND(HL(), 1, 5);
+                PC() -= 2;
+                MP() = PC() + 1;
             }
             else
             {
-                switch (p)
-                {
-                case 0:     // C9 - RET
-                    PC() = pop(tState);
-                    MP() = PC();
-                    break;
-
-                case 1:     // D9 - EXX
-                    exx();
-                    break;
-
-                case 2:     // E9 - JP HL()
-                    PC() = HL();
-                    break;
-
-                case 3:     // F9 - LD SP(), HL()
-                    CONTEND(IR(), 1, 2);
-                    SP() = HL();
-                    break;
-                }
+                MP() += kDir;
             }
-            break;  // x, z = (3, 1)
+            HL() += kDir;
+        }
+        while (repeat && repeatBlock(tState, limit, HL(), HL()));
+    }
+    else if constexpr (kOpCode == 0xa2 || kOpCode == 0xaa || kOpCode == 0xb2 || kOpCode == 0xba)
+    {
+        // INI, IND, INIR, INDR
+        constexpr bool kRepeat = kOpCode >= 0xb0;
+        constexpr u16 kDir = (kOpCode & 0x08) ? 0xffff : 0x0001;
 
-        case 2:
-            // C2, CA, D2, DA, E2, EA, F2, FA - JP flag,nn
-            tt = PEEK16(PC());
-            if (getFlag(y, F()))
+        TState limit = kRepeat ? m_ext.blockLimit(PC() - 2) : 0;
+
+        do
+        {
+            CONTEND(IR(), 1, 1);
+            u8 t1 = m_ext.in(BC(), tState);
+            NX_LOG_IN(BC(), t1);
+            POKE(HL(), t1);
+            MP() = BC() + kDir;
+            --B();
+            u8 t2 = t1 + C() + (u8)kDir;
+            F() = (t1 & 0x80 ? F_NEG : 0) |
+                ((t2 < t1) ? F_HALF | F_CARRY : 0) |
+                (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
+                m_SZ53[B()];
+            if (kRepeat && B())
             {
-                PC() = tt;
+                CONTEND(HL(), 1, 5);
+                PC() -= 2;
             }
-            else
+            HL() += kDir;
+        }
+        while (kRepeat && B() && m_ext.isBlockSafePort(BC()) && repeatBlock(tState, limit, HL(), HL()));
+    }
+    else if constexpr (kOpCode == 0xa3 || kOpCode == 0xab || kOpCode == 0xb3 || kOpCode == 0xbb)
+    {
+        // OUTI, OUTD, OTIR, OTDR
+        constexpr bool kRepeat = kOpCode >= 0xb0;
+        constexpr u16 kDir = (kOpCode & 0x08) ? 0xffff : 0x0001;
+
+        TState limit = kRepeat ? m_ext.blockLimit(PC() - 2) : 0;
+
+        do
+        {
+            CONTEND(IR(), 1, 1);
+            u8 t1 = PEEK(HL());
+            --B();
+            MP() = BC() + kDir;
+            NX_LOG_OUT(BC(), t1);
+            m_ext.out(BC(), t1, tState);
+            HL() += kDir;
+            u8 t2 = t1 + L();
+            F() = (t1 & 0x80 ? F_NEG : 0) |
+                ((t2 < t1) ? F_HALF | F_CARRY : 0) |
+                (m_parity[(t2 & 0x07) ^ B()] ? F_PARITY : 0) |
+                m_SZ53[B()];
+            if (kRepeat && B())
             {
-                PC() += 2;
+                CONTEND(BC(), 1, 5);
+                PC() -= 2;
             }
-            MP() = tt;
-            break;  // x, z = (3, 2)
+        }
+        while (kRepeat && B() && m_ext.isBlockSafePort(BC()) && repeatBlock(tState, limit, HL(), HL()));
+    }
+    else
+    {
+        // Invalid instruction: interpret the opcode as if it wasn't prefixed.
+        executeBase<X, Y, Z>(tState);
+    }
+}
 
-        case 3:
-            switch (y)
-            {
-            case 0:     // C3 - JP nn
-                PC() = PEEK16(PC());
-                MP() = PC();
-                break;
+//----------------------------------------------------------------------------------------------------------------------
+// DD & FD prefixed opcodes
+//----------------------------------------------------------------------------------------------------------------------
 
-            case 1:     // CB (prefix)
-                opCode = fetchInstruction(tState);
-                decodeInstruction(opCode, x, y, z, p, q);
+#define II idx.r
+#define IH idx.h
+#define IL idx.l
 
-                switch (x)
-                {
-                case 0:     // 00-3F: Rotate/Shift instructions
-                    if (z == 6)
-                    {
-                        r8 = PEEK(HL());
-                        CONTEND(HL(), 1, 1);
-                        getRotateShift(y)(r8);
-                        POKE(HL(), r8);
-                    }
-                    else
-                    {
-                        getRotateShift(y)(getReg8(z));
-                    }
-                    break;
-
-                case 1:     // 40-7F: BIT instructions
-                    if (z == 6)
-                    {
-                        // BIT n,(HL())
-                        r8 = PEEK(HL());
-                        CONTEND(HL(), 1, 1);
-                        bitReg8MP(r8, y);
-                    }
-                    else
-                    {
-                        bitReg8(getReg8(z), y);
-                    }
-                    break;
-
-                case 2:     // 80-BF: RES instructions
-                    if (z == 6)
-                    {
-                        // RES n,(HL())
-                        r8 = PEEK(HL());
-                        CONTEND(HL(), 1, 1);
-                        resReg8(r8, y);
-                        POKE(HL(), r8);
-                    }
-                    else
-                    {
-                        resReg8(getReg8(z), y);
-                    }
-                    break;
-
-                case 3:     // C0-FF: SET instructions
-                    if (z == 6)
-                    {
-                        // BIT n,(HL())
-                        r8 = PEEK(HL());
-                        CONTEND(HL(), 1, 1);
-                        setReg8(r8, y);
-                        POKE(HL(), r8);
-                    }
-                    else
-                    {
-                        setReg8(getReg8(z), y);
-                    }
-                }
-                break;
+template <typename Bus>
+template <Reg Z80::*Idx, int X, int Y, int Z>
+void Z80Core<Bus>::executeDDFD(TState& tState)
+{
+    constexpr int P = Y >> 1;
+    constexpr int Q = Y & 1;
+    constexpr u8 kOpCode = (u8)((X << 6) | (Y << 3) | Z);
+
+    Reg& idx = this->*Idx;
+
+    // Reads the displacement for (IX+d) and sets MEMPTR to the effective address.
+    auto indexAddress = [&]() -> u16 {
+        i8 d = PEEK(PC());
+        CONTEND(PC(), 1, 5);
+        ++PC();
+        return MP() = II + d;
+    };
 
-            case 2:     // D3 - OUT (n),A()       A() -> $AAnn
-                r8 = PEEK(PC());
-                NX_LOG_OUT((u16)r8 | ((u16)A() << 8), A());
-                m_ext.out((u16)r8 | ((u16)A() << 8), A(), tState);
-                m_mp.h = A();
-                m_mp.l = (u8)(r8 + 1);
-                ++PC();
-                break;
+    if constexpr (kOpCode == 0x21)
+    {
+        // 21 - LD IX,nn
+        II = PEEK16(PC());
+        PC() += 2;
+    }
+    else if constexpr (X == 0 && Z == 1 && Q == 1)
+    {
+        // 09 19 29 39 - ADD IX,BC/DE/IX/SP
+        CONTEND(IR(), 1, 7);
+        MP() = II + 1;
+        if constexpr (P == 2) addReg16(II, II); else addReg16(II, reg16_1<P>());
+    }
+    else if constexpr (kOpCode == 0x22)
+    {
+        // 22 - LD (nn),IX
+        u16 tt = PEEK16(PC());
+        POKE16(tt, II);
+        MP() = tt + 1;
+        PC() += 2;
+    }
+    else if constexpr (kOpCode == 0x2a)
+    {
+        // 2A - LD IX,(nn)
+        u16 tt = PEEK16(PC());
+        II = PEEK16(tt);
+        PC() += 2;
+        MP() = tt + 1;
+    }
+    else if constexpr (kOpCode == 0x23)
+    {
+        // 23 - INC IX
+        CONTEND(IR(), 1, 2);
+        ++II;
+    }
+    else if constexpr (kOpCode == 0x2b)
+    {
+        // 2B - DEC IX
+        CONTEND(IR(), 1, 2);
+        --II;
+    }
+    else if constexpr (kOpCode == 0x24) incReg8(IH);    // 24 - INC IXH
+    else if constexpr (kOpCode == 0x2c) incReg8(IL);    // 2C - INC IXL
+    else if constexpr (kOpCode == 0x25) decReg8(IH);    // 25 - DEC IXH
+    else if constexpr (kOpCode == 0x2d) decReg8(IL);    // 2D - DEC IXL
+    else if constexpr (kOpCode == 0x34 || kOpCode == 0x35)
+    {
+        // 34 - INC (IX+d)
+        // 35 - DEC (IX+d)
+        u16 addr = indexAddress();
+        u8 v = PEEK(addr);
+        CONTEND(addr, 1, 1);
+        if constexpr (kOpCode == 0x34) incReg8(v); else decReg8(v);
+        POKE(addr, v);
+    }
+    else if constexpr (kOpCode == 0x26) IH = PEEK(PC()++);  // 26 - LD IXH,n
+    else if constexpr (kOpCode == 0x2e) IL = PEEK(PC()++);  // 2E - LD IXL,n
+    else if constexpr (kOpCode == 0x36)
+    {
+        // 36 - LD (IX+d),n
+        i8 d = PEEK(PC()++);
+        u8 v = PEEK(PC());
+        CONTEND(PC(), 1, 2);
+        ++PC();
+        MP() = II + d;
+        POKE(MP(), v);
+    }
+    else if constexpr (X == 1 && !(Y == 6 && Z == 6) &&
+        (Y == 4 || Y == 5 || Y == 6 || Z == 4 || Z == 5 || Z == 6))
+    {
+        // 40-7F - LD R,R with any IXH, IXL or (IX+d) operands
+        if constexpr (Z == 6)
+        {
+            // LD R,(IX+d) - includes 66/6E LD H/L,(IX+d)
+            u16 addr = indexAddress();
+            reg8<Y>() = PEEK(addr);
+        }
+        else if constexpr (Y == 6)
+        {
+            // LD (IX+d),R
+            u16 addr = indexAddress();
+            POKE(addr, reg8<Z>());
+        }
+        else
+        {
+            // LD IXH/IXL,R - LD R,IXH/IXL - LD IXH/IXL,IXH/IXL
+            u8& r1 = (Y == 4) ? IH : (Y == 5) ? IL : reg8<Y>();
+            u8& r2 = (Z == 4) ? IH : (Z == 5) ? IL : reg8<Z>();
+            r1 = r2;
+        }
+    }
+    else if constexpr (X == 2 && (Z == 4 || Z == 5 || Z == 6))
+    {
+        // ALU A,IXH/IXL/(IX+d)
+        if constexpr (Z == 6)
+        {
+            u8 v = PEEK(indexAddress());
+            alu<Y>(v);
+        }
+        else
+        {
+            alu<Y>(Z == 4 ? IH : IL);
+        }
+    }
+    else if constexpr (kOpCode == 0xcb)
+    {
+        // DDCB prefixes
+        CONTEND(PC(), 3, 1);
+        MP() = II + (i8)m_ext.peek(PC());
+        ++PC();
+        CONTEND(PC(), 3, 1);
+        u8 opCode = m_ext.peek(PC());
+        CONTEND(PC(), 1, 2);
+        ++PC();
+        (this->*kDDFDCBOps[opCode])(tState);
+    }
+    else if constexpr (kOpCode == 0xe1)
+    {
+        // POP IX
+        II = pop(tState);
+    }
+    else if constexpr (kOpCode == 0xe3)
+    {
+        // EX (SP),IX
+        Reg t;
+        t.l = PEEK(SP());
+        t.h = PEEK(SP() + 1);
+        CONTEND(SP() + 1, 1, 1);
+        POKE(SP() + 1, IH);
+        POKE(SP(), IL);
+        CONTEND(SP(), 1, 2);
+        II = MP() = t.r;
+    }
+    else if constexpr (kOpCode == 0xe5)
+    {
+        // PUSH IX
+        CONTEND(IR(), 1, 1);
+        push(II, tState);
+    }
+    else if constexpr (kOpCode == 0xe9)
+    {
+        // JP (IX)
+        PC() = II;
+    }
+    else if constexpr (kOpCode == 0xf9)
+    {
+        // LD SP,IX
+        CONTEND(IR(), 1, 2);
+        SP() = II;
+    }
+    else
+    {
+        // Invalid instruction: the prefix is ignored and the opcode runs as normal.
+        executeBase<X, Y, Z>(tState);
+    }
+}
 
-            case 3:     // DB - IN A(),(n)        A() <- $AAnn
-                r8 = PEEK(PC());
-                tt = ((u16)A() << 8) | r8;
-                m_mp.h = A();
-                m_mp.l = (u8)(r8 + 1);
-                A() = m_ext.in(tt, tState);
-                NX_LOG_IN(tt, A());
-                ++PC();
-                break;
+//----------------------------------------------------------------------------------------------------------------------
+// DDCB & FDCB prefixed opcodes
+// MEMPTR has already been set to IX+d/IY+d by the prefix handler.
+//----------------------------------------------------------------------------------------------------------------------
 
-            case 4:     // E3 - EX (SP()),HL()
-                tt = PEEK16(SP());
-                CONTEND(SP() + 1, 1, 1);
-                POKE(SP() + 1, H());
-                POKE(SP(), L());
-                CONTEND(SP(), 1, 2);
-                HL() = tt;
-                MP() = HL();
-                break;
+template <typename Bus>
+template <int X, int Y, int Z>
+void Z80Core<Bus>::executeDDFDCB(TState& tState)
+{
+    u8 v = PEEK(MP());
 
-            case 5:     // EB - EX DE(),HL()
-                tt = DE();
-                DE() = HL();
-                HL() = tt;
-                break;
+    if constexpr (X == 0)
+    {
+        // LD R[z],rot/shift[y] (IX+d)      or rot/shift[y] (IX+d) (z == 6)
+        CONTEND(MP(), 1, 1);
+        rotateShift<Y>(v);
+    }
+    else if constexpr (X == 1)
+    {
+        // BIT y,(IX+d)
+        CONTEND(MP(), 1, 1);
+        bitReg8MP(v, Y);
+        return;
+    }
+    else if constexpr (X == 2)
+    {
+        // LD R[z],RES y,(IX+d)             or RES y,(IX+d)  (z == 6)
+        resReg8(v, Y);
+        CONTEND(MP(), 1, 1);
+    }
+    else
+    {
+        // LD R[z],SET y,(IX+d)             or SET y,(IX+d)  (z == 6)
+        setReg8(v, Y);
+        CONTEND(MP(), 1, 1);
+    }
 
-            case 6:     // F3 - DI
-                IFF1() = false;
-                IFF2() = false;
-                break;
+    if constexpr (Z != 6) reg8<Z>() = v;
+    POKE(MP(), v);
+}
 
-            case 7:     // FB - EI
-                IFF1() = true;
-                IFF2() = true;
-                m_eiHappened = true;
-                break;
-            }
-            break;  // x, z = (3, 3)
+//----------------------------------------------------------------------------------------------------------------------
+// Dispatch tables
+//----------------------------------------------------------------------------------------------------------------------
 
-        case 4:
-            // C4 CC D4 DC E4 EC F4 FC - CALL F(),nn
-            tt = PEEK16(PC());
-            MP() = tt;
-            if (getFlag(y, F()))
-            {
-                CONTEND(PC() + 1, 1, 1);
-                push(PC() + 2, tState);
-                PC() = tt;
-            }
-            else
-            {
-                PC() += 2;
-            }
-            break;  // x, z = (3, 4)
+template <typename Bus>
+template <size_t... Op>
+constexpr typename Z80Core<Bus>::OpTable Z80Core<Bus>::makeBaseTable(index_sequence<Op...>)
+{
+    return {{ &Z80Core::executeBase<(Op >> 6), ((Op >> 3) & 7), (Op & 7)>... }};
+}
 
-        case 5:
-            if (0 == q)
-            {
-                // C5 D5 E5 F5 - PUSH RR
-                CONTEND(IR(), 1, 1);
-                push(*&getReg16_2(p), tState);
-            }
-            else
-            {
-                switch (p)
-                {
-                case 0:     // CD - CALL nn
-                    tt = PEEK16(PC());
-                    MP() = tt;
-                    CONTEND(PC() + 1, 1, 1);
-                    push(PC() + 2, tState);
-                    PC() = tt;
-                    break;
-
-                case 1:     // DD - IX prefix
-                    executeDDFD(m_ix, tState);
-                    break;
-
-                case 2:     // ED - extensions prefix
-                    executeED(tState);
-                    break;
-
-                case 3:     // FD - IY prefix
-                    executeDDFD(m_iy, tState);
-                    break;
-                }
-            }
-            break;  // x, z = (3, 5)
+template <typename Bus>
+template <size_t... Op>
+constexpr typename Z80Core<Bus>::OpTable Z80Core<Bus>::makeCBTable(index_sequence<Op...>)
+{
+    return {{ &Z80Core::executeCB<(Op >> 6), ((Op >> 3) & 7), (Op & 7)>... }};
+}
 
-        case 6:
-            // C6, CE, D6, DE(), E6, EE, F6, FE - ALU A(),n
-            r8 = PEEK(PC()++);
-            getAlu(y)(r8);
-            break;  // x, z = (3, 6)
+template <typename Bus>
+template <size_t... Op>
+constexpr typename Z80Core<Bus>::OpTable Z80Core<Bus>::makeEDTable(index_sequence<Op...>)
+{
+    return {{ &Z80Core::executeED<(Op >> 6), ((Op >> 3) & 7), (Op & 7)>... }};
+}
 
-        case 7:
-            // C7, CF, D7, DF, E7, EF, F7, FF - RST n
-            CONTEND(IR(), 1, 1);
-            push(PC(), tState);
-            PC() = (u16)y * 8;
-            MP() = PC();
-            break;  // x, z = (3, 7)
+template <typename Bus>
+template <Reg Z80::*Idx, size_t... Op>
+constexpr typename Z80Core<Bus>::OpTable Z80Core<Bus>::makeDDFDTable(index_sequence<Op...>)
+{
+    return {{ &Z80Core::executeDDFD<Idx, (Op >> 6), ((Op >> 3) & 7), (Op & 7)>... }};
+}
 
-        }
-        break; // x == 3
-    } // switch(x)
+template <typename Bus>
+template <size_t... Op>
+constexpr typename Z80Core<Bus>::OpTable Z80Core<Bus>::makeDDFDCBTable(index_sequence<Op...>)
+{
+    return {{ &Z80Core::executeDDFDCB<(Op >> 6), ((Op >> 3) & 7), (Op & 7)>... }};
 }
 
-void Z80::step(i64& tState)
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kBaseOps = makeBaseTable(make_index_sequence<256>());
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kCBOps = makeCBTable(make_index_sequence<256>());
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kEDOps = makeEDTable(make_index_sequence<256>());
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kDDOps = makeDDFDTable<&Z80Core::m_ix>(make_index_sequence<256>());
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kFDOps = makeDDFDTable<&Z80Core::m_iy>(make_index_sequence<256>());
+template <typename Bus>
+const typename Z80Core<Bus>::OpTable Z80Core<Bus>::kDDFDCBOps = makeDDFDCBTable(make_index_sequence<256>());
+
+//----------------------------------------------------------------------------------------------------------------------
+// z80Step
+// Run a single instruction
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename Bus>
+void Z80Core<Bus>::step(TState& tState)
 {
     assert(tState >= 0);
     if (IFF1() && /*(*tState < 32)*/ m_interrupt && !m_eiHappened)
@@ -2082,8 +2123,52 @@ void Z80::step(i64& tState)
         if (!m_eiHappened) m_interrupt = false;
 
         u8 opCode = fetchInstruction(tState);
-        execute(opCode, tState);
+        if (!isPrefix(opCode) || !executeDecoded(tState))
+        {
+            (this->*kBaseOps[opCode])(tState);
+        }
+    }
+}
+
+template <typename Bus>
+bool Z80Core<Bus>::run(TState& tState, TState until, StopConditions stop)
+{
+    do
+    {
+        u16* slot = m_interrupt ? nullptr : m_ext.blockSlot(PC());
+        if (slot)
+        {
+            runDecodedBlock(*slot, tState, until);
+        }
+        else
+        {
+            m_instructionStart = tState;
+            step(tState);
+        }
+        if (stop.breakpoints && m_ext.shouldBreak(PC())) return true;
+        if (stop.halt && m_halt) break;
     }
+    while (!stop.single && tState < until);
+
+    return false;
+}
+
+template <typename Bus>
+Z80Core<Bus>::Z80Core(Bus& bus)
+    : m_ext(bus)
+{
+}
+
+void Z80::skipHalt(TState& tState, TState until)
+{
+    assert(m_halt);
+    if (tState >= until) return;
+
+    // Each pass re-fetches the HALT: 4 t-states and one refresh cycle.  The last one is the current instruction.
+    TState numFetches = (until - tState + 3) / 4;
+    tState += numFetches * 4;
+    m_instructionStart = tState - 4;
+    R() = (R() & 0x80) | ((R() + numFetches) & 0x7f);
 }
 
 void Z80::interrupt()
@@ -2096,5 +2181,14 @@ void Z80::nmi()
     m_nmi = true;
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+// Instantiations
+// The Spectrum gets its own core so its memory and I/O methods are inlined into every handler.  The IExternals core
+// is for everything else.
+//----------------------------------------------------------------------------------------------------------------------
+
+template class Z80Core<IExternals>;
+template class Z80Core<Spectrum>;
+
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
@@ -2,13 +2,21 @@
 // Z80 emulation
 //----------------------------------------------------------------------------------------------------------------------
 
+#pragma once
+
 #include <config.h>
 #include <types.h>
 
-#include <functional>
+#include <array>
+#include <utility>
+#include <vector>
 
 //----------------------------------------------------------------------------------------------------------------------
 // CPU interface to external systems
+//
+// Z80Core can be instantiated on any type that provides these methods.  Using a concrete type (e.g. Spectrum) lets
+// the compiler inline memory and I/O accesses into the instruction handlers.  This interface is an adapter for
+// anything else (tests, tools) that would rather implement virtual methods.
 //----------------------------------------------------------------------------------------------------------------------
 
 struct IExternals
@@ -26,27 +34,90 @@ struct IExternals
     // I/O
     virtual u8 in(u16 port, TState& t) = 0;
     virtual void out(u16 port, u8 x, TState& t) = 0;
+
+    // Block instructions.  blockLimit returns the t-state up to which a repeating block instruction at pc may keep
+    // running without returning from step() (0 to never do so).  Each extra iteration must only touch addresses and
+    // ports that the isBlockSafe methods allow.
+    virtual TState blockLimit(u16 pc) { return 0; }
+    virtual bool isBlockSafe(u16 address) { return false; }
+    virtual bool isBlockSafePort(u16 port) { return false; }
+
+    // Breakpoints.  Called by Z80Core::run after each instruction if asked to.
+    virtual bool shouldBreak(u16 pc) { return false; }
+
+    // Predecode cache.  decodeSlot returns where the decoded form of the instruction at pc is kept (or nullptr to
+    // decode it every time).  The slot must belong to the physical address of pc and be reset to 0 whenever any of
+    // the 4 bytes from pc change or stop being the ones seen at pc.  canDecode is asked before an empty slot is
+    // filled, and can refuse (e.g. for an instruction that crosses into another bank).
+    virtual u16* decodeSlot(u16 pc) { return nullptr; }
+    virtual bool canDecode(u16 pc) { return true; }
+
+    // Decoded-block cache.  blockSlot returns where the decoded block of code starting at pc is kept (or nullptr if
+    // code at pc can't be run from the cache, e.g. because its fetches are contended).  blockSize is called before a
+    // block is decoded and returns how many bytes from pc it may cover.  Each instruction is passed to addCode before
+    // it is added to a block, and from then on codeVersion(pc) must change whenever one of its bytes is written.  Code
+    // versions must never be the same for different memory.
+    virtual u16* blockSlot(u16 pc) { return nullptr; }
+    virtual int blockSize(u16 pc) { return 0; }
+    virtual void addCode(u16 address, int size) {}
+    virtual const u64* codeVersion(u16 pc) { return nullptr; }
 };
 
 //----------------------------------------------------------------------------------------------------------------------
-// Z80 emulation
+// Reasons for Z80Core::run to return before its deadline
+//----------------------------------------------------------------------------------------------------------------------
+
+struct StopConditions
+{
+    bool    breakpoints;    // Stop after any instruction where the bus's shouldBreak(PC) returns true
+    bool    halt;           // Stop after the instruction that halts the CPU
+    bool    single;         // Stop after the first instruction or block
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Z80 state
+// Registers and all the operations that do not touch the bus.
 //----------------------------------------------------------------------------------------------------------------------
 
 class Z80
 {
 public:
 
-    Z80(IExternals& ext);
+    Z80();
 
-    void step(TState& tState);
     void interrupt();
     void nmi();
     void restart();
 
+    // Everything needed to carry on running from between two instructions, used to rewind the machine.
+    struct State
+    {
+        u16     af, bc, de, hl, ix, iy, sp, pc, ir;
+        u16     af_, bc_, de_, hl_;
+        u16     mp;
+        u8      im;
+        bool    halt, iff1, iff2;
+        bool    interrupt, nmi, eiHappened;
+    };
+
+    State getState();
+    void setState(const State& state);
+
     bool isHalted() const { return m_halt; }
 
+    // True if the next step() will respond to an interrupt rather than run an instruction.
+    bool isInterruptDue() const { return m_iff1 && m_interrupt && !m_eiHappened; }
+
+    // The t-state the instruction being run by Z80Core::run started at.  The bus can use this to bring anything that
+    // watches the CPU up to date before the instruction changes it.
+    TState getInstructionStart() const { return m_instructionStart; }
+
+    // Run a halted CPU up to tState 'until' in one go.  This is only equivalent to stepping it if fetching the HALT
+    // is not contended.
+    void skipHalt(TState& tState, TState until);
+
     u8& A() { return m_af.h; }
-    u8& F() { return m_af.l; }
+    u8& F() { if (m_flagOp != kFlagsReady) resolveFlags(); return m_af.l; }
     u8& B() { return m_bc.h; }
     u8& C() { return m_bc.l; }
     u8& D() { return m_de.h; }
@@ -60,7 +131,7 @@ public:
     u8& I() { return m_ir.h; }
     u8& R() { return m_ir.l; }
 
-    u16& AF() { return m_af.r; }
+    u16& AF() { if (m_flagOp != kFlagsReady) resolveFlags(); return m_af.r; }
     u16& BC() { return m_bc.r; }
     u16& DE() { return m_de.r; }
     u16& HL() { return m_hl.r; }
@@ -90,14 +161,26 @@ public:
     static const u8 F_ZERO = 0x40;
     static const u8 F_SIGN = 0x80;
 
-    // Pop is public because it is needed for snapshot loading
-    u16 pop(TState& inOutTState);
-    void push(u16 x, TState& inOutTState);
-
-
-private:
+protected:
     void setFlags(u8 flags, bool value);
 
+    // Lazy flags.  The 8-bit arithmetic and logic operations only record their operands and result, as F is usually
+    // overwritten before anything reads it.  F() and AF() work it out when they are called, and the conditions that
+    // only need the zero, carry or sign flags read them straight from the result.  newF() is for code that is about to
+    // set every bit of F.
+    static const u8 kFlagsReady = 0;    // F is up to date
+    static const u8 kFlagsAdd = 1;      // ADD, ADC: operands and 9-bit result
+    static const u8 kFlagsSub = 2;      // SUB, SBC: operands and 9-bit result
+    static const u8 kFlagsCp = 3;       // CP: operands and 9-bit result
+    static const u8 kFlagsInc = 4;      // INC: carry and result
+    static const u8 kFlagsDec = 5;      // DEC: carry and result
+    static const u8 kFlagsLogic = 6;    // AND, OR, XOR: half carry and result
+
+    void resolveFlags();
+    u8 carryFlag() const;
+    u8& newF() { m_flagOp = kFlagsReady; return m_af.l; }
+    void lazyFlags(u8 op, u8 operand1, u8 operand2, u16 result);
+
     void exx();
     void exAfAf();
 
@@ -129,29 +212,14 @@ private:
     void daa();
     int displacement(u8 x);
 
-    u8& getReg8(u8 y);
-    u16& getReg16_1(u8 p);
-    u16& getReg16_2(u8 p);
-    bool getFlag(u8 y, u8 flags);
-
-    using ALUFunc = function<void(u8&)>;
-    using RotShiftFunc = function<void(u8&)>;
-
-    ALUFunc getAlu(u8 y);
-    RotShiftFunc getRotateShift(u8 y);
-
-    void decodeInstruction(u8 opCode, u8& x, u8& y, u8& z, u8& p, u8& q);
-    u8 fetchInstruction(i64& tState);
-
-    void execute(u8 opCode, i64& tState);
-    void executeDDFDCB(Reg& idx, i64& tState);
-    void executeDDFD(Reg& idx, i64& tState);
-    void executeED(i64& tState);
-
-
-private:
-    IExternals& m_ext;
+    template <int R> u8& reg8();
+    template <int P> u16& reg16_1();
+    template <int P> u16& reg16_2();
+    template <int Y> bool condition();
+    template <int Y> void alu(u8& reg);
+    template <int Y> void rotateShift(u8& reg);
 
+protected:
     // Base registers
     Reg         m_af, m_bc, m_de, m_hl;
     Reg         m_sp, m_pc, m_ix, m_iy;
@@ -163,6 +231,12 @@ private:
     // Internal registers
     Reg         m_mp;
 
+    // Lazy flags
+    u8          m_flagOp;       // kFlagsXXX
+    u8          m_flagOperand1;
+    u8          m_flagOperand2;
+    u16         m_flagResult;
+
     bool        m_halt;
     bool        m_iff1;
     bool        m_iff2;
@@ -171,6 +245,7 @@ private:
     bool        m_nmi;          // Set to false when nmi occurs.
     bool        m_eiHappened;   // Set to false when EI is called.  This stops the interrupt occurring for at least one
                                 // instruction afterwards.
+    TState      m_instructionStart;
 
     u8          m_parity[256];
     u8          m_SZ53[256];
@@ -184,3 +259,118 @@ private:
     static const u8 kOverflowSub[8];
 };
 
+//----------------------------------------------------------------------------------------------------------------------
+// Z80 emulation
+// Runs instructions against a bus of type Bus (see IExternals for the methods it needs).  The implementation lives in
+// z80.cc, which explicitly instantiates the cores used by the emulator.
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename Bus>
+class Z80Core : public Z80
+{
+public:
+
+    Z80Core(Bus& bus);
+
+    void step(TState& tState);
+
+    // Run instructions until tState reaches 'until' or one of the stop conditions is met.  At least one instruction
+    // is always run.  Returns true if it stopped at a breakpoint.  Where the bus allows it, instructions are run in
+    // blocks, with breakpoints only checked between blocks.
+    bool run(TState& tState, TState until, StopConditions stop);
+
+    // Pop is public because it is needed for snapshot loading
+    u16 pop(TState& inOutTState);
+    void push(u16 x, TState& inOutTState);
+
+private:
+    u8 fetchInstruction(TState& tState);
+    bool repeatBlock(TState& tState, TState limit, u16 address1, u16 address2);
+
+    // Predecoded prefixed instructions are the opcode that selects the final handler, ORed with the table it comes
+    // from (kDecodedXXX).  executeDecoded is called once a prefix has been fetched and returns false if the
+    // instruction has to be run the normal way.
+    u16 decode(u16 pc);
+    bool executeDecoded(TState& tState);
+
+    static const u16 kDecodedCB = 0x100;
+    static const u16 kDecodedED = 0x200;
+    static const u16 kDecodedDD = 0x300;
+    static const u16 kDecodedFD = 0x400;
+    static const u16 kDecodedDDCB = 0x500;
+    static const u16 kDecodedFDCB = 0x600;
+    static const u16 kNotDecoded = 0xffff;      // Repeated prefixes or refused by the bus: run the normal way
+
+    // Opcode handlers.  Each is specialised at compile time on the X, Y & Z fields of the opcode (and the index
+    // register for DD/FD) so no decoding happens at run-time.
+    template <int X, int Y, int Z> void executeBase(TState& tState);
+    template <int X, int Y, int Z> void executeCB(TState& tState);
+    template <int X, int Y, int Z> void executeED(TState& tState);
+    template <Reg Z80::*Idx, int X, int Y, int Z> void executeDDFD(TState& tState);
+    template <int X, int Y, int Z> void executeDDFDCB(TState& tState);
+
+    // Dispatch tables, one per prefix, indexed by opcode.
+    using OpFunc = void (Z80Core::*)(TState& tState);
+    using OpTable = array<OpFunc, 256>;
+
+    template <size_t... Op> static constexpr OpTable makeBaseTable(index_sequence<Op...>);
+    template <size_t... Op> static constexpr OpTable makeCBTable(index_sequence<Op...>);
+    template <size_t... Op> static constexpr OpTable makeEDTable(index_sequence<Op...>);
+    template <Reg Z80::*Idx, size_t... Op> static constexpr OpTable makeDDFDTable(index_sequence<Op...>);
+    template <size_t... Op> static constexpr OpTable makeDDFDCBTable(index_sequence<Op...>);
+
+    static const OpTable kBaseOps;
+    static const OpTable kCBOps;
+    static const OpTable kEDOps;
+    static const OpTable kDDOps;
+    static const OpTable kFDOps;
+    static const OpTable kDDFDCBOps;
+
+    // Decoded-block cache.  The first time a straight run of instructions is executed, each instruction is decoded to
+    // the handler it reached and the run is kept as a block.  Later runs call those handlers in turn without the fetch,
+    // decode and interrupt checks between instructions.  This is still the interpreter: no host code is generated and
+    // every handler does exactly what it does in step().  Blocks only run from uncontended memory, so the opcode
+    // fetches always take 4 t-states.  A block ends at the first instruction that doesn't carry on to the next, or as
+    // soon as any code near it is written.  It can be used again if its own code turns out to be unchanged.
+    struct DecodedOp
+    {
+        OpFunc      handler;
+        u16         pc;
+        u8          numFetches;     // Opcode fetches before the handler (1 or 2)
+        u8          index;          // DDCB/FDCB: 1 for IX or 2 for IY, whose displacement is read first
+    };
+
+    struct DecodedBlock
+    {
+        u64         version;        // Bus's code version when decoded
+        u16         pc;
+        u16         numOps;
+        u32         firstOp;        // Index into m_decodedOps
+        u32         firstByte;      // Index into m_decodedBytes
+        u16         numBytes;       // Code bytes the block was decoded from
+        u32         numStaleRuns;   // Times run normally since its code changed
+        u32         staleLimit;     // Recorded again after this many
+    };
+
+    void runDecodedBlock(u16& slot, TState& tState, TState until);
+    void decodeBlock(u16& slot, TState& tState, TState until, u32 staleLimit);
+    bool isSameCode(const DecodedBlock& block);
+
+    static const int kMaxDecodedOps = 64;
+    static const size_t kMaxDecodedBlocks = 65535;     // Slots hold the block's index + 1
+
+    // Code that keeps changing is mostly run normally, as decoding it costs more than it saves.  A block whose code
+    // has changed is only decoded again after it has been run normally a number of times, which doubles each time it
+    // goes stale.
+    static const u32 kMinStaleLimit = 16;
+    static const u32 kMaxStaleLimit = 4096;
+
+private:
+    Bus&                    m_ext;
+    vector<DecodedBlock>    m_decodedBlocks;
+    vector<DecodedOp>       m_decodedOps;
+    vector<u8>              m_decodedBytes;
+};
+
+extern template class Z80Core<IExternals>;
+
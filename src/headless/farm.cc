@@ -0,0 +1,99 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Machine farm implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <headless/farm.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constructor
+//----------------------------------------------------------------------------------------------------------------------
+
+Farm::Farm(int numThreads)
+    : m_numThreads(numThreads)
+    , m_seconds(0)
+{
+    if (m_numThreads <= 0)
+    {
+        m_numThreads = max(1, (int)thread::hardware_concurrency());
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Running
+//----------------------------------------------------------------------------------------------------------------------
+
+Farm::Result Farm::runJob(const Job& job)
+{
+    Headless machine(job.model);
+    Result result = { true, 0, 0, 0, {}, {} };
+
+    for (const auto& file : job.files)
+    {
+        if (!machine.openFile(file))
+        {
+            result.loaded = false;
+            return result;
+        }
+    }
+
+    if (job.check)
+    {
+        while (result.numFrames < job.numFrames)
+        {
+            int numFrames = job.numFrames - result.numFrames;
+            if (numFrames > kCheckFrames) numFrames = kCheckFrames;
+            int numRun = machine.run(numFrames);
+            result.numFrames += numRun;
+            if (numRun < numFrames || job.check(machine)) break;
+        }
+    }
+    else
+    {
+        result.numFrames = machine.run(job.numFrames);
+    }
+    result.tStates = machine.getTStates();
+    result.seconds = machine.getSeconds();
+
+    const u32* image = machine.getSpeccy().getVideoImage();
+    result.image.assign(image, image + kWindowWidth * kWindowHeight);
+    result.text = machine.getScreenText();
+
+    return result;
+}
+
+vector<Farm::Result> Farm::run(const vector<Job>& jobs)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+    vector<Result> results(jobs.size());
+
+    // Each worker takes the next unstarted job until there are none left.  Results are written to separate slots so
+    // no locking is needed.
+    atomic<size_t> nextJob(0);
+    auto worker = [&] {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            results[i] = runJob(jobs[i]);
+        }
+    };
+
+    int numWorkers = min(m_numThreads, (int)jobs.size());
+    vector<thread> threads;
+    for (int i = 1; i < numWorkers; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) t.join();
+
+    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - startTime;
+    m_seconds = elapsed.count();
+
+    return results;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
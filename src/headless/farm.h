@@ -0,0 +1,66 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Machine farm
+// Runs many independent headless machines across a pool of threads.  Each job gets its own Spectrum, so jobs never
+// share emulator state.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <headless/headless.h>
+#include <types.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Farm
+//----------------------------------------------------------------------------------------------------------------------
+
+class Farm
+{
+public:
+    // A thread count of 0 uses one thread per hardware core.
+    Farm(int numThreads = 0);
+
+    struct Job
+    {
+        Model           model;
+        vector<string>  files;      // Loaded in order into the same machine
+        int             numFrames;  // Maximum number of frames to run
+
+        // Called every kCheckFrames frames from the job's worker thread.  Returning true stops the machine early.
+        function<bool(Headless&)> check;
+    };
+
+    struct Result
+    {
+        bool            loaded;     // False if any of the job's files could not be opened
+        int             numFrames;  // Frames actually run
+        TState          tStates;
+        double          seconds;
+        vector<u32>     image;      // Final kWindowWidth x kWindowHeight RGBA image
+        vector<string>  text;       // Final screen text (see Headless::getScreenText)
+    };
+
+    static const int kCheckFrames = 25;
+
+    // Run all the jobs and wait for them to finish.  Results are in the same order as the jobs.
+    vector<Result> run(const vector<Job>& jobs);
+
+    int getNumThreads() const { return m_numThreads; }
+
+    // Wall clock time taken by the last call to run().
+    double getSeconds() const { return m_seconds; }
+
+private:
+    static Result runJob(const Job& job);
+
+private:
+    int         m_numThreads;
+    double      m_seconds;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
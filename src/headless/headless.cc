@@ -0,0 +1,255 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Headless emulator implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/nxfile.h>
+#include <emulator/snapshot.h>
+#include <headless/headless.h>
+#include <utils/filename.h>
+#include <utils/format.h>
+
+#include <algorithm>
+#include <chrono>
+
+// Frames given to the ROM to boot before anything is typed
+static const int kBootFrames = 150;
+
+// Frames each typed key combination is held down for, and then released for
+static const int kKeyFrames = 6;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constructor
+//----------------------------------------------------------------------------------------------------------------------
+
+Headless::Headless(Model model)
+    : m_speccy([] {})
+    , m_tape()
+    , m_rewind()
+    , m_frameCount(0)
+    , m_midFrame(false)
+
+    //--- Typing ---------------------------------------------------------
+    , m_typing()
+    , m_typingStart(0)
+    , m_keyRows(8, 0)
+
+    //--- Frame capture --------------------------------------------------
+    , m_captureInterval(0)
+    , m_frames()
+
+    //--- Statistics -----------------------------------------------------
+    , m_tStates(0)
+    , m_seconds(0)
+{
+    m_speccy.reset(model);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Loading
+//----------------------------------------------------------------------------------------------------------------------
+
+bool Headless::openFile(string fileName)
+{
+    // Get extension
+    Path path = fileName;
+    if (!path.hasExtension()) return false;
+
+    string ext = path.extension();
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    vector<u8> data = NxFile::loadFile(fileName);
+    if (data.empty()) return false;
+
+    if (ext == ".sna")
+    {
+        return loadSnaSnapshot(m_speccy, data);
+    }
+    else if (ext == ".z80")
+    {
+        return loadZ80Snapshot(m_speccy, data);
+    }
+    else if (ext == ".tap")
+    {
+        m_tape = make_unique<Tape>(data);
+        m_tape->selectBlock(0);
+        m_tape->play();
+        m_speccy.setTape(m_tape.get());
+
+        // The tape starts with 2 seconds of silence, which is long enough for the ROM to boot and be told to load.
+        if (m_speccy.getModel() == Model::ZX48)
+        {
+            typeKeys(kBootFrames, { { Key::J }, { Key::SymShift, Key::P }, { Key::SymShift, Key::P }, { Key::Enter } });
+        }
+        else
+        {
+            // The first option on the 128K menu is the tape loader.
+            typeKeys(kBootFrames, { { Key::Enter } });
+        }
+        return true;
+    }
+
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Running
+//----------------------------------------------------------------------------------------------------------------------
+
+void Headless::typeKeys(int startFrame, const vector<vector<Key>>& keys)
+{
+    m_typing = keys;
+    m_typingStart = startFrame;
+}
+
+void Headless::updateKeys()
+{
+    fill(m_keyRows.begin(), m_keyRows.end(), 0);
+
+    int frame = m_frameCount - m_typingStart;
+    int index = frame / (kKeyFrames * 2);
+    if (frame >= 0 && index < (int)m_typing.size() && (frame % (kKeyFrames * 2)) < kKeyFrames)
+    {
+        for (Key key : m_typing[index])
+        {
+            m_keyRows[(int)key / 5] |= u8(1 << ((int)key % 5));
+        }
+    }
+
+    m_speccy.setKeyboardState(m_keyRows);
+}
+
+int Headless::run(int numFrames)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+    TState startTState = m_speccy.getTState();
+    int numRun = 0;
+
+    while (numRun < numFrames)
+    {
+        updateKeys();
+        if (m_rewind) m_rewind->update();
+
+        bool breakpointHit = false;
+        m_speccy.update(RunMode::Normal, breakpointHit);
+        if (breakpointHit) break;
+
+        ++numRun;
+        endFrame();
+    }
+
+    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - startTime;
+    m_seconds += elapsed.count();
+    m_tStates += TState(numRun) * m_speccy.getFrameTime() + m_speccy.getTState() - startTState;
+
+    return numRun;
+}
+
+void Headless::setRewind(bool enabled)
+{
+    if (!enabled)
+    {
+        m_rewind.reset();
+    }
+    else if (!m_rewind)
+    {
+        m_rewind = make_unique<Rewind>(m_speccy);
+    }
+}
+
+bool Headless::runSlice()
+{
+    if (!m_midFrame) updateKeys();
+
+    bool breakpointHit = false;
+    m_midFrame = !m_speccy.updateSlice(breakpointHit);
+    if (!m_midFrame) endFrame();
+
+    return !m_midFrame;
+}
+
+void Headless::endFrame()
+{
+    ++m_frameCount;
+    if (m_captureInterval && (m_frameCount % m_captureInterval) == 0)
+    {
+        const u32* image = m_speccy.getVideoImage();
+        m_frames.push_back({ m_frameCount, vector<u32>(image, image + kWindowWidth * kWindowHeight) });
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Screen text
+//----------------------------------------------------------------------------------------------------------------------
+
+extern const u8 gRom48[16384];
+
+vector<string> Headless::getScreenText() const
+{
+    // The character set for codes 32-127 lives at $3d00 in the 48K ROM.
+    const u8* font = gRom48 + 0x3d00;
+    int videoBank = m_speccy.getVideoBank();
+    int bankSize = m_speccy.getBankSize();
+
+    vector<string> lines(24, string(32, ' '));
+    for (int row = 0; row < 24; ++row)
+    {
+        for (int col = 0; col < 32; ++col)
+        {
+            u8 cell[8];
+            u8 allOr = 0;
+            u8 allAnd = 0xff;
+            for (int line = 0; line < 8; ++line)
+            {
+                int addr = ((row & 0x18) << 8) + (line << 8) + ((row & 7) << 5) + col;
+                cell[line] = m_speccy.bankPeek(u16(videoBank + addr / bankSize), u16(addr % bankSize));
+                allOr |= cell[line];
+                allAnd &= cell[line];
+            }
+            if (allOr == 0 || allAnd == 0xff) continue;
+
+            char c = '?';
+            for (int ch = 0; ch < 96; ++ch)
+            {
+                const u8* glyph = font + ch * 8;
+                bool normal = true;
+                bool inverse = true;
+                for (int line = 0; line < 8; ++line)
+                {
+                    normal = normal && cell[line] == glyph[line];
+                    inverse = inverse && cell[line] == u8(~glyph[line]);
+                }
+                if (normal || inverse)
+                {
+                    c = char(32 + ch);
+                    break;
+                }
+            }
+            lines[row][col] = c;
+        }
+    }
+
+    return lines;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Frame capture
+//----------------------------------------------------------------------------------------------------------------------
+
+bool Headless::saveImage(string fileName, const u32* image)
+{
+    string header = stringFormat("P6\n{0} {1}\n255\n", kWindowWidth, kWindowHeight);
+    vector<u8> data(header.begin(), header.end());
+    data.reserve(data.size() + kWindowWidth * kWindowHeight * 3);
+
+    // Pixels are stored as R, G, B, A bytes.
+    const u8* pixels = (const u8 *)image;
+    for (int i = 0; i < kWindowWidth * kWindowHeight; ++i, pixels += 4)
+    {
+        data.insert(data.end(), pixels, pixels + 3);
+    }
+
+    return NxFile::saveFile(fileName, data);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,115 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Headless emulator
+// Runs a Spectrum with no window or audio device, as fast as the host allows.  Used for batch regression and
+// benchmarking.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <emulator/rewind.h>
+#include <emulator/spectrum.h>
+#include <tape/tape.h>
+#include <types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Headless
+//----------------------------------------------------------------------------------------------------------------------
+
+class Headless
+{
+public:
+    Headless(Model model);
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Loading
+    //------------------------------------------------------------------------------------------------------------------
+
+    // Load a .sna, .z80 or .tap file.  Tapes start playing straight away and LOAD "" is typed once the ROM has
+    // booted.
+    bool openFile(string fileName);
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Running
+    //------------------------------------------------------------------------------------------------------------------
+
+    // Type a sequence of key combinations starting at the given frame.  Each combination is held down for a few
+    // frames and then released for the same time.
+    void typeKeys(int startFrame, const vector<vector<Key>>& keys);
+
+    // Run for a number of frames.  Returns the number actually run, which is fewer if a breakpoint was hit.
+    int run(int numFrames);
+
+    // Run one slice of a frame (see Spectrum::updateSlice).  Returns true if it completed a frame.  Statistics are
+    // only kept by run().
+    bool runSlice();
+
+    Spectrum& getSpeccy() { return m_speccy; }
+
+    // Record a rewind history while run() runs, to measure what it costs.
+    void setRewind(bool enabled);
+    Rewind* getRewind() { return m_rewind.get(); }
+    int getFrameCount() const { return m_frameCount; }
+
+    // Read the text on the screen as 24 lines of 32 characters by matching each character cell against the ROM font.
+    // Inverse characters are matched too.  Blank cells become spaces and cells that don't match become '?'.
+    vector<string> getScreenText() const;
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Frame capture
+    //------------------------------------------------------------------------------------------------------------------
+
+    struct Frame
+    {
+        int             index;      // Frame number the image was taken at
+        vector<u32>     image;      // kWindowWidth x kWindowHeight RGBA pixels
+    };
+
+    // Keep a copy of every nth frame's image (0 to keep none).
+    void setCaptureInterval(int interval) { m_captureInterval = interval; }
+
+    const vector<Frame>& getFrames() const { return m_frames; }
+
+    // Write an image as a binary PPM file.
+    static bool saveImage(string fileName, const u32* image);
+
+    //------------------------------------------------------------------------------------------------------------------
+    // Statistics
+    //------------------------------------------------------------------------------------------------------------------
+
+    // T-states emulated by run() and the time it took.
+    TState getTStates() const { return m_tStates; }
+    double getSeconds() const { return m_seconds; }
+    double getEmulatedMHz() const { return m_seconds > 0 ? double(m_tStates) / m_seconds / 1000000.0 : 0; }
+
+private:
+    void updateKeys();
+    void endFrame();
+
+private:
+    Spectrum                m_speccy;
+    unique_ptr<Tape>        m_tape;
+    unique_ptr<Rewind>      m_rewind;
+    int                     m_frameCount;
+    bool                    m_midFrame;         // Part of the current frame has been run by runSlice()
+
+    // Typing
+    vector<vector<Key>>     m_typing;
+    int                     m_typingStart;
+    vector<u8>              m_keyRows;
+
+    // Frame capture
+    int                     m_captureInterval;
+    vector<Frame>           m_frames;
+
+    // Statistics
+    TState                  m_tStates;
+    double                  m_seconds;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,273 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Lockstep checker implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <asm/disasm.h>
+#include <headless/lockstep.h>
+#include <utils/format.h>
+
+#include <algorithm>
+
+// Differing bytes listed in a report
+static const size_t kMaxBytesShown = 16;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constructor
+//----------------------------------------------------------------------------------------------------------------------
+
+Lockstep::Lockstep(Model model, const Settings& test)
+    : m_reference(model)
+    , m_test(model)
+    , m_numChecks(0)
+    , m_report()
+    , m_history()
+    , m_testStart(0)
+{
+    Spectrum& ref = m_reference.getSpeccy();
+    ref.setHaltSkip(false);
+    ref.setDecodeCache(false);
+    ref.setBlockCache(false);
+    ref.setBulkRepeat(false);
+
+    Spectrum& speccy = m_test.getSpeccy();
+    speccy.setHaltSkip(test.haltSkip);
+    speccy.setDecodeCache(test.decodeCache);
+    speccy.setBlockCache(test.blockCache);
+    speccy.setBulkRepeat(test.bulkRepeat);
+    copyMemory();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Loading
+//----------------------------------------------------------------------------------------------------------------------
+
+bool Lockstep::openFile(string fileName)
+{
+    if (!m_reference.openFile(fileName) || !m_test.openFile(fileName)) return false;
+    copyMemory();
+    return true;
+}
+
+void Lockstep::copyMemory()
+{
+    // Memory is filled with random bytes on power up and whatever the programs didn't load is left that way.
+    Spectrum& ref = m_reference.getSpeccy();
+    Spectrum& test = m_test.getSpeccy();
+    for (u16 bank = 0; bank < ref.getNumBanks(); ++bank)
+    {
+        for (u16 offset = 0; offset < ref.getBankSize(); ++offset)
+        {
+            test.bankPoke(bank, offset, ref.bankPeek(bank, offset));
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Running
+//----------------------------------------------------------------------------------------------------------------------
+
+TState Lockstep::time(Headless& machine)
+{
+    Spectrum& speccy = machine.getSpeccy();
+    return TState(machine.getFrameCount()) * speccy.getFrameTime() + speccy.getTState();
+}
+
+bool Lockstep::run(int numFrames)
+{
+    Spectrum& ref = m_reference.getSpeccy();
+    Spectrum& test = m_test.getSpeccy();
+
+    // Loading writes memory without going through the CPU, so start from a full comparison.
+    m_testStart = test.getZ80().PC();
+    if (!compareCpus() || !compareFrames()) return false;
+
+    ref.setWriteTracking(true);
+    test.setWriteTracking(true);
+
+    int endFrame = m_test.getFrameCount() + numFrames;
+    vector<u32> addresses;
+    bool ok = true;
+
+    while (ok && m_test.getFrameCount() < endFrame)
+    {
+        // The test machine runs as much as it likes in one go.  The reference, which only ever runs one instruction at
+        // a time, must land on exactly the same t-state.
+        m_testStart = test.getZ80().PC();
+        bool frameDone = m_test.runSlice();
+
+        TState target = time(m_test);
+        while (time(m_reference) < target)
+        {
+            u16 pc = ref.getZ80().PC();
+            if (m_history.empty() || m_history.back() != pc)
+            {
+                if (m_history.size() == kHistorySize) m_history.erase(m_history.begin());
+                m_history.push_back(pc);
+            }
+            m_reference.runSlice();
+        }
+
+        ++m_numChecks;
+        if (time(m_reference) != target)
+        {
+            fail(stringFormat("The reference reached t-state {0} but the test machine stopped at {1}.",
+                time(m_reference), target));
+            ok = false;
+            break;
+        }
+
+        addresses.swap(ref.getWrites());
+        addresses.insert(addresses.end(), test.getWrites().begin(), test.getWrites().end());
+        test.getWrites().clear();
+        sort(addresses.begin(), addresses.end());
+        addresses.erase(unique(addresses.begin(), addresses.end()), addresses.end());
+        ok = compareCpus() && compareMemory(addresses) && (!frameDone || compareFrames());
+        addresses.clear();
+    }
+
+    ref.setWriteTracking(false);
+    test.setWriteTracking(false);
+    return ok;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Comparison
+//----------------------------------------------------------------------------------------------------------------------
+
+bool Lockstep::compareCpus()
+{
+    Spectrum& refSpeccy = m_reference.getSpeccy();
+    Spectrum& testSpeccy = m_test.getSpeccy();
+    Z80& ref = refSpeccy.getZ80();
+    Z80& test = testSpeccy.getZ80();
+
+    struct Reg16
+    {
+        const char*     name;
+        u16             ref;
+        u16             test;
+    };
+
+    Reg16 regs[] = {
+        { "AF", ref.AF(), test.AF() },
+        { "BC", ref.BC(), test.BC() },
+        { "DE", ref.DE(), test.DE() },
+        { "HL", ref.HL(), test.HL() },
+        { "AF'", ref.AF_(), test.AF_() },
+        { "BC'", ref.BC_(), test.BC_() },
+        { "DE'", ref.DE_(), test.DE_() },
+        { "HL'", ref.HL_(), test.HL_() },
+        { "IX", ref.IX(), test.IX() },
+        { "IY", ref.IY(), test.IY() },
+        { "SP", ref.SP(), test.SP() },
+        { "PC", ref.PC(), test.PC() },
+        { "IR", ref.IR(), test.IR() },
+        { "MEMPTR", ref.MP(), test.MP() },
+        { "IFF1", ref.IFF1(), test.IFF1() },
+        { "IFF2", ref.IFF2(), test.IFF2() },
+        { "IM", u16(ref.IM()), u16(test.IM()) },
+        { "Halted", ref.isHalted(), test.isHalted() },
+        { "Border", refSpeccy.getBorderColour(), testSpeccy.getBorderColour() },
+    };
+
+    string diffs;
+    for (const auto& reg : regs)
+    {
+        if (reg.ref != reg.test)
+        {
+            diffs += stringFormat("    {0} reference ${1} test ${2}\n", reg.name, hexWord(reg.ref), hexWord(reg.test));
+        }
+    }
+    for (int slot = 0; slot < refSpeccy.getNumSlots(); ++slot)
+    {
+        if (refSpeccy.getBank(slot) != testSpeccy.getBank(slot))
+        {
+            diffs += stringFormat("    Slot {0} reference bank {1} test bank {2}\n", slot, refSpeccy.getBank(slot),
+                testSpeccy.getBank(slot));
+        }
+    }
+
+    if (!diffs.empty()) fail("Machine state differs:\n" + diffs);
+    return diffs.empty();
+}
+
+bool Lockstep::compareMemory(const vector<u32>& addresses)
+{
+    Spectrum& ref = m_reference.getSpeccy();
+    Spectrum& test = m_test.getSpeccy();
+    u32 bankSize = ref.getBankSize();
+
+    string diffs;
+    size_t numDiffs = 0;
+    for (u32 address : addresses)
+    {
+        u16 bank = u16(address / bankSize);
+        u16 offset = u16(address % bankSize);
+        u8 refByte = ref.bankPeek(bank, offset);
+        u8 testByte = test.bankPeek(bank, offset);
+        if (refByte != testByte && numDiffs++ < kMaxBytesShown)
+        {
+            diffs += stringFormat("    {0} reference ${1} test ${2}\n", ref.physicalAddressName(address),
+                hexByte(refByte), hexByte(testByte));
+        }
+    }
+
+    if (numDiffs > kMaxBytesShown) diffs += stringFormat("    ...and {0} more\n", numDiffs - kMaxBytesShown);
+    if (numDiffs) fail("Memory differs:\n" + diffs);
+    return numDiffs == 0;
+}
+
+bool Lockstep::compareFrames()
+{
+    Spectrum& ref = m_reference.getSpeccy();
+    Spectrum& test = m_test.getSpeccy();
+
+    vector<u32> addresses(u32(ref.getNumBanks()) * ref.getBankSize());
+    for (u32 i = 0; i < addresses.size(); ++i) addresses[i] = i;
+    if (!compareMemory(addresses)) return false;
+
+    const u32* refImage = ref.getVideoImage();
+    const u32* testImage = test.getVideoImage();
+    auto diff = mismatch(refImage, refImage + kWindowWidth * kWindowHeight, testImage);
+    if (diff.first != refImage + kWindowWidth * kWindowHeight)
+    {
+        int pixel = int(diff.first - refImage);
+        fail(stringFormat("Video image differs, starting at ({0}, {1}).\n", pixel % kWindowWidth, pixel / kWindowWidth));
+        return false;
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reporting
+//----------------------------------------------------------------------------------------------------------------------
+
+string Lockstep::describeHistory()
+{
+    Spectrum& ref = m_reference.getSpeccy();
+    Disassembler d;
+    string s;
+    for (u16 pc : m_history)
+    {
+        d.disassemble(pc, ref.peek(pc), ref.peek(pc + 1), ref.peek(pc + 2), ref.peek(pc + 3));
+        s += stringFormat("    ${0}  {1} {2}\n", hexWord(pc), d.opCodeString(), d.operandString());
+    }
+    return s;
+}
+
+void Lockstep::fail(const string& what)
+{
+    Spectrum& test = m_test.getSpeccy();
+    m_report = stringFormat("Frame {0}, t-state {1}, after {2} checks.\n", m_test.getFrameCount(), test.getTState(),
+        m_numChecks);
+    m_report += stringFormat("The test machine ran from ${0} to ${1}.\n", hexWord(m_testStart), hexWord(test.getZ80().PC()));
+    if (!m_history.empty())
+    {
+        m_report += "The reference's last instructions were:\n" + describeHistory();
+    }
+    m_report += what;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
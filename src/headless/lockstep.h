@@ -0,0 +1,74 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Lockstep checker
+// Runs the same files on two headless machines, a reference that steps the plain interpreter one instruction at a time
+// and a test machine with the fast paths under test, and stops at the first point where they disagree.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <headless/headless.h>
+#include <types.h>
+
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Lockstep
+//----------------------------------------------------------------------------------------------------------------------
+
+class Lockstep
+{
+public:
+    // The Spectrum features that change how the CPU is run.  The reference machine has all of them turned off.
+    struct Settings
+    {
+        bool    haltSkip;
+        bool    decodeCache;
+        bool    blockCache;
+        bool    bulkRepeat;
+    };
+
+    Lockstep(Model model, const Settings& test);
+
+    // Load a .sna, .z80 or .tap file into both machines.
+    bool openFile(string fileName);
+
+    // Run both machines for a number of frames.  Every time the test machine finishes an instruction or block, the
+    // reference is stepped up to the same t-state and the CPU state and the memory either has written are compared.
+    // The whole of memory and the video image are compared at the end of each frame.  Returns false at the first
+    // difference.
+    bool run(int numFrames);
+
+    // A description of the first difference found by run().
+    const string& getReport() const { return m_report; }
+
+    int getFrameCount() const { return m_test.getFrameCount(); }
+    i64 getNumChecks() const { return m_numChecks; }
+
+    Headless& getReference() { return m_reference; }
+    Headless& getTest() { return m_test; }
+
+private:
+    void copyMemory();
+    TState time(Headless& machine);
+    bool compareCpus();
+    bool compareMemory(const vector<u32>& addresses);
+    bool compareFrames();
+    void fail(const string& what);
+    string describeHistory();
+
+private:
+    Headless            m_reference;
+    Headless            m_test;
+    i64                 m_numChecks;
+    string              m_report;
+
+    // The PCs of the last few instructions run by the reference, and where the test machine's last slice started.
+    static const int    kHistorySize = 8;
+    vector<u16>         m_history;
+    u16                 m_testStart;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,280 @@
+//----------------------------------------------------------------------------------------------------------------------
+// NX headless runner
+//
+// Usage: nx-headless [-model=48|128|plus2] [-frames=<n>] [-capture=<n>] [-dump=<prefix>] [-jobs=<n>]
+//                    [-profile=<file>] [-rewind] <file>...
+//
+//      -model      Machine to emulate (default 48)
+//      -frames     Number of frames to run (default 500)
+//      -capture    Keep every nth frame in memory (default 0, which only keeps the last if dumping)
+//      -dump       Write the kept frames as <prefix><frame>.ppm
+//      -jobs       Run each file in its own machine, using this many threads (0 for one per core)
+//      -profile    Profile the run, print the hot spots, opcode mix and call graph, and write all the counts to a CSV
+//                  file
+//      -rewind     Record a rewind history while running and report its size
+//
+// Files can be .sna, .z80 or .tap.  Without -jobs they are all loaded into one machine.  Reports the emulated speed on
+// exit.
+//
+//       nx-headless -test[=<folder>] [-jobs=<n>] [-slow] [<suite>...]
+//
+// Runs the test programs in the folder (default etc/tests) and reports which passed.  All the quick suites are run if
+// none are named, plus the slow ones with -slow.  Suites are spread over one thread per core unless -jobs is given.
+//
+//       nx-headless -lockstep [-model=48|128|plus2] [-frames=<n>] [-nohaltskip] [-nodecode] [-noblocks] [-nobulk]
+//                   <file>...
+//
+// Runs the files on a reference machine that steps the plain interpreter and a test machine with the halt skip,
+// predecode cache, decoded-block cache and bulk block instructions (unless turned off), and stops with a report at the
+// first difference between them.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <emulator/nxfile.h>
+#include <headless/farm.h>
+#include <headless/headless.h>
+#include <headless/lockstep.h>
+#include <headless/testrunner.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Settings
+//----------------------------------------------------------------------------------------------------------------------
+
+static map<string, string> gSettings;
+
+static string getSetting(string key, string defaultSetting)
+{
+    auto it = gSettings.find(key);
+    return it == gSettings.end() ? defaultSetting : it->second;
+}
+
+static string frameFileName(const string& prefix, int frame)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%05d.ppm", frame);
+    return prefix + name;
+}
+
+static bool parseModel(const string& name, Model& model)
+{
+    if (name == "48")           model = Model::ZX48;
+    else if (name == "128")     model = Model::ZX128;
+    else if (name == "plus2")   model = Model::ZXPlus2;
+    else return false;
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Farm mode
+//----------------------------------------------------------------------------------------------------------------------
+
+static int runFarm(Model model, const vector<string>& files, int numFrames, int numThreads, const string& dumpPrefix)
+{
+    vector<Farm::Job> jobs;
+    for (const auto& file : files)
+    {
+        jobs.push_back({ model, { file }, numFrames, nullptr });
+    }
+
+    Farm farm(numThreads);
+    vector<Farm::Result> results = farm.run(jobs);
+
+    int exitCode = 0;
+    TState totalTStates = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Farm::Result& result = results[i];
+        if (!result.loaded)
+        {
+            fprintf(stderr, "Cannot load '%s'.\n", files[i].c_str());
+            exitCode = 1;
+            continue;
+        }
+
+        printf("%-40s %6d frames  %8.2f MHz\n", files[i].c_str(), result.numFrames,
+            result.seconds > 0 ? double(result.tStates) / result.seconds / 1000000.0 : 0.0);
+        totalTStates += result.tStates;
+        if (result.numFrames != numFrames && !exitCode) exitCode = 2;
+
+        if (!dumpPrefix.empty())
+        {
+            Headless::saveImage(frameFileName(dumpPrefix + to_string(i) + "_", result.numFrames), result.image.data());
+        }
+    }
+
+    printf("Machines:      %d\n", (int)results.size());
+    printf("Threads:       %d\n", farm.getNumThreads());
+    printf("Time:          %.3fs\n", farm.getSeconds());
+    printf("Emulated MHz:  %.2f\n", farm.getSeconds() > 0 ? double(totalTStates) / farm.getSeconds() / 1000000.0 : 0.0);
+
+    return exitCode;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Lockstep mode
+//----------------------------------------------------------------------------------------------------------------------
+
+static int runLockstep(Model model, const vector<string>& files, int numFrames)
+{
+    Lockstep::Settings settings = {
+        !gSettings.count("nohaltskip"),
+        !gSettings.count("nodecode"),
+        !gSettings.count("noblocks"),
+        !gSettings.count("nobulk"),
+    };
+
+    Lockstep lockstep(model, settings);
+    for (const auto& file : files)
+    {
+        if (!lockstep.openFile(file))
+        {
+            fprintf(stderr, "Cannot load '%s'.\n", file.c_str());
+            return 1;
+        }
+    }
+
+    if (!lockstep.run(numFrames))
+    {
+        printf("Machines diverged.\n%s", lockstep.getReport().c_str());
+        return 3;
+    }
+
+    printf("Frames:        %d\n", lockstep.getFrameCount());
+    printf("Checks:        %lld\n", (long long)lockstep.getNumChecks());
+    printf("No differences.\n");
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Main entry point
+//----------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    // Deal with the command line
+    vector<string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        char* arg = argv[i];
+        if (arg[0] == '-')
+        {
+            // Setting being added
+            char* keyEnd = strchr(arg, '=');
+            char* keyStart = arg + 1;
+            if (keyEnd)
+            {
+                gSettings[string(keyStart, keyEnd)] = string(keyEnd + 1);
+            }
+            else
+            {
+                // Assume key is "yes"
+                gSettings[keyStart] = "yes";
+            }
+        }
+        else
+        {
+            files.emplace_back(arg);
+        }
+    }
+
+    if (gSettings.count("test"))
+    {
+        string testsPath = getSetting("test", "yes");
+        return runTestSuites(testsPath == "yes" ? "etc/tests" : testsPath, files, atoi(getSetting("jobs", "0").c_str()),
+            gSettings.count("slow") != 0);
+    }
+
+    Model model;
+    if (!parseModel(getSetting("model", "48"), model))
+    {
+        fprintf(stderr, "Unknown model '%s'.  Use 48, 128 or plus2.\n", getSetting("model", "").c_str());
+        return 1;
+    }
+
+    int numFrames = atoi(getSetting("frames", "500").c_str());
+    int captureInterval = atoi(getSetting("capture", "0").c_str());
+    string dumpPrefix = getSetting("dump", "");
+
+    if (gSettings.count("lockstep"))
+    {
+        return runLockstep(model, files, numFrames);
+    }
+
+    if (gSettings.count("jobs"))
+    {
+        return runFarm(model, files, numFrames, atoi(getSetting("jobs", "0").c_str()), dumpPrefix);
+    }
+
+    string profileFile = getSetting("profile", "");
+
+    Headless machine(model);
+    machine.setCaptureInterval(captureInterval);
+    machine.getSpeccy().setProfiling(!profileFile.empty());
+    machine.setRewind(gSettings.count("rewind") != 0);
+    for (const auto& file : files)
+    {
+        if (!machine.openFile(file))
+        {
+            fprintf(stderr, "Cannot load '%s'.\n", file.c_str());
+            return 1;
+        }
+    }
+
+    int numRun = machine.run(numFrames);
+
+    if (!dumpPrefix.empty())
+    {
+        if (machine.getFrames().empty())
+        {
+            // Nothing captured along the way, so dump the final image.
+            Headless::saveImage(frameFileName(dumpPrefix, machine.getFrameCount()), machine.getSpeccy().getVideoImage());
+        }
+        for (const auto& frame : machine.getFrames())
+        {
+            Headless::saveImage(frameFileName(dumpPrefix, frame.index), frame.image.data());
+        }
+    }
+
+    if (!profileFile.empty())
+    {
+        Spectrum& speccy = machine.getSpeccy();
+        Profiler& profiler = speccy.getProfiler();
+        for (const auto& line : profiler.hotSpotReport(speccy, Profiler::Sort::TStates, 20)) printf("%s\n", line.c_str());
+        printf("\n");
+        for (const auto& line : profiler.opCodeReport(20)) printf("%s\n", line.c_str());
+        printf("\n");
+
+        // There are no labels here, so routines are named by address.
+        auto name = [&speccy](u16 address, u32 physAddress) { return speccy.physicalAddressName(physAddress); };
+        for (const auto& line : speccy.getCallStack().report(name, 20)) printf("%s\n", line.c_str());
+        printf("\n");
+
+        string csv = profiler.csv(speccy) + "\n" + speccy.getCallStack().csv(name);
+        if (!NxFile::saveFile(profileFile, vector<u8>(csv.begin(), csv.end())))
+        {
+            fprintf(stderr, "Cannot write '%s'.\n", profileFile.c_str());
+        }
+    }
+
+    if (Rewind* rewind = machine.getRewind())
+    {
+        printf("Rewind:        %d snapshots, %dK of changes\n", (int)rewind->getNumSnapshots(),
+            (int)(rewind->getMemoryUsed() / 1024));
+    }
+
+    printf("Frames:        %d\n", numRun);
+    printf("T-states:      %lld\n", (long long)machine.getTStates());
+    printf("Time:          %.3fs\n", machine.getSeconds());
+    printf("Emulated MHz:  %.2f\n", machine.getEmulatedMHz());
+    printf("Frames/sec:    %.1f\n", machine.getSeconds() > 0 ? numRun / machine.getSeconds() : 0.0);
+
+    return numRun == numFrames ? 0 : 2;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Test ROM runner implementation
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <headless/farm.h>
+#include <headless/testrunner.h>
+
+#include <algorithm>
+#include <cstdio>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Suites
+//----------------------------------------------------------------------------------------------------------------------
+
+// Quick suites finish within a few minutes of emulated time.  The known failures are details that aren't emulated yet:
+// the Z80's Q register (which affects the undocumented flags of SCF and CCF), the floating bus and the ULA's early/late
+// timing.  The ULA and contention tapes time everything by sampling the floating bus, so rows of idle bus values are
+// their failures.  btime, stime and IR_Contention are interactive or only draw in the border, so all they can show
+// here is that they load and start.
+static const TestSuite gSuites[] =
+{
+    // Name            File                         Model        Frames   Done              Pass                Fail                       Slow   Known
+    { "fusetest",      "fusetest.tap",              Model::ZX48, 4000,    "0 OK",           nullptr,            "failed",                  false, true },
+    { "z80doc",        "z80doc.tap",                Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, false },
+    { "z80docflags",   "z80docflags.tap",           Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, false },
+    { "z80flags",      "z80flags.tap",              Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, true },
+    { "z80full",       "z80full.tap",               Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, true },
+    { "z80memptr",     "z80memptr.tap",             Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, false },
+    { "z80ccf",        "z80ccf.tap",                Model::ZX48, 200000,  "Result:",        "all tests passed", "FAILED",                  false, true },
+    { "timing48",      "Timing_Tests-48k_v1.0.sna", Model::ZX48, 3000,    "STOP statement", nullptr,            "UNKNOWN",                 false, true },
+    { "ulatest2",      "ulatest2.tap",              Model::ZX48, 4000,    "14345",          nullptr,            "FF FF FF FF FF FF FF FF", false, true },
+    { "ulatest2a",     "ulatest2a.tap",             Model::ZX48, 4000,    "14344",          nullptr,            "FF FF FF FF FF FF FF FF", false, true },
+    { "ulatest3",      "ulatest3.tap",              Model::ZX48, 4000,    "14345",          nullptr,            "FF FF FF FF FF FF FF FF", false, true },
+    { "contention",    "contention.tap",            Model::ZX48, 4000,    " = ",            nullptr,            "00,00,00,00 = 00",        false, true },
+    { "iocontention",  "iocontention.tap",          Model::ZX48, 4000,    "3800:",          nullptr,            "00,00,00,00 = 00",        false, true },
+    { "IR_Contention", "IR_Contention.tap",         Model::ZX48, 4000,    "symmetrical",    nullptr,            nullptr,                   false, false },
+    { "btime",         "btime.tap",                 Model::ZX48, 4000,    "Q:inc",          nullptr,            nullptr,                   false, false },
+    { "stime",         "stime.tap",                 Model::ZX48, 4000,    "Q:inc",          nullptr,            nullptr,                   false, false },
+    { "prtiming",      "prtiming.tap",              Model::ZX48, 4000,    "Choose test",    "duration: 69888",  nullptr,                   false, false },
+    { "zexfix",        "zexfix.tap",                Model::ZX48, 2000000, "Tests complete", nullptr,            "ERROR",                   true,  false },
+    { "zexall",        "../zexall.sna",             Model::ZX48, 2000000, "Tests complete", nullptr,            "ERROR",                   true,  false },
+};
+
+// Failing lines listed per suite in the report
+static const size_t kMaxFailuresShown = 5;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Screen scanning
+//----------------------------------------------------------------------------------------------------------------------
+
+static bool screenContains(const vector<string>& text, const char* str)
+{
+    return any_of(text.begin(), text.end(), [str](const string& line) { return line.find(str) != string::npos; });
+}
+
+static string trim(const string& str)
+{
+    size_t start = str.find_first_not_of(' ');
+    size_t end = str.find_last_not_of(' ');
+    return start == string::npos ? string() : str.substr(start, end - start + 1);
+}
+
+// Remember every line containing the suite's failure text, since they usually scroll away before the end.
+static void collectFailures(const TestSuite& suite, const vector<string>& text, vector<string>& failures)
+{
+    if (!suite.failText) return;
+    for (const auto& line : text)
+    {
+        if (line.find(suite.failText) != string::npos)
+        {
+            string failure = trim(line);
+            if (find(failures.begin(), failures.end(), failure) == failures.end())
+            {
+                failures.push_back(failure);
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Running
+//----------------------------------------------------------------------------------------------------------------------
+
+int runTestSuites(const string& testsPath, const vector<string>& names, int numThreads, bool includeSlow)
+{
+    for (const auto& name : names)
+    {
+        if (none_of(begin(gSuites), end(gSuites), [&name](const TestSuite& suite) { return name == suite.name; }))
+        {
+            fprintf(stderr, "Unknown test suite '%s'.  Available suites are:\n", name.c_str());
+            for (const auto& suite : gSuites) fprintf(stderr, "    %s\n", suite.name);
+            return 1;
+        }
+    }
+
+    vector<const TestSuite*> suites;
+    for (const auto& suite : gSuites)
+    {
+        bool named = find(names.begin(), names.end(), suite.name) != names.end();
+        if (named || (names.empty() && (includeSlow || !suite.slow)))
+        {
+            suites.push_back(&suite);
+        }
+    }
+
+    // Each job only touches its own failure list so the checks can run on any thread.
+    vector<vector<string>> failures(suites.size());
+    vector<Farm::Job> jobs;
+    for (size_t i = 0; i < suites.size(); ++i)
+    {
+        const TestSuite& suite = *suites[i];
+        vector<string>& suiteFailures = failures[i];
+        jobs.push_back({ suite.model, { testsPath + "/" + suite.file }, suite.maxFrames,
+            [&suite, &suiteFailures](Headless& machine) {
+                vector<string> text = machine.getScreenText();
+                collectFailures(suite, text, suiteFailures);
+
+                // Answer the ROM's scroll prompt so long reports keep going.
+                if (screenContains(text, "scroll?"))
+                {
+                    machine.typeKeys(machine.getFrameCount(), { { Key::Enter } });
+                }
+                return screenContains(text, suite.doneText);
+            } });
+    }
+
+    Farm farm(numThreads);
+    vector<Farm::Result> results = farm.run(jobs);
+
+    printf("%-14s %-14s %8s %10s %9s %8s\n", "Suite", "Result", "Frames", "Emulated", "Wall", "MHz");
+
+    int numPassed = 0;
+    int numUnexpected = 0;
+    double totalSeconds = 0;
+    for (size_t i = 0; i < suites.size(); ++i)
+    {
+        const TestSuite& suite = *suites[i];
+        const Farm::Result& result = results[i];
+        collectFailures(suite, result.text, failures[i]);
+
+        bool done = result.loaded && screenContains(result.text, suite.doneText);
+        bool passed = done && failures[i].empty() && (!suite.passText || screenContains(result.text, suite.passText));
+
+        const char* status = !result.loaded ? "LOAD FAILED" : !done ? "TIMEOUT" : passed ? "PASS" : "FAIL";
+        string note;
+        if (suite.knownFailure)
+        {
+            note = passed ? " (unexpected)" : " (known)";
+        }
+        if (passed) ++numPassed;
+        if (passed == suite.knownFailure) ++numUnexpected;
+        totalSeconds += result.seconds;
+
+        printf("%-14s %-14s %8d %9.1fs %8.2fs %8.2f\n", suite.name, (string(status) + note).c_str(), result.numFrames,
+            result.numFrames / 50.0, result.seconds,
+            result.seconds > 0 ? double(result.tStates) / result.seconds / 1000000.0 : 0.0);
+
+        if (!passed)
+        {
+            for (size_t f = 0; f < failures[i].size() && f < kMaxFailuresShown; ++f)
+            {
+                printf("    %s\n", failures[i][f].c_str());
+            }
+            if (failures[i].size() > kMaxFailuresShown)
+            {
+                printf("    ...and %d more\n", int(failures[i].size() - kMaxFailuresShown));
+            }
+            if (done && failures[i].empty())
+            {
+                // No individual failures seen so show the summary instead.
+                for (const auto& line : result.text)
+                {
+                    if (line.find(suite.doneText) != string::npos) printf("    %s\n", trim(line).c_str());
+                }
+            }
+        }
+    }
+
+    printf("\n%d of %d suites passed, %d unexpected.  %.2fs wall time on %d threads (%.2fs of emulation).\n",
+        numPassed, (int)suites.size(), numUnexpected, farm.getSeconds(), farm.getNumThreads(), totalSeconds);
+
+    return numUnexpected ? 3 : 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,38 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Test ROM runner
+// Runs the test programs in etc/tests across a farm of headless machines and decides whether each passed by reading
+// what it printed on the screen.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <config.h>
+#include <emulator/spectrum.h>
+#include <types.h>
+
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Test suites
+//----------------------------------------------------------------------------------------------------------------------
+
+struct TestSuite
+{
+    const char*     name;
+    const char*     file;           // Relative to the tests folder
+    Model           model;
+    int             maxFrames;      // Give up after this many frames
+    const char*     doneText;       // Appears on screen when the suite has finished
+    const char*     passText;       // Must be on screen when finished (or nullptr)
+    const char*     failText;       // Must never be seen on screen (or nullptr)
+    bool            slow;           // Only run when asked for by name or with -slow
+    bool            knownFailure;   // Fails on this emulator; doesn't affect the exit code
+};
+
+// Run the named suites (or all of the quick ones if the list is empty) from the tests folder on the given number of
+// threads.  Prints a line per suite and returns 0 if every suite passed or failed as expected.
+int runTestSuites(const string& testsPath, const vector<string>& names, int numThreads, bool includeSlow);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,60 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Tape browser UI
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <tape/tape.h>
+#include <utils/ui.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// TapeWindow
+//----------------------------------------------------------------------------------------------------------------------
+
+class TapeWindow final : public Window
+{
+public:
+    TapeWindow(Nx& nx);
+
+    void reset();
+    void setTape(Tape *tape)    { m_tape = tape; reset(); m_tape->selectBlock(0); }
+    void ejectTape()            { m_tape = nullptr; reset(); }
+
+protected:
+    void onDraw(Draw& draw) override;
+    void onKey(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt) override;
+    void onText(char ch) override;
+
+private:
+    int m_topIndex;
+    int m_index;
+    Tape* m_tape;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// A tape-browser overlay
+// Contains a single tape, and allows controls
+//----------------------------------------------------------------------------------------------------------------------
+
+class TapeBrowser final : public Overlay
+{
+public:
+    TapeBrowser(Nx& nx);
+
+    Tape* loadTape(const vector<u8>& data);
+
+protected:
+    void render(Draw& draw) override;
+    void key(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt) override;
+    void text(char ch) override;
+    const vector<string>& commands() const override;
+
+private:
+    TapeWindow      m_window;
+    vector<string>  m_commands;
+    Tape*           m_currentTape;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
@@ -1,8 +1,7 @@
 //----------------------------------------------------------------------------------------------------------------------
-// Tape browser
+// Tape emulation
 //----------------------------------------------------------------------------------------------------------------------
 
-#include <emulator/nx.h>
 #include <tape/tape.h>
 
 #include <algorithm>
@@ -17,6 +16,9 @@ Tape::Tape()
     , m_index(0)
     , m_bitIndex(15)
     , m_counter(0)
+    , m_output(0)
+    , m_edgeTStates(0)
+    , m_edgeCount(0)
 {
 
 }
@@ -147,13 +149,28 @@ void Tape::selectBlock(int i)
     m_currentBlock = i;
 }
 
+Tape::Position Tape::getPosition() const
+{
+    return { m_currentBlock, int(m_state), m_index, m_bitIndex, m_counter, m_output, m_edgeTStates, m_edgeCount };
+}
+
+void Tape::setPosition(const Position& position)
+{
+    m_currentBlock = position.block;
+    m_state = State(position.state);
+    m_index = position.index;
+    m_bitIndex = position.bitIndex;
+    m_counter = position.counter;
+    m_output = position.output;
+    m_edgeTStates = position.edgeTStates;
+    m_edgeCount = position.edgeCount;
+}
+
 u8 Tape::play(TState tStates)
 {
     m_counter -= (int)tStates;
     u8 result = 0;
 
-    static int bits = 0;
-
     for (;;)
     {
         switch (m_state)
@@ -220,7 +237,7 @@ u8 Tape::play(TState tStates)
             {
                 // Transition to Data
                 m_bitIndex = 15;
-                bits = 0;
+                m_edgeCount = 0;
                 nextBit();
                 continue;
             }
@@ -240,27 +257,44 @@ u8 Tape::play(TState tStates)
         break;
     }
 
-    static TState total = 0;
-    static u8 lastBit = result;
-
-    total += tStates;
-    if (result != lastBit)
+    m_edgeTStates += tStates;
+    if (result != m_output)
     {
         // Edge detected
-        NX_LOG("Edge after: %dT [%d->%d]\n", (int)total, lastBit, result);
-        total = 0;
-        if (bits++ == 16)
+        NX_LOG("Edge after: %dT [%d->%d]\n", (int)m_edgeTStates, m_output, result);
+        m_edgeTStates = 0;
+        if (m_edgeCount++ == 16)
         {
             NX_LOG("--------------------------------------------------\n");
-            bits = 0;
+            m_edgeCount = 0;
         }
     }
-    lastBit = result;
-
+    m_output = result;
 
     return result << 6;
 }
 
+TState Tape::nextEdge() const
+{
+    switch (m_state)
+    {
+    case State::Stopped:
+        return 0;
+
+    case State::Pilot:
+        // The pilot tone toggles every 2168 t-states within the state.
+        return max(1, min(m_counter % 2168 + 1, m_counter));
+
+    case State::Quiet:
+        // The end of a data block switches to quiet but still outputs the last bit's low level.  The quiet high
+        // level starts on the next call.
+        return m_output ? max(1, m_counter) : 1;
+
+    default:
+        return max(1, m_counter);
+    }
+}
+
 bool Tape::nextBit()
 {
     m_state = State::Data;
@@ -293,243 +327,5 @@ bool Tape::nextBit()
     return false;
 }
 
-//----------------------------------------------------------------------------------------------------------------------
-// Tape window
-//----------------------------------------------------------------------------------------------------------------------
-
-TapeWindow::TapeWindow(Nx& nx)
-    : Window(nx, 1, 1, 40, 60, "Tape Browser", Colour::Black, Colour::White, true)
-    , m_topIndex(0)
-    , m_index(0)
-    , m_tape(nullptr)
-{
-
-}
-
-void TapeWindow::reset()
-{
-    m_index = m_topIndex = 0;
-}
-
-void TapeWindow::onDraw(Draw& draw)
-{
-    if (!m_tape)
-    {
-        draw.printSquashedString(m_x + 2, m_y + 2, "No tape inserted.  Open a tape file. ",
-            draw.attr(Colour::White, Colour::Red, true));
-    }
-    else
-    {
-        int numBlocks = m_tape->numBlocks();
-        int y = m_y + 1;
-
-        for (int i = m_topIndex; (i < numBlocks) && (y < (m_topIndex + m_height - 2)); i++, y+=2)
-        {
-            u8 colour = 0;
-
-            if (i == m_index)
-            {
-                colour = draw.attr(Colour::Black, Colour::Yellow, true);
-            }
-            else
-            {
-                colour = draw.attr(Colour::Black, Colour::White, (y & 2) != 0);
-            }
-            draw.attrRect(m_x, y, m_width, 2, colour);
-
-            Tape::BlockType type = m_tape->getBlockType(i);
-            string category, desc1, desc2;
-            switch (type)
-            {
-            case Tape::BlockType::Program:
-                {
-                    category = "     PROGRAM";
-                    Tape::Header hdr = m_tape->getHeader(i);
-                    desc1 = draw.format("\"%s\"", hdr.fileName.c_str());
-                    desc2 = draw.format("auto: %d, length: %d", hdr.u.p.autoStartLine, hdr.u.p.programLength);
-                }
-                break;
-
-            case Tape::BlockType::NumberArray:
-                {
-                    category = "NUMBER ARRAY";
-                    Tape::Header hdr = m_tape->getHeader(i);
-                    desc1 = draw.format("\"%s\"", hdr.fileName.c_str());
-                    desc2 = draw.format("name: %c, length: %d", hdr.u.a.variableName, hdr.u.a.arrayLength);
-                }
-                break;
-
-            case Tape::BlockType::StringArray:
-                {
-                    category = "STRING ARRAY";
-                    Tape::Header hdr = m_tape->getHeader(i);
-                    desc1 = draw.format("\"%s\"", hdr.fileName.c_str());
-                    desc2 = draw.format("name: %c$, length: %d", hdr.u.a.variableName, hdr.u.a.arrayLength);
-                }
-                break;
-
-            case Tape::BlockType::Bytes:
-                {
-                    category = "       BYTES";
-                    Tape::Header hdr = m_tape->getHeader(i);
-                    desc1 = draw.format("\"%s\"", hdr.fileName.c_str());
-                    desc2 = draw.format("start: $%04x, length: %d", hdr.u.b.startAddress, hdr.u.b.dataLength);
-                }
-                break;
-
-            case Tape::BlockType::Block:
-                {
-                    category = "       BLOCK";
-                    desc1 = draw.format("Length: %d", m_tape->getBlockLength(i) - 2);
-                    desc2 = "";
-                }
-                break;
-            }
-
-            draw.printString(m_x + 2, y, category.c_str(), false, colour);
-            draw.printSquashedString(m_x + 16, y, desc1.c_str(), colour);
-            draw.printSquashedString(m_x + 16, y + 1, desc2.c_str(), colour);
-
-            if (m_tape->getCurrentBlock() == i)
-            {
-                draw.printChar(m_x + 1, y, m_tape->isPlaying() ? '*' : ')', colour, gGfxFont);
-            }
-        }
-    }
-}
-
-void TapeWindow::onKey(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt)
-{
-    using K = sf::Keyboard::Key;
-
-    if (!m_tape) return;
-    if (!down) return;
-
-    int halfSize = (m_height - 2) / 4;
-
-    if (!shift && !ctrl && !alt)
-    {
-        switch (key)
-        {
-        case K::Up:
-            if (m_index > 0)
-            {
-                --m_index;
-                while (m_index < m_topIndex)
-                {
-                    m_topIndex = max(0, m_topIndex - ((m_height - 2) / 4));
-                }
-            }
-            break;
-
-        case K::Down:
-            if (m_index < (m_tape->numBlocks() - 1))
-            {
-                ++m_index;
-                if ((m_index >= (m_topIndex + halfSize)) &&
-                    (m_tape->numBlocks() > (2 * halfSize)))
-                {
-                    // Cursor has gone past halfway on a list that's bigger than the window
-                    ++m_topIndex;
-                }
-            }
-            break;
-
-        case K::Return:
-            m_tape->stop();
-            m_tape->selectBlock(m_index);
-            break;
-                
-        default:
-            break;
-        }
-    }
-}
-
-void TapeWindow::onText(char ch)
-{
-
-}
-
-//----------------------------------------------------------------------------------------------------------------------
-// Tape browser overlay
-//----------------------------------------------------------------------------------------------------------------------
-
-TapeBrowser::TapeBrowser(Nx& nx)
-    : Overlay(nx)
-    , m_window(nx)
-    , m_commands({
-        "Esc/Ctrl-T|Exit",
-        "Up|Cursor up",
-        "Down|Cursor down",
-        "Enter|Select tape position",
-        "Ctrl-Space|Play/Stop"
-        })
-    , m_currentTape(nullptr)
-{
-
-}
-
-Tape* TapeBrowser::loadTape(const vector<u8>& data)
-{
-    if (m_currentTape)
-    {
-        delete m_currentTape;
-    }
-
-    m_currentTape = new Tape(data);
-    m_window.setTape(m_currentTape);
-    return m_currentTape;
-}
-
-void TapeBrowser::render(Draw& draw)
-{
-    m_window.draw(draw);
-}
-
-void TapeBrowser::key(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt)
-{
-    using K = sf::Keyboard::Key;
-
-    if (down && !shift && !ctrl && !alt)
-    {
-        switch (key)
-        {
-        case K::Escape:
-            getEmulator().hideAll();
-            break;
-
-        default:
-            if (down) m_window.keyPress(key, down, shift, ctrl, alt);
-        }
-    }
-    else if (down && !shift && ctrl && !alt)
-    {
-        switch (key)
-        {
-        case K::Space:
-            if (m_currentTape) m_currentTape->toggle();
-            break;
-
-        case K::T:
-            getEmulator().hideAll();
-            break;
-                
-        default:
-            break;
-        }
-    }
-}
-
-void TapeBrowser::text(char ch)
-{
-
-}
-
-const vector<string>& TapeBrowser::commands() const
-{
-    return m_commands;
-}
-
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
@@ -6,7 +6,6 @@
 
 #include <config.h>
 #include <types.h>
-#include <utils/ui.h>
 
 #include <string>
 #include <vector>
@@ -84,8 +83,27 @@ public:
     int getCurrentBlock() const { return m_currentBlock; }
     u8 play(TState tStates);
 
+    // The number of t-states that can be passed to play() before its result might change.
+    TState nextEdge() const;
+
     bool isPlaying() const { return m_state != State::Stopped; }
 
+    // Where the tape is, so that it can be put back there when the machine is rewound.
+    struct Position
+    {
+        int         block;
+        int         state;
+        int         index;
+        int         bitIndex;
+        int         counter;
+        u8          output;
+        TState      edgeTStates;
+        int         edgeCount;
+    };
+
+    Position getPosition() const;
+    void setPosition(const Position& position);
+
 private:
     // Returns true if end of block
     bool nextBit();
@@ -112,56 +130,12 @@ private:
     int         m_index;
     int         m_bitIndex;
     int         m_counter;
-};
-
-//----------------------------------------------------------------------------------------------------------------------
-// TapeWindow
-//----------------------------------------------------------------------------------------------------------------------
-
-class TapeWindow final : public Window
-{
-public:
-    TapeWindow(Nx& nx);
-
-    void reset();
-    void setTape(Tape *tape)    { m_tape = tape; reset(); m_tape->selectBlock(0); }
-    void ejectTape()            { m_tape = nullptr; reset(); }
-
-protected:
-    void onDraw(Draw& draw) override;
-    void onKey(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt) override;
-    void onText(char ch) override;
+    u8          m_output;       // Result of the last call to play()
 
-private:
-    int m_topIndex;
-    int m_index;
-    Tape* m_tape;
+    // Edge logging
+    TState      m_edgeTStates;  // T-states since the last edge
+    int         m_edgeCount;    // Edges since the last separator
 };
 
 //----------------------------------------------------------------------------------------------------------------------
-// A tape-browser overlay
-// Contains a single tape, and allows controls
 //----------------------------------------------------------------------------------------------------------------------
-
-class TapeBrowser final : public Overlay
-{
-public:
-    TapeBrowser(Nx& nx);
-
-    Tape* loadTape(const vector<u8>& data);
-
-protected:
-    void render(Draw& draw) override;
-    void key(sf::Keyboard::Key key, bool down, bool shift, bool ctrl, bool alt) override;
-    void text(char ch) override;
-    const vector<string>& commands() const override;
-
-private:
-    TapeWindow      m_window;
-    vector<string>  m_commands;
-    Tape*           m_currentTape;
-};
-
-//----------------------------------------------------------------------------------------------------------------------
-//----------------------------------------------------------------------------------------------------------------------
-
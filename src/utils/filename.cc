@@ -144,6 +144,6 @@ bool Path::hasExtension() const
 string Path::extension() const
 {
     assert(m_elems.size() > 0);
-    size_t i = m_elems.back().find('.');
+    size_t i = m_elems.back().rfind('.');
     return m_elems.back().substr(i);
 }
@@ -3,6 +3,7 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 #include <algorithm>
+#include <cstdio>
 #include <utils/format.h>
 
 string decimalWord(u16 x)
@@ -113,3 +114,10 @@ string intString(int x, int pad)
     s.insert(0, max(0, pad - int(s.size())), ' ');
     return s;
 }
+
+string percentString(u64 x, u64 total)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%5.1f%%", total ? 100.0 * double(x) / double(total) : 0.0);
+    return buffer;
+}
@@ -5,6 +5,8 @@
 #pragma once
 
 #include <codecvt>
+#include <cstring>
+#include <locale>
 #include <types.h>
 #include <config.h>
 
@@ -27,6 +29,7 @@ string decimalByte(u8 x);
 string hexWord(u16 x);
 string hexByte(u8 x);
 string intString(int x, int pad);
+string percentString(u64 x, u64 total);     // x as a percentage of total, padded to 6 characters
 
 bool parseNumber(const string& str, int& i);
 bool parseByte(const string& str, u8& out);
@@ -109,8 +109,6 @@ const u8 gGfxFont[] = {
 // Overlays
 //----------------------------------------------------------------------------------------------------------------------
 
-Overlay* Overlay::ms_currentOverlay = 0;
-
 Overlay::Overlay(Nx& nx)
     : m_nx(nx)
     , m_errorString()
@@ -121,13 +119,14 @@ Overlay::Overlay(Nx& nx)
 
 void Overlay::toggle(Overlay& fallbackOverlay)
 {
-    selectIf(ms_currentOverlay != this, fallbackOverlay);
+    selectIf(getEmulator().getUi().currentOverlay() != this, fallbackOverlay);
 }
 
 void Overlay::select()
 {
-    if (ms_currentOverlay) ms_currentOverlay->m_counter = 0;
-    ms_currentOverlay = this;
+    Ui& ui = getEmulator().getUi();
+    if (ui.currentOverlay()) ui.currentOverlay()->m_counter = 0;
+    ui.select(*this);
 }
 
 void Overlay::selectIf(bool selectCond, Overlay& fallbackOverlay)
@@ -184,9 +183,10 @@ bool Overlay::renderErrors(Draw& draw)
 // Draw
 //----------------------------------------------------------------------------------------------------------------------
 
-Draw::Draw(std::vector<u8>& pixels, std::vector<u8>& attr)
+Draw::Draw(std::vector<u8>& pixels, std::vector<u8>& attr, std::vector<u8>& drawn)
     : m_pixels(pixels)
     , m_attrs(attr)
+    , m_drawn(drawn)
 {
 
 }
@@ -200,6 +200,7 @@ void Draw::pokePixel(int xCell, int yPixel, u8 bits)
     assert(xCell < (kUiWidth / 8));
     assert(yPixel < kUiHeight);
     m_pixels[yPixel * (kUiWidth / 8) + xCell] = bits;
+    m_drawn[(yPixel / 8) * (kUiWidth / 8) + xCell] = 1;
 }
 
 void Draw::andPixel(int xCell, int yPixel, u8 bits)
@@ -207,6 +208,7 @@ void Draw::andPixel(int xCell, int yPixel, u8 bits)
     assert(xCell < (kUiWidth / 8));
     assert(yPixel < kUiHeight);
     m_pixels[yPixel * (kUiWidth / 8) + xCell] &= bits;
+    m_drawn[(yPixel / 8) * (kUiWidth / 8) + xCell] = 1;
 }
 
 void Draw::orPixel(int xCell, int yPixel, u8 bits)
@@ -214,6 +216,7 @@ void Draw::orPixel(int xCell, int yPixel, u8 bits)
     assert(xCell < (kUiWidth / 8));
     assert(yPixel < kUiHeight);
     m_pixels[yPixel * (kUiWidth / 8) + xCell] |= bits;
+    m_drawn[(yPixel / 8) * (kUiWidth / 8) + xCell] = 1;
 }
 
 void Draw::xorPixel(int xCell, int yPixel, u8 bits)
@@ -221,6 +224,7 @@ void Draw::xorPixel(int xCell, int yPixel, u8 bits)
     assert(xCell < (kUiWidth / 8));
     assert(yPixel < kUiHeight);
     m_pixels[yPixel * (kUiWidth / 8) + xCell] ^= bits;
+    m_drawn[(yPixel / 8) * (kUiWidth / 8) + xCell] = 1;
 }
 
 void Draw::pokeAttr(int xCell, int yCell, u8 attr)
@@ -228,6 +232,7 @@ void Draw::pokeAttr(int xCell, int yCell, u8 attr)
     assert(xCell < (kUiWidth / 8));
     assert(yCell < (kUiHeight / 8));
     m_attrs[yCell * (kUiWidth / 8) + xCell] = attr;
+    m_drawn[yCell * (kUiWidth / 8) + xCell] = 1;
 }
 
 u8 Draw::attr(Colour ink, Colour paper, bool bright)
@@ -462,13 +467,63 @@ void Draw::window(int xCell, int yCell, int width, int height, const string& tit
 // UI class
 //----------------------------------------------------------------------------------------------------------------------
 
+namespace
+{
+    struct UiTables
+    {
+        u32     colours[2][256][2];     // [flash phase][attribute] -> paper, ink
+        u32     masks[256][8];          // [pixel byte] -> ~0 for each pixel that is ink
+
+        UiTables()
+        {
+            static const u32 palette[16] =
+            {
+                0xdf000000, 0xdfd70000, 0xdf0000d7, 0xdfd700d7, 0xdf00d700, 0xdfd7d700, 0xdf00d7d7, 0xdfd7d7d7,
+                0xdf000000, 0xdfff0000, 0xdf0000ff, 0xdfff00ff, 0xdf00ff00, 0xdfffff00, 0xdf00ffff, 0xdfffffff,
+            };
+
+            for (int attr = 0; attr < 256; ++attr)
+            {
+                // Bright is either 0x08 or 0x00.  An attribute of 0 is see-through.
+                int bright = (attr & 0x40) >> 3;
+                u32 paper = attr ? palette[((attr & 0x38) >> 3) + bright] : 0;
+                u32 ink = attr ? palette[(attr & 0x07) + bright] : 0;
+                bool swap = (attr & 0x80) != 0;
+
+                colours[0][attr][0] = paper;
+                colours[0][attr][1] = ink;
+                colours[1][attr][0] = swap ? ink : paper;
+                colours[1][attr][1] = swap ? paper : ink;
+            }
+
+            for (int pixels = 0; pixels < 256; ++pixels)
+            {
+                for (int p = 0; p < 8; ++p) masks[pixels][p] = (pixels & (0x80 >> p)) ? 0xffffffff : 0;
+            }
+        }
+    };
+
+    const UiTables gUiTables;
+
+    const int kUiCellsWide = kUiWidth / 8;
+    const int kUiCellsHigh = kUiHeight / 8;
+}
+
 Ui::Ui(Spectrum& speccy)
-    : m_image(new u32 [kUiWidth * kUiHeight])
+    : m_image(new u32 [kUiWidth * kUiHeight]())
     , m_uiTexture()
     , m_uiSprite()
-    , m_pixels(kUiWidth / 8 * kUiHeight)
-    , m_attrs(kUiWidth / 8 * kUiHeight / 8)
+    , m_pixels(kUiCellsWide * kUiHeight)
+    , m_attrs(kUiCellsWide * kUiCellsHigh)
     , m_speccy(speccy)
+    , m_drawn(kUiCellsWide * kUiCellsHigh)
+    , m_wiped(kUiCellsWide * kUiCellsHigh)
+    , m_shownPixels(kUiCellsWide * kUiCellsHigh)
+    , m_shownAttrs(kUiCellsWide * kUiCellsHigh)
+    , m_dirtyFirst(0)
+    , m_dirtyLast(kUiHeight - 1)
+    , m_layoutSource(nullptr)
+    , m_currentOverlay(nullptr)
 {
     m_uiTexture.create(kUiWidth, kUiHeight);
     m_uiSprite.setTexture(m_uiTexture);
@@ -476,8 +531,17 @@ Ui::Ui(Spectrum& speccy)
 
 void Ui::clear()
 {
-    m_pixels.assign(kUiWidth / 8 * kUiHeight, 0x00);
-    m_attrs.assign(kUiWidth / 8 * kUiHeight / 8, 0x00);
+    // Every cell that hasn't been drawn to is already blank.
+    for (int cell = 0; cell < kUiCellsWide * kUiCellsHigh; ++cell)
+    {
+        if (!m_drawn[cell]) continue;
+
+        u8* pixels = &m_pixels[(cell / kUiCellsWide) * kUiWidth + (cell % kUiCellsWide)];
+        for (int i = 0; i < 8; ++i) pixels[i * kUiCellsWide] = 0;
+        m_attrs[cell] = 0;
+        m_drawn[cell] = 0;
+        m_wiped[cell] = 1;
+    }
 }
 
 void Ui::render(bool flash)
@@ -485,96 +549,128 @@ void Ui::render(bool flash)
     //
     // Render the overlay
     //
-    Draw draw(m_pixels, m_attrs);
+    Draw draw(m_pixels, m_attrs, m_drawn);
     clear();
-    if (Overlay::currentOverlay())
+    if (m_currentOverlay)
     {
-        Overlay::currentOverlay()->render(draw);
+        m_currentOverlay->render(draw);
     }
 
     //
     // Render the error message
     //
-    if (!Overlay::currentOverlay()->renderErrors(draw))
+    if (!m_currentOverlay->renderErrors(draw))
     {
         //
         // Render the commands
         //
-        const vector<string>& commands = Overlay::currentOverlay()->commands();
-        if (commands.size() > 0)
+        const vector<string>& commands = m_currentOverlay->commands();
+        if (&commands != m_layoutSource)
         {
-            int y = 63;
-            int x = 0;
-            u8 bkg = draw.attr(Colour::Black, Colour::White, true);
-            u8 hi = draw.attr(Colour::White, Colour::Red, true);
-            for (const auto& str : commands)
-            {
-                vector<string> ss = split(str, '|');
-                int len = (int)ss[0].length() + draw.squashedStringWidth(ss[1]);
-                if (x + len >= 80)
-                {
-                    for (; x < 80; ++x) draw.printChar(x, y, ' ', bkg);
-                    --y;
-                    x = 0;
-                }
-                x = draw.printString(x, y, ss[0], false, hi);
-                x += draw.printSquashedString(x, y, ss[1], bkg);
-                draw.printChar(x++, y, ' ', bkg);
-            }
-            for (; x < 80; ++x) draw.printChar(x, y, ' ', bkg);
+            layoutCommands(draw, commands);
+            m_layoutSource = &commands;
         }
+        renderCommands(draw);
     }
 
     //
-    // Convert the Ui VRAM into actual renderable pixels
+    // Convert the Ui VRAM into actual renderable pixels.  Only the cells drawn to this time or last time can have
+    // changed.
     //
+    for (int cell = 0; cell < kUiCellsWide * kUiCellsHigh; ++cell)
+    {
+        if (m_drawn[cell] | m_wiped[cell])
+        {
+            m_wiped[cell] = 0;
+            updateCell(cell, flash);
+        }
+    }
+}
+
+void Ui::updateCell(int cell, bool flash)
+{
+    int xCell = cell % kUiCellsWide;
+    int yCell = cell / kUiCellsWide;
+    const u8* pixels = &m_pixels[yCell * kUiWidth + xCell];
 
-    static const u32 colours[16] =
+    // A see-through cell looks the same whatever its pixels are.
+    u8 a = m_attrs[cell];
+    u64 p = 0;
+    if (a)
     {
-        0xdf000000, 0xdfd70000, 0xdf0000d7, 0xdfd700d7, 0xdf00d700, 0xdfd7d700, 0xdf00d7d7, 0xdfd7d7d7,
-        0xdf000000, 0xdfff0000, 0xdf0000ff, 0xdfff00ff, 0xdf00ff00, 0xdfffff00, 0xdf00ffff, 0xdfffffff,
-    };
+        for (int i = 0; i < 8; ++i) p |= u64(pixels[i * kUiCellsWide]) << (i * 8);
+    }
+    u16 shownAttr = u16(a) | ((flash && (a & 0x80)) ? 0x100 : 0);
+    if (p == m_shownPixels[cell] && shownAttr == m_shownAttrs[cell]) return;
+
+    m_shownPixels[cell] = p;
+    m_shownAttrs[cell] = shownAttr;
 
-    // Convert the pixels and attrs into an image
-    u32* img = m_image;
-    for (int row = 0; row < kUiHeight; ++row)
+    const u32* colours = gUiTables.colours[flash ? 1 : 0][a];
+    u32 paper = colours[0];
+    u32 diff = paper ^ colours[1];
+    u32* img = m_image + (yCell * 8) * kUiWidth + xCell * 8;
+    for (int row = 0; row < 8; ++row, img += kUiWidth)
     {
-        u8* attrRow = m_attrs.data() + ((row >> 3) * (kUiWidth >> 3));
-        u8* pixelRow = m_pixels.data() + (row * (kUiWidth >> 3));
+        const u32* mask = gUiTables.masks[u8(p >> (row * 8))];
+        for (int i = 0; i < 8; ++i) img[i] = paper ^ (diff & mask[i]);
+    }
 
-        for (int col = 0; col < kUiWidth / 8; ++col)
-        {
-            u8 p = *pixelRow++;
-            u8 a = *attrRow++;
+    m_dirtyFirst = min(m_dirtyFirst, yCell * 8);
+    m_dirtyLast = max(m_dirtyLast, yCell * 8 + 7);
+}
 
-            if (0 == a)
-            {
-                for (int bit = 0; bit < 8; ++bit) *img++ = 0x00000000;
-            }
-            else
-            {
-                u8 ink = a & 0x07;
-                u8 paper = (a & 0x38) >> 3;
-                u8 bright = (a & 0x40) >> 3;
-
-                if (flash && ((a & 0x80) != 0))
-                {
-                    swap(ink, paper);
-                }
-
-                for (int bit = 0; bit < 8; ++bit)
-                {
-                    *img++ = (p & 0x80) != 0 ? colours[ink + bright] : colours[paper + bright];
-                    p <<= 1;
-                }
-            }
+void Ui::layoutCommands(Draw& draw, const vector<string>& commands)
+{
+    // The commands fill the bottom row first and push any that don't fit onto rows above.
+    m_commandLayout.clear();
+    m_commandPadding.clear();
+    if (commands.empty()) return;
+
+    int y = 63;
+    int x = 0;
+    for (const auto& str : commands)
+    {
+        vector<string> ss = split(str, '|');
+        int labelWidth = draw.squashedStringWidth(ss[1]);
+        int len = (int)ss[0].length() + labelWidth;
+        if (x + len >= 80)
+        {
+            m_commandPadding.emplace_back(x, y);
+            --y;
+            x = 0;
         }
+        m_commandLayout.push_back({ x, y, ss[0], ss[1], labelWidth });
+        x += len + 1;
+    }
+    m_commandPadding.emplace_back(x, y);
+}
+
+void Ui::renderCommands(Draw& draw)
+{
+    u8 bkg = draw.attr(Colour::Black, Colour::White, true);
+    u8 hi = draw.attr(Colour::White, Colour::Red, true);
+    for (const auto& command : m_commandLayout)
+    {
+        int x = draw.printString(command.x, command.y, command.key, false, hi);
+        x += draw.printSquashedString(x, command.y, command.label, bkg);
+        draw.printChar(x, command.y, ' ', bkg);
+    }
+    for (const auto& padding : m_commandPadding)
+    {
+        for (int x = padding.first; x < 80; ++x) draw.printChar(x, padding.second, ' ', bkg);
     }
 }
 
 sf::Sprite& Ui::getSprite()
 {
-    m_uiTexture.update((const sf::Uint8 *)m_image);
+    if (m_dirtyFirst <= m_dirtyLast)
+    {
+        m_uiTexture.update((const sf::Uint8 *)(m_image + m_dirtyFirst * kUiWidth), kUiWidth,
+            unsigned(m_dirtyLast - m_dirtyFirst + 1), 0, unsigned(m_dirtyFirst));
+        m_dirtyFirst = kUiHeight;
+        m_dirtyLast = -1;
+    }
     return m_uiSprite;
 }
 
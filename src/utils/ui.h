@@ -43,7 +43,7 @@ class Draw
     friend class Ui;
 
 public:
-    Draw(vector<u8>& pixels, vector<u8>& attr);
+    Draw(vector<u8>& pixels, vector<u8>& attr, vector<u8>& drawn);
 
     //
     // Level 0 - poking/low-level calculations
@@ -78,6 +78,7 @@ private:
 private:
     vector<u8>&     m_pixels;
     vector<u8>&     m_attrs;
+    vector<u8>&     m_drawn;        // Set for each 8x8 cell written to
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -102,8 +103,6 @@ public:
     virtual void text(char ch) = 0;
     virtual const vector<string>& commands() const { static vector<string> vs; return vs; }
 
-    static Overlay* currentOverlay() { return ms_currentOverlay; }
-
     void error(string msg);
     bool renderErrors(Draw& draw);
 
@@ -114,7 +113,6 @@ protected:
     const Spectrum& getSpeccy() const;
 
 private:
-    static Overlay*     ms_currentOverlay;
     Nx&                 m_nx;
 
     string              m_errorString;
@@ -130,22 +128,32 @@ class Ui
 public:
     Ui(Spectrum& speccy);
 
-    // Overlay selection
-    void toggle(Overlay& overlay);
-    void select(Overlay& overlay);
+    // Overlay selection.  Use Overlay::select() rather than calling select() directly.
+    Overlay* currentOverlay() const { return m_currentOverlay; }
+    void select(Overlay& overlay) { m_currentOverlay = &overlay; }
 
-    // Clear the screen
+    // Clear the screen.  Only the cells drawn to since the last clear are wiped.
     void clear();
 
-    // Render the screen
+    // Render the screen.  Only the cells that look different from last time are converted into the image.
     void render(bool flash);
 
-    // UI sprite
+    // UI sprite.  Only the rows of the image that have changed since last time are sent to the texture.
     sf::Sprite& getSprite();
 
-    // VRAM
-    vector<u8>& getPixels() { return m_pixels; }
-    vector<u8>& getAttrs() { return m_attrs; }
+private:
+    struct CommandLayout
+    {
+        int         x;
+        int         y;
+        string      key;
+        string      label;
+        int         labelWidth;     // In cells
+    };
+
+    void layoutCommands(Draw& draw, const vector<string>& commands);
+    void renderCommands(Draw& draw);
+    void updateCell(int cell, bool flash);
 
 private:
     // Video state
@@ -155,6 +163,22 @@ private:
     vector<u8>      m_pixels;
     vector<u8>      m_attrs;
     Spectrum&       m_speccy;
+
+    // Dirty cell state
+    vector<u8>      m_drawn;        // Cells drawn to since the last clear
+    vector<u8>      m_wiped;        // Cells wiped by the last clear
+    vector<u64>     m_shownPixels;  // The 8 pixel bytes of each cell as they are in the image
+    vector<u16>     m_shownAttrs;   // The attribute of each cell as it is in the image, with 0x100 if flashed
+    int             m_dirtyFirst;   // Rows of the image not yet sent to the texture
+    int             m_dirtyLast;
+
+    // Command bar state
+    const vector<string>*   m_layoutSource;
+    vector<CommandLayout>   m_commandLayout;
+    vector<pair<int, int>>  m_commandPadding;   // Where each row of the bar ends as (x, y)
+
+    // Overlay state
+    Overlay*        m_currentOverlay;
 };
 
 //----------------------------------------------------------------------------------------------------------------------